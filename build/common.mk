@@ -47,6 +47,7 @@ MRI_UART ?= MRI_UART_MBED_USB
 HEAP_TAGS ?= 0
 WRITE_BUFFER_DISABLE ?= 0
 STACK_SIZE ?= 0
+PROFILE ?= 0
 
 
 # Configure MRI variables based on BUILD_TYPE build type variable.
@@ -140,6 +141,13 @@ ifeq "$(OPTIMIZATION)" "0"
 DEFINES += -DDEBUG
 endif
 
+# the profiling zones are never built into Release
+ifneq "$(BUILD_TYPE)" "Release"
+DEFINES += -DPROFILE_ENABLE=$(PROFILE)
+else
+DEFINES += -DPROFILE_ENABLE=0
+endif
+
 # Libraries to be linked into final binary
 MBED_LIBS = $(MBED_DIR)/$(DEVICE)/GCC_ARM/libmbed.a
 SYS_LIBS = -lstdc++_s -lsupc++_s -lm -lgcc -lc_s -lgcc -lc_s -lnosys
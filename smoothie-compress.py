@@ -0,0 +1,239 @@
+#!/usr/bin/env python
+"""\
+Compress g-code so Smoothie can play it without decompressing it first
+
+The output is a heatshrink LZSS stream behind a 12 byte header, see
+src/modules/utils/player/ShrinkReader.h for the format. Copy the .gcz file
+to the sd card over usb, the network or sftp and play it like any other file.
+The serial upload command and M28 only take text, they cannot upload it.
+"""
+
+from __future__ import print_function
+import sys
+import argparse
+import os
+import struct
+
+MAGIC = b'HSGC'
+VERSION = 1
+HEADER_SIZE = 12
+MAX_WINDOW_BITS = 12
+CHAIN = 32 # positions tried for each match, more compresses a little better and a lot slower
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.byte = 0
+        self.bits = 0
+
+    def put(self, value, count):
+        for i in range(count - 1, -1, -1):
+            self.byte = (self.byte << 1) | ((value >> i) & 1)
+            self.bits += 1
+            if self.bits == 8:
+                self.out.append(self.byte)
+                self.byte = 0
+                self.bits = 0
+
+    def finish(self):
+        if self.bits > 0:
+            self.out.append(self.byte << (8 - self.bits))
+        return self.out
+
+
+class BitReader:
+    def __init__(self, data, pos):
+        self.data = data
+        self.pos = pos
+        self.byte = 0
+        self.mask = 0
+
+    def get(self, count):
+        value = 0
+        for i in range(count):
+            if self.mask == 0:
+                if self.pos >= len(self.data):
+                    return -1
+                self.byte = self.data[self.pos]
+                self.pos += 1
+                self.mask = 0x80
+            value = (value << 1) | (1 if self.byte & self.mask else 0)
+            self.mask >>= 1
+        return value
+
+
+def compress(data, window_bits, lookahead_bits):
+    window = 1 << window_bits
+    longest = 1 << lookahead_bits
+    # a copy only pays if it is shorter than the literals it replaces
+    shortest = 1
+    while 9 * shortest <= 1 + window_bits + lookahead_bits:
+        shortest += 1
+
+    bw = BitWriter()
+    chains = {}
+    n = len(data)
+    i = 0
+    while i < n:
+        best_len = 0
+        best_dist = 0
+        if i + 3 <= n:
+            key = bytes(data[i:i + 3])
+            limit = min(longest, n - i)
+            for p in reversed(chains.get(key, ())):
+                dist = i - p
+                if dist > window:
+                    break
+                l = 3
+                while l < limit and data[p + l] == data[i + l]:
+                    l += 1
+                if l > best_len:
+                    best_len = l
+                    best_dist = dist
+                    if l == limit:
+                        break
+
+        step = best_len if best_len >= shortest else 1
+        if step > 1:
+            bw.put(0, 1)
+            bw.put(best_dist - 1, window_bits)
+            bw.put(best_len - 1, lookahead_bits)
+        else:
+            bw.put(1, 1)
+            bw.put(data[i], 8)
+
+        for j in range(i, min(i + step, n - 2)):
+            key = bytes(data[j:j + 3])
+            chain = chains.get(key)
+            if chain is None:
+                chains[key] = [j]
+            else:
+                chain.append(j)
+                if len(chain) > CHAIN:
+                    del chain[0]
+        i += step
+
+    header = MAGIC + struct.pack('<BBBBI', VERSION, window_bits, lookahead_bits, 0, n)
+    return header + bw.finish()
+
+
+# the same decoder the firmware runs, so a file that decompresses here plays there
+def decompress(data):
+    if len(data) < HEADER_SIZE or data[0:4] != MAGIC:
+        raise ValueError("not a compressed g-code file")
+    version, window_bits, lookahead_bits, reserved, size = struct.unpack('<BBBBI', bytes(data[4:HEADER_SIZE]))
+    if version != VERSION or window_bits < 4 or window_bits > MAX_WINDOW_BITS or lookahead_bits < 3 or lookahead_bits >= window_bits:
+        raise ValueError("unsupported compression parameters")
+
+    mask = (1 << window_bits) - 1
+    window = bytearray(mask + 1)
+    head = 0
+    out = bytearray()
+    br = BitReader(data, HEADER_SIZE)
+    while len(out) < size:
+        tag = br.get(1)
+        if tag < 0:
+            break
+        if tag:
+            c = br.get(8)
+            if c < 0:
+                break
+            window[head & mask] = c
+            head += 1
+            out.append(c)
+        else:
+            index = br.get(window_bits)
+            count = br.get(lookahead_bits)
+            if index < 0 or count < 0:
+                break
+            for k in range(count + 1):
+                if len(out) >= size:
+                    break
+                c = window[(head - index - 1) & mask]
+                window[head & mask] = c
+                head += 1
+                out.append(c)
+
+    if len(out) != size:
+        raise ValueError("truncated, got %d of %d bytes" % (len(out), size))
+    return out
+
+
+def self_test(window_bits, lookahead_bits):
+    import random
+    random.seed(1)
+    line = b'G1 X10.123 Y20.456 E0.789 F1800\n'
+    samples = [
+        b'',
+        b'G',
+        b'\n' * 10000,
+        line * 500,
+        bytearray(random.getrandbits(8) for i in range(5000)),
+        b''.join(('G1 X%.3f Y%.3f E%.4f\n' % (random.uniform(0, 200), random.uniform(0, 200), i * 0.0123)).encode() for i in range(2000)),
+    ]
+    for i, s in enumerate(samples):
+        s = bytearray(s)
+        c = compress(s, window_bits, lookahead_bits)
+        if decompress(c) != s:
+            print("round trip %d failed" % i)
+            return False
+        print("round trip %d ok, %d -> %d bytes" % (i, len(s), len(c)))
+    return True
+
+
+# Define command line argument interface
+parser = argparse.ArgumentParser(description='Compress g-code for playing on Smoothie, or decompress it again.')
+parser.add_argument('file', nargs='?',
+        help='file to compress, or to decompress with -d')
+parser.add_argument('-o','--output',
+        help='output filename, file.gcz by default, or file without .gcz with -d')
+parser.add_argument('-d','--decompress',action='store_true',
+        help='decompress a .gcz file')
+parser.add_argument('-w','--window',type=int,default=11,
+        help='window size bits, 4 to %d, the firmware needs 2^bits bytes of RAM to play it (default 11)' % MAX_WINDOW_BITS)
+parser.add_argument('-l','--lookahead',type=int,default=4,
+        help='longest match bits, 3 to window - 1 (default 4)')
+parser.add_argument('--test',action='store_true',
+        help='round trip some generated g-code and exit')
+parser.add_argument('-q','--quiet',action='store_true',
+        help='suppress all output to terminal')
+
+args = parser.parse_args()
+
+if args.window < 4 or args.window > MAX_WINDOW_BITS or args.lookahead < 3 or args.lookahead >= args.window:
+    print("window must be 4 to %d and lookahead 3 to window - 1" % MAX_WINDOW_BITS)
+    sys.exit(1)
+
+if args.test:
+    sys.exit(0 if self_test(args.window, args.lookahead) else 1)
+
+if args.file is None:
+    parser.print_usage()
+    sys.exit(1)
+
+with open(args.file, 'rb') as f:
+    data = bytearray(f.read())
+
+if args.decompress:
+    output = args.output
+    if output is None:
+        output = args.file[:-4] if args.file.endswith('.gcz') else args.file + '.out'
+    try:
+        result = decompress(data)
+    except ValueError as e:
+        print("Failed to decompress " + args.file + ": " + str(e))
+        sys.exit(1)
+else:
+    output = args.output if args.output is not None else args.file + '.gcz'
+    result = compress(data, args.window, args.lookahead)
+    # every file is checked before it goes anywhere near a printer
+    if decompress(result) != data:
+        print("Round trip check failed, nothing written")
+        sys.exit(1)
+
+with open(output, 'wb') as f:
+    f.write(result)
+
+if not args.quiet:
+    print("%s: %d bytes -> %s: %d bytes" % (args.file, os.path.getsize(args.file), output, len(result)))
@@ -0,0 +1,82 @@
+#!/usr/bin/env python
+"""\
+Symbolize the samples from Smoothie's sampling profiler
+
+On Smoothie run: profile start [hz] [samples], let it run through the job, then profile dump.
+Either save the dump output to a file, or give --telnet to fetch it over the network.
+The addresses are looked up in the elf the firmware was built from with arm-none-eabi-addr2line.
+"""
+
+from __future__ import print_function
+import sys
+import re
+import subprocess
+import argparse
+from collections import Counter
+
+# Define command line argument interface
+parser = argparse.ArgumentParser(description='Symbolize a Smoothie profile dump against the firmware elf.')
+parser.add_argument('elf',
+        help='the elf file of the running firmware, eg LPC1768/main.elf')
+parser.add_argument('dump', nargs='?', type=argparse.FileType('r'), default=sys.stdin,
+        help='file with the output of profile dump, default is stdin')
+parser.add_argument('--telnet', metavar='ipaddr',
+        help='fetch the dump from Smoothie at this IP address instead')
+parser.add_argument('-l','--lines',action='store_true', default=False,
+        help='count per source line instead of per function')
+parser.add_argument('-n','--top', type=int, default=30,
+        help='number of entries to show, default 30')
+parser.add_argument('--addr2line', default='arm-none-eabi-addr2line',
+        help='addr2line to use')
+args = parser.parse_args()
+
+def fetch_dump(ipaddr):
+    import telnetlib
+    tn = telnetlib.Telnet(ipaddr)
+    # read startup prompt
+    # telnetlib sends and receives bytes on python 3
+    tn.read_until(b"> ")
+    tn.write(b"profile dump\n")
+    text = tn.read_until(b"profile end").decode('ascii', 'replace')
+    tn.write(b"exit\n")
+    tn.read_all()
+    return text.splitlines()
+
+lines = fetch_dump(args.telnet) if args.telnet else args.dump.readlines()
+
+# the samples are the hex words between the header and profile end
+samples = []
+header = None
+for line in lines:
+    line = line.strip()
+    if line.startswith("profile samples"):
+        header = line
+        samples = []
+    elif line.startswith("profile end"):
+        break
+    elif header and re.match(r'^[0-9a-fA-F]{8}( [0-9a-fA-F]{8})*$', line):
+        samples.extend(int(w, 16) for w in line.split())
+
+if not samples:
+    print("No samples found, is profile start running?")
+    sys.exit(1)
+
+# look up each distinct address once
+addresses = sorted(set(samples))
+p = subprocess.Popen([args.addr2line, '-f', '-C', '-e', args.elf], stdin=subprocess.PIPE, stdout=subprocess.PIPE, universal_newlines=True)
+out, _ = p.communicate("\n".join("%08x" % a for a in addresses) + "\n")
+out = out.splitlines()
+
+where = {}
+for i, a in enumerate(addresses):
+    function = out[i * 2]
+    fileline = out[i * 2 + 1]
+    where[a] = "%s %s" % (function, fileline) if args.lines else function
+
+counts = Counter(where[a] for a in samples)
+total = len(samples)
+
+print(header)
+print("%7s %6s  %s" % ("samples", "%", "line" if args.lines else "function"))
+for name, n in counts.most_common(args.top):
+    print("%7d %5.1f%%  %s" % (n, 100.0 * n / total, name))
@@ -37,6 +37,7 @@ FATFileHandle::FATFileHandle(FIL_t fh) {
 int FATFileHandle::close() {
     FFSDEBUG("close\n");
     int retval = f_close(&_fh);
+    delete [] _fh.cltbl;
     delete this;
     return retval;
 }
@@ -74,6 +75,10 @@ off_t FATFileHandle::lseek(off_t position, int whence) {
     } else if(whence==SEEK_CUR) {
         position += _fh.fptr;
     }
+    // the first real seek walks the whole cluster chain anyway, so map it then and later seeks are O(1)
+    if(position != 0 && (DWORD)position != _fh.fptr) {
+        build_linkmap();
+    }
     FRESULT res = f_lseek(&_fh, position);
     if(res) {
         FFSDEBUG("lseek failed (%d, %s)\n", res, FR_ERRORS[res]);
@@ -94,6 +99,30 @@ int FATFileHandle::fsync() {
     return 0;
 }
 
+// read only files get a cluster link map so f_lseek does not have to follow the FAT from the start of the file,
+// files being written keep normal seeks as fast seek mode can not extend a file
+bool FATFileHandle::build_linkmap() {
+    if(_fh.cltbl != NULL) return true;
+    if(_fh.flag & FA_WRITE) return false;
+
+    // enough for 15 fragments, if not FatFs tells us how much it needs
+    DWORD size = 32;
+    for(int tries = 0; tries < 2; tries++) {
+        DWORD *tbl = new DWORD[size];
+        if(tbl == NULL) return false;
+        tbl[0] = size;
+        _fh.cltbl = tbl;
+        FRESULT res = f_lseek(&_fh, CREATE_LINKMAP);
+        if(res == FR_OK) return true;
+        _fh.cltbl = NULL;
+        size = tbl[0];
+        delete [] tbl;
+        if(res != FR_NOT_ENOUGH_CORE) break;
+    }
+    FFSDEBUG("build_linkmap failed\n");
+    return false;
+}
+
 off_t FATFileHandle::flen() {
     FFSDEBUG("flen\n");
     return _fh.fsize;
@@ -24,6 +24,8 @@ public:
 
 protected:
 
+    bool build_linkmap();
+
     FIL_t _fh;
 
 };
@@ -0,0 +1,31 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CYCLECOUNTER_H
+#define CYCLECOUNTER_H
+
+#include <stdint.h>
+
+// The Cortex-M3 DWT cycle counter counts core clock cycles, it wraps every 42 seconds at 100MHz
+// so only use it for short intervals, the unsigned subtraction is correct across one wrap.
+// score_cm3.h does not declare the DWT so the registers are addressed directly.
+#define CYCLE_COUNTER_DEMCR  (*(volatile uint32_t *)0xE000EDFCUL)
+#define CYCLE_COUNTER_CTRL   (*(volatile uint32_t *)0xE0001000UL)
+#define CYCLE_COUNTER_CYCCNT (*(volatile uint32_t *)0xE0001004UL)
+
+static inline void enable_cycle_counter()
+{
+    CYCLE_COUNTER_DEMCR |= (1UL << 24); // TRCENA
+    CYCLE_COUNTER_CTRL |= 1UL;          // CYCCNTENA
+}
+
+static inline uint32_t cycle_count()
+{
+    return CYCLE_COUNTER_CYCCNT;
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EventHooks.h"
+#include "Gcode.h"
+
+#include <algorithm>
+
+// Resolve the module's virtual handler for the event to the function that implements it, this uses the GCC extension
+// for getting the function pointer out of a bound pointer to member function, so dispatching skips the vtable lookup
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpmf-conversions"
+EventHooks::EventHook EventHooks::make_hook(_EVENT_ENUM id_event, Module *mod){
+    EventHook hook;
+    hook.module = mod;
+    hook.function = (EventFunction)(mod->*kernel_callback_functions[id_event]);
+    return hook;
+}
+#pragma GCC diagnostic pop
+
+// Adds a hook for a given module and event
+void EventHooks::add(_EVENT_ENUM id_event, Module *mod){
+    this->hooks[id_event].push_back(make_hook(id_event, mod));
+}
+
+// Adds a hook for ON_GCODE_RECEIVED that is only called for the given G or M code, it can be added once per code
+void EventHooks::add_gcode(char letter, uint16_t code, Module *mod){
+    GcodeRoute route;
+    route.key = (letter == 'M') ? (code | 0x8000) : code;
+    route.position = this->hooks[ON_GCODE_RECEIVED].size();
+    route.hook = make_hook(ON_GCODE_RECEIVED, mod);
+
+    // insert after any other route for the same code so they stay in registration order
+    auto it = std::upper_bound(this->gcode_routes.begin(), this->gcode_routes.end(), route.key,
+                               [](uint16_t key, const GcodeRoute& r) { return key < r.key; });
+    this->gcode_routes.insert(it, route);
+}
+
+// Call the modules hooked to the event
+void EventHooks::call(_EVENT_ENUM id_event, void *argument){
+    if(id_event == ON_GCODE_RECEIVED && !gcode_routes.empty()) {
+        call_gcode_received(argument);
+        return;
+    }
+
+    for (auto& h : hooks[id_event]) {
+        h.function(h.module, argument);
+    }
+}
+
+// Call the modules that want every gcode, and those that registered for this one, in the order they registered
+// NOTE a line with both a G and an M code is routed by its G code
+void EventHooks::call_gcode_received(void *argument){
+    Gcode *gcode = static_cast<Gcode *>(argument);
+    const std::vector<EventHook>& all = this->hooks[ON_GCODE_RECEIVED];
+
+    // the routes for this code, usually there are none
+    auto route = this->gcode_routes.end();
+    auto end = route;
+    if(gcode->has_g || gcode->has_m) {
+        uint16_t key = gcode->has_g ? gcode->g : (gcode->m | 0x8000);
+        route = std::lower_bound(this->gcode_routes.begin(), this->gcode_routes.end(), key,
+                                 [](const GcodeRoute& r, uint16_t key) { return r.key < key; });
+        end = std::upper_bound(route, this->gcode_routes.end(), key,
+                               [](uint16_t key, const GcodeRoute& r) { return key < r.key; });
+    }
+
+    for (size_t i = 0; i <= all.size(); i++) {
+        while(route != end && route->position == i) {
+            route->hook.function(route->hook.module, argument);
+            ++route;
+        }
+        if(i < all.size()) all[i].function(all[i].module, argument);
+    }
+}
@@ -0,0 +1,45 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EVENTHOOKS_H
+#define EVENTHOOKS_H
+
+#include "Module.h"
+#include <array>
+#include <vector>
+
+// The modules the Kernel calls for each event, in the order they registered.
+// Modules that only handle a few G or M codes can be hooked to ON_GCODE_RECEIVED for just those.
+class EventHooks {
+    public:
+        void add(_EVENT_ENUM id_event, Module *module);
+        void add_gcode(char letter, uint16_t code, Module *module);
+        void call(_EVENT_ENUM id_event, void *argument);
+
+    private:
+        // the module's handler is looked up once when it registers, so calling it is a plain function call
+        typedef void (*EventFunction)(Module *module, void *argument);
+        struct EventHook {
+            Module *module;
+            EventFunction function;
+        };
+        static EventHook make_hook(_EVENT_ENUM id_event, Module *module);
+
+        // modules that only want ON_GCODE_RECEIVED for some G or M codes, sorted by key
+        struct GcodeRoute {
+            uint16_t key;      // the code, with bit 15 set for M codes
+            uint16_t position; // where it goes in hooks[ON_GCODE_RECEIVED], so modules are still called in the order they registered
+            EventHook hook;
+        };
+        void call_gcode_received(void *argument);
+
+        // When a module asks to be called for a specific event ( a hook ), this is where that request is remembered
+        std::array<std::vector<EventHook>, NUMBER_OF_DEFINED_EVENTS> hooks;
+        std::vector<GcodeRoute> gcode_routes;
+};
+
+#endif
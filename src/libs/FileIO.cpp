@@ -0,0 +1,183 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FileIO.h"
+#include "Kernel.h"
+
+#include <string.h>
+
+FileIO::FileIO(Scheduler *scheduler)
+{
+    this->scheduler = scheduler;
+    // normal priority so the player and the serial ports are fed first in the pass a read or write is done in
+    this->task = scheduler->add_task("file io", [](void *io) { static_cast<FileIO *>(io)->service(); }, this, Scheduler::NORMAL_PRIORITY, Scheduler::ON_DEMAND);
+}
+
+void FileIO::read(FILE *file, char *buffer, size_t length, done_t done, void *object)
+{
+    queue_request(file, buffer, length, done, object, READ);
+}
+
+void FileIO::write(FILE *file, const char *buffer, size_t length, done_t done, void *object)
+{
+    // only ever read from
+    queue_request(file, const_cast<char *>(buffer), length, done, object, WRITE);
+}
+
+void FileIO::queue_request(FILE *file, char *buffer, size_t length, done_t done, void *object, op_t op)
+{
+    this->queue.push_back({file, buffer, length, 0, done, object, op});
+    this->scheduler->wake(this->task);
+}
+
+// moves up to max bytes of the request, returns true while there is more of it to do
+bool FileIO::step(request_t &request, size_t max)
+{
+    size_t n = request.length - request.moved;
+    if(n > max) n = max;
+    char *at = request.buffer + request.moved;
+    size_t moved = request.op == READ ? fread(at, 1, n, request.file) : fwrite(at, 1, n, request.file);
+    request.moved += moved;
+    return moved == n && request.moved < request.length;
+}
+
+// one piece of the oldest request each pass
+void FileIO::service()
+{
+    if(this->queue.empty()) return;
+
+    if(step(this->queue.front(), max_per_pass)) {
+        this->scheduler->wake(this->task);
+        return;
+    }
+
+    // off the queue first, done may queue the next request
+    request_t request = this->queue.front();
+    this->queue.pop_front();
+    if(!this->queue.empty()) this->scheduler->wake(this->task);
+    if(request.done != NULL) request.done(request.object, request.moved);
+}
+
+void FileIO::finish(void *object)
+{
+    for(;;) {
+        std::deque<request_t>::iterator i = this->queue.begin();
+        while(i != this->queue.end() && i->object != object) ++i;
+        if(i == this->queue.end()) return;
+
+        request_t request = *i;
+        this->queue.erase(i);
+        while(step(request, request.length)) ;
+        if(request.done != NULL) request.done(request.object, request.moved);
+    }
+}
+
+void FileIO::cancel(void *object)
+{
+    for(std::deque<request_t>::iterator i = this->queue.begin(); i != this->queue.end(); ) {
+        if(i->object == object) i = this->queue.erase(i);
+        else ++i;
+    }
+}
+
+bool FileIO::pending(void *object) const
+{
+    for(std::deque<request_t>::const_iterator i = this->queue.begin(); i != this->queue.end(); ++i) {
+        if(i->object == object) return true;
+    }
+    return false;
+}
+
+FileIOWriter::FileIOWriter()
+{
+    this->file = NULL;
+    this->buffers[0] = this->buffers[1] = NULL;
+    this->fill = 0;
+    this->queued_length = 0;
+    this->current = 0;
+    this->queued = false;
+    this->failed = false;
+}
+
+FileIOWriter::~FileIOWriter()
+{
+    close();
+}
+
+bool FileIOWriter::open(const char *path)
+{
+    close();
+
+    this->buffers[0] = new char[2 * buffer_size];
+    if(this->buffers[0] == NULL) return false;
+    this->buffers[1] = this->buffers[0] + buffer_size;
+
+    this->file = fopen(path, "w");
+    if(this->file == NULL) {
+        delete [] this->buffers[0];
+        this->buffers[0] = this->buffers[1] = NULL;
+        return false;
+    }
+    // every write is a whole sector at a sector aligned offset, a stdio buffer would only copy it again
+    setvbuf(this->file, NULL, _IONBF, 0);
+
+    this->fill = 0;
+    this->current = 0;
+    this->queued = false;
+    this->failed = false;
+    return true;
+}
+
+bool FileIOWriter::write(const char *data, size_t length)
+{
+    if(this->file == NULL || this->failed) return false;
+
+    while(length > 0) {
+        size_t n = buffer_size - this->fill;
+        if(n > length) n = length;
+        memcpy(this->buffers[this->current] + this->fill, data, n);
+        this->fill += n;
+        data += n;
+        length -= n;
+        if(this->fill == buffer_size) queue_buffer();
+    }
+    return !this->failed;
+}
+
+// the other buffer is filled while this one is written, if its own write has not been done yet it is done now
+void FileIOWriter::queue_buffer()
+{
+    if(this->queued) THEKERNEL->file_io->finish(this);
+
+    this->queued = true;
+    this->queued_length = this->fill;
+    THEKERNEL->file_io->write(this->file, this->buffers[this->current], this->fill, written, this);
+    this->current ^= 1;
+    this->fill = 0;
+}
+
+void FileIOWriter::written(void *object, size_t bytes)
+{
+    FileIOWriter *writer = static_cast<FileIOWriter *>(object);
+    if(bytes != writer->queued_length) writer->failed = true;
+    writer->queued = false;
+}
+
+bool FileIOWriter::close()
+{
+    if(this->file == NULL) return false;
+
+    if(this->fill > 0 && !this->failed) queue_buffer();
+    THEKERNEL->file_io->finish(this);
+
+    bool ok = !this->failed;
+    if(fclose(this->file) != 0) ok = false;
+    this->file = NULL;
+    delete [] this->buffers[0];
+    this->buffers[0] = this->buffers[1] = NULL;
+    return ok;
+}
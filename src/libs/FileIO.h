@@ -0,0 +1,91 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include "Scheduler.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+
+// Reads and writes on open files, queued and done by a main loop task at most max_per_pass bytes a pass, so a slow
+// card holds up one pass by one piece instead of holding up whoever asked for the whole transfer.
+// The card itself is still driven synchronously, what this buys is that the SD time is spread out and kept out of
+// the passes that feed the planner.
+// Requests are done in the order they were made. done is called from the main loop once a request has finished with
+// the number of bytes moved, fewer than asked for at the end of a file or on an error. The buffer must stay valid
+// until then, or until the requests of its object are cancelled.
+class FileIO {
+    public:
+        typedef void (*done_t)(void *object, size_t bytes);
+        static const size_t max_per_pass = 1024;
+
+        FileIO(Scheduler *scheduler);
+
+        void read(FILE *file, char *buffer, size_t length, done_t done, void *object);
+        void write(FILE *file, const char *buffer, size_t length, done_t done, void *object);
+
+        // does the requests of object now, for when it cannot wait for the main loop, they still call done
+        void finish(void *object);
+        // drops the requests of object without calling done, one that was under way stays part done
+        void cancel(void *object);
+        bool pending(void *object) const;
+
+    private:
+        enum op_t { READ, WRITE };
+        struct request_t {
+            FILE *file;
+            char *buffer;
+            size_t length;
+            size_t moved;
+            done_t done;
+            void *object;
+            op_t op;
+        };
+
+        void queue_request(FILE *file, char *buffer, size_t length, done_t done, void *object, op_t op);
+        bool step(request_t &request, size_t max);
+        void service();
+
+        std::deque<request_t> queue;
+        Scheduler *scheduler;
+        Scheduler::Task *task;
+};
+
+// Writes a file through FileIO a buffer at a time, whole sectors while the next buffer fills, for uploads that
+// arrive a line or a character at a time
+class FileIOWriter {
+    public:
+        static const size_t buffer_size = 512;
+
+        FileIOWriter();
+        ~FileIOWriter();
+
+        bool open(const char *path);
+        // false once a write has failed, everything after that is dropped
+        bool write(const char *data, size_t length);
+        // writes what is left and closes the file, false if any of it could not be written
+        bool close();
+        bool is_open() const { return file != NULL; }
+
+    private:
+        void queue_buffer();
+        static void written(void *object, size_t bytes);
+
+        FILE *file;
+        char *buffers[2];
+        size_t fill;
+        size_t queued_length;
+        uint8_t current;
+        bool queued;
+        bool failed;
+};
+
+#endif
@@ -10,6 +10,8 @@
 #include "libs/Config.h"
 #include "libs/nuts_bolts.h"
 #include "libs/SlowTicker.h"
+#include "libs/Scheduler.h"
+#include "libs/FileIO.h"
 #include "libs/Adc.h"
 #include "libs/StreamOutputPool.h"
 #include <mri.h>
@@ -26,6 +28,8 @@
 #include "modules/robot/Conveyor.h"
 #include "modules/robot/Pauser.h"
 
+#include "us_ticker_api.h" // mbed.h lib
+
 #include <malloc.h>
 #include <array>
 
@@ -35,6 +39,7 @@
 #define base_stepping_frequency_checksum            CHECKSUM("base_stepping_frequency")
 #define microseconds_per_step_pulse_checksum        CHECKSUM("microseconds_per_step_pulse")
 #define acceleration_ticks_per_second_checksum      CHECKSUM("acceleration_ticks_per_second")
+#define main_loop_budget_checksum                   CHECKSUM("main_loop_budget_us")
 
 Kernel* Kernel::instance;
 
@@ -58,6 +63,11 @@ Kernel::Kernel(){
 
     this->streams = new StreamOutputPool();
 
+    this->idle_depth = 0;
+    this->scheduler = new Scheduler();
+    this->scheduler->set_budget_us(this->config->value(main_loop_budget_checksum)->by_default(2000)->as_number());
+    this->file_io = new FileIO(this->scheduler);
+
     this->current_path   = "/";
 
     // Configure UART depending on MRI config
@@ -106,6 +116,7 @@ Kernel::Kernel(){
     // Set other priorities lower than the timers
     NVIC_SetPriority(ADC_IRQn, 5);
     NVIC_SetPriority(USB_IRQn, 5);
+    NVIC_SetPriority(DMA_IRQn, 5);
 
     // If MRI is enabled
     if( MRI_ENABLE ){
@@ -148,19 +159,46 @@ void Kernel::add_module(Module* module){
 
 // Adds a hook for a given module and event
 void Kernel::register_for_event(_EVENT_ENUM id_event, Module *mod){
-    this->hooks[id_event].push_back(mod);
+    this->hooks.add(id_event, mod);
+}
+
+// Adds a hook for ON_GCODE_RECEIVED that is only called for the given G or M code,
+// use instead of register_for_event(ON_GCODE_RECEIVED) for modules that handle a few codes, it can be called once per code
+void Kernel::register_for_gcode(char letter, uint16_t code, Module *mod){
+    this->hooks.add_gcode(letter, code, mod);
+}
+
+// Return a grbl style status report for the ? realtime query, the position is read live from the actuators
+std::string Kernel::get_query_string()
+{
+    float pos[3];
+    this->robot->get_current_machine_position(pos);
+
+    char buf[96];
+    int n = snprintf(buf, sizeof(buf), "<%s,MPos:%1.4f,%1.4f,%1.4f>\r\n",
+                     this->conveyor->is_queue_empty() ? "Idle" : "Run",
+                     this->robot->from_millimeters(pos[X_AXIS]),
+                     this->robot->from_millimeters(pos[Y_AXIS]),
+                     this->robot->from_millimeters(pos[Z_AXIS]));
+    return std::string(buf, n);
 }
 
 // Call a specific event without arguments
 void Kernel::call_event(_EVENT_ENUM id_event){
-    for (auto m : hooks[id_event]) {
-        (m->*kernel_callback_functions[id_event])(this);
-    }
+    call_event(id_event, this);
 }
 
 // Call a specific event with an argument
 void Kernel::call_event(_EVENT_ENUM id_event, void * argument){
-    for (auto m : hooks[id_event]) {
-        (m->*kernel_callback_functions[id_event])(argument);
+    // the scheduler counts the time spent in ON_IDLE, wherever it is called from, as idle time
+    if(id_event == ON_IDLE && idle_depth == 0) {
+        idle_depth++;
+        uint32_t start = us_ticker_read();
+        this->hooks.call(ON_IDLE, argument);
+        this->scheduler->add_idle_time(us_ticker_read() - start);
+        idle_depth--;
+        return;
     }
+
+    this->hooks.call(id_event, argument);
 }
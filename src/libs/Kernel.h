@@ -11,6 +11,7 @@
 #define THEKERNEL Kernel::instance
 
 #include "Module.h"
+#include "EventHooks.h"
 #include <array>
 #include <vector>
 #include <string>
@@ -31,6 +32,8 @@ class StepTicker;
 class Adc;
 class PublicData;
 class TemperatureControlPool;
+class Scheduler;
+class FileIO;
 
 class Kernel {
     public:
@@ -40,9 +43,12 @@ class Kernel {
 
         void add_module(Module* module);
         void register_for_event(_EVENT_ENUM id_event, Module *module);
+        void register_for_gcode(char letter, uint16_t code, Module *module);
         void call_event(_EVENT_ENUM id_event);
         void call_event(_EVENT_ENUM id_event, void * argument);
 
+        std::string get_query_string();
+
         // These modules are available to all other modules
         SerialConsole*    serial;
         StreamOutputPool* streams;
@@ -57,6 +63,8 @@ class Kernel {
 
         int debug;
         SlowTicker*       slow_ticker;
+        Scheduler*        scheduler;
+        FileIO*           file_io;
         StepTicker*       step_ticker;
         Adc*              adc;
         bool              use_leds;
@@ -65,8 +73,8 @@ class Kernel {
         uint32_t          acceleration_ticks_per_second;
 
     private:
-        // When a module asks to be called for a specific event ( a hook ), this is where that request is remembered
-        std::array<std::vector<Module*>, NUMBER_OF_DEFINED_EVENTS> hooks;
+        EventHooks hooks;
+        uint8_t idle_depth;
 
 };
 
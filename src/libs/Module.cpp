@@ -18,7 +18,6 @@ const ModuleCallback kernel_callback_functions[NUMBER_OF_DEFINED_EVENTS] = {
     &Module::on_console_line_received,
     &Module::on_gcode_received,
     &Module::on_gcode_execute,
-    &Module::on_speed_change,
     &Module::on_block_begin,
     &Module::on_block_end,
     &Module::on_play,
@@ -37,3 +36,8 @@ void Module::register_for_event(_EVENT_ENUM event_id){
     // You add things to Smoothie by making a new class that inherits the Module class. See http://smoothieware.org/moduleexample for a crude introduction
     THEKERNEL->register_for_event(event_id, this);
 }
+
+// Like registering for ON_GCODE_RECEIVED, but on_gcode_received is only called for this G or M code
+void Module::register_for_gcode(char letter, uint16_t code){
+    THEKERNEL->register_for_gcode(letter, code, this);
+}
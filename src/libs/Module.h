@@ -8,6 +8,8 @@
 #ifndef MODULE_H
 #define MODULE_H
 
+#include <stdint.h>
+
 // See : http://smoothieware.org/listofevents
 // When adding a new event the virtual method needs to be defined in class Module and the method pointer need to be defined in
 // Module.cpp:16 in the same order
@@ -16,7 +18,6 @@ enum _EVENT_ENUM {
     ON_CONSOLE_LINE_RECEIVED,
     ON_GCODE_RECEIVED,
     ON_GCODE_EXECUTE,
-    ON_SPEED_CHANGE,
     ON_BLOCK_BEGIN,
     ON_BLOCK_END,
     ON_PLAY,
@@ -43,6 +44,7 @@ public:
     virtual void on_module_loaded() {};
 
     void register_for_event(_EVENT_ENUM event_id);
+    void register_for_gcode(char letter, uint16_t code);
 
     // event callbacks, not every module will implement all of these
     // there should be one for each _EVENT_ENUM
@@ -50,7 +52,6 @@ public:
     virtual void on_console_line_received(void *) {};
     virtual void on_gcode_received(void *) {};
     virtual void on_gcode_execute(void *) {};
-    virtual void on_speed_change(void *) {};
     virtual void on_block_begin(void *) {};
     virtual void on_block_end(void *) {};
     virtual void on_play(void *) {};
@@ -17,6 +17,7 @@
 #include "NetworkPublicAccess.h"
 #include "checksumm.h"
 #include "ConfigValue.h"
+#include "Scheduler.h"
 
 #include "uip.h"
 #include "telnetd.h"
@@ -193,8 +194,8 @@ void Network::on_module_loaded()
 
     // Register for events
     this->register_for_event(ON_IDLE);
-    this->register_for_event(ON_MAIN_LOOP);
     this->register_for_event(ON_GET_PUBLIC_DATA);
+    THEKERNEL->scheduler->add_task("network", [](void *network) { static_cast<Network *>(network)->on_main_loop(nullptr); }, this, Scheduler::NORMAL_PRIORITY);
 
     this->init();
 }
@@ -0,0 +1,65 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Profiler.h"
+
+#if PROFILE_ENABLE
+
+#include "StreamOutput.h"
+
+#ifdef __arm__
+#include "system_LPC17xx.h" // for SystemCoreClock
+#endif
+
+// one for each _PROFILE_ZONE_ENUM in the same order
+static const char *const profile_zone_names[NUMBER_OF_PROFILE_ZONES] = {
+    "step ticker",
+    "accel tick",
+    "recalculate",
+    "gcode parse",
+    "sd read",
+};
+
+Profiler::Zone Profiler::zones[NUMBER_OF_PROFILE_ZONES];
+
+// print the zones in ticks, which are core cycles on the board or nanoseconds on the host, and in microseconds
+void Profiler::report(StreamOutput *stream)
+{
+#ifdef __arm__
+    float us_per_tick = 1000000.0F / SystemCoreClock;
+    const char *units = "cycles";
+#else
+    float us_per_tick = 0.001F;
+    const char *units = "ns";
+#endif
+
+    stream->printf("times in %s\r\n", units);
+    stream->printf("%-12s %10s %10s %10s %10s %10s\r\n", "zone", "count", "min", "avg", "max", "avg us");
+    for (int i = 0; i < NUMBER_OF_PROFILE_ZONES; i++) {
+        Zone z = zones[i]; // the interrupts keep updating it while we print
+        if(z.count == 0) {
+            stream->printf("%-12s %10s\r\n", profile_zone_names[i], "-");
+            continue;
+        }
+        float avg = (float)z.total / z.count;
+        stream->printf("%-12s %10lu %10lu %10.0f %10lu %10.2f\r\n", profile_zone_names[i], (unsigned long)z.count, (unsigned long)z.min, avg, (unsigned long)z.max, avg * us_per_tick);
+    }
+}
+
+void Profiler::reset()
+{
+    for (int i = 0; i < NUMBER_OF_PROFILE_ZONES; i++) {
+        zones[i] = {0, 0, UINT32_MAX, 0};
+    }
+}
+
+// zones start out reset
+static struct ProfilerInit {
+    ProfilerInit() { Profiler::reset(); }
+} profiler_init;
+
+#endif
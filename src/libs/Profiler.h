@@ -0,0 +1,92 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+class StreamOutput;
+
+// Named timing zones for the hot paths, reported by the profile shell command.
+// They are only built with PROFILE=1 and never in Release builds, otherwise PROFILE_SCOPE compiles to nothing.
+// On the board a zone is timed with the DWT cycle counter, in a host build with std::chrono in nanoseconds.
+// Recording is a few cycles and never allocates so zones can be used in interrupts,
+// a zone entered from two interrupt priorities at once may lose a count.
+
+// When adding a zone add its name to profile_zone_names in Profiler.cpp in the same order
+enum _PROFILE_ZONE_ENUM {
+    PROFILE_STEP_TICKER,
+    PROFILE_ACCELERATION_TICK,
+    PROFILE_PLANNER_RECALCULATE,
+    PROFILE_GCODE_PARSE,
+    PROFILE_SD_READ,
+    NUMBER_OF_PROFILE_ZONES
+};
+
+#if PROFILE_ENABLE
+
+#ifdef __arm__
+#include "CycleCounter.h"
+#else
+#include <chrono>
+#endif
+
+class Profiler {
+    public:
+        struct Zone {
+            uint64_t total;
+            uint32_t count;
+            uint32_t min;
+            uint32_t max;
+        };
+
+        static void report(StreamOutput *stream);
+        static void reset();
+
+        static inline uint32_t now()
+        {
+#ifdef __arm__
+            return cycle_count();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        static inline void record(_PROFILE_ZONE_ENUM id, uint32_t ticks)
+        {
+            Zone &z = zones[id];
+            z.total += ticks;
+            z.count++;
+            if(ticks < z.min) z.min = ticks;
+            if(ticks > z.max) z.max = ticks;
+        }
+
+    private:
+        static Zone zones[NUMBER_OF_PROFILE_ZONES];
+};
+
+// times the rest of the enclosing block
+class ProfileScope {
+    public:
+        ProfileScope(_PROFILE_ZONE_ENUM id) : id(id), start(Profiler::now()) {}
+        ~ProfileScope() { Profiler::record(id, Profiler::now() - start); }
+
+    private:
+        _PROFILE_ZONE_ENUM id;
+        uint32_t start;
+};
+
+#define PROFILE_SCOPE(id) ProfileScope profile_scope(id)
+
+#else
+
+#define PROFILE_SCOPE(id)
+
+#endif
+
+#endif
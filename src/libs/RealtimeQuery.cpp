@@ -0,0 +1,59 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RealtimeQuery.h"
+
+#include "us_ticker_api.h" // mbed.h lib
+#include "cmsis.h"
+
+RealtimeQuery::RealtimeQuery()
+{
+    this->held_at = 0;
+    this->held = false;
+    this->query = false;
+    this->at_line_start = true;
+}
+
+int RealtimeQuery::receive(char c)
+{
+    int n = 1;
+    if(this->held) {
+        this->held = false;
+        if(c == '\n' || c == '\r') {
+            // the line is just ?
+            n = 2;
+        } else {
+            this->query = true;
+        }
+    }
+
+    if(c == '?' && this->at_line_start) {
+        this->held = true;
+        this->held_at = us_ticker_read();
+        return n - 1;
+    }
+
+    this->at_line_start = (c == '\n' || c == '\r');
+    return n;
+}
+
+bool RealtimeQuery::take()
+{
+    if(this->held) {
+        // the receive interrupt may be deciding about the same ?
+        __disable_irq();
+        if(this->held && us_ticker_read() - this->held_at >= hold_us) {
+            this->held = false;
+            this->query = true;
+        }
+        __enable_irq();
+    }
+
+    if(!this->query) return false;
+    this->query = false;
+    return true;
+}
@@ -0,0 +1,40 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REALTIMEQUERY_H
+#define REALTIMEQUERY_H
+
+#include <stdint.h>
+
+// Picks grbl style ? status queries out of the bytes a serial port receives.
+// Only a ? at the start of a line can be one, anywhere else it is data, so comments, M117 text and uploads keep theirs.
+// That ? is held back until the next byte shows what it was: a line ending makes it the line "?", the shell's help,
+// anything else means it was a query and the byte starts the line. A ? sent on its own, the way hosts poll, is
+// taken as a query once nothing has followed it for hold_us.
+// So a host must only send ? between lines: one sent while it is part way through sending a line is part of that
+// line and is never answered.
+class RealtimeQuery {
+    public:
+        static const uint32_t hold_us = 10000;
+
+        RealtimeQuery();
+
+        // called from the receive interrupt with each byte, returns how many to queue: 0 none, 1 the byte,
+        // 2 a ? then the byte
+        int receive(char c);
+
+        // called on idle, true once when there is a query to answer
+        bool take();
+
+    private:
+        volatile uint32_t held_at;
+        volatile bool held;
+        volatile bool query;
+        volatile bool at_line_start;
+};
+
+#endif
@@ -1,8 +1,18 @@
 #include "SDFAT.h"
+#include "platform_memory.h"
+#include "StreamOutput.h"
+
+#include <string.h>
 
 SDFAT::SDFAT(const char *n, MSD_Disk *disk) : mbed::FATFileSystem(n)
 {
     d = disk;
+    cache_entries = NULL;
+    cache = NULL;
+    cache_size = 0;
+    cache_clock = 0;
+    seen_host_writes = 0;
+    hits = misses = writebacks = 0;
 }
 
 int SDFAT::disk_initialize()
@@ -15,28 +25,219 @@ int SDFAT::disk_status()
     return d->disk_status();
 }
 
-int SDFAT::disk_read(char *buffer, int sector)
+int SDFAT::disk_read(char *buffer, int sector, int count)
 {
-    return d->disk_read(buffer, sector);
+    if(cache_size == 0)
+        return d->disk_read(buffer, sector, count);
+    cache_check_host();
+
+    if(count == 1) {
+        // FAT, directory and partial data sectors all come through the window one at a time
+        cache_entry_t *e = cache_find(sector);
+        if(e != NULL) {
+            hits++;
+            e->last_used = ++cache_clock;
+            memcpy(buffer, cache_data(e), 512);
+            return 0;
+        }
+        misses++;
+        int r = d->disk_read(buffer, sector, 1);
+        if(r == 0) cache_store(sector, buffer, false);
+        return r;
+    }
+
+    // runs of sectors are file data read straight into the callers buffer, only patch in what has not been written yet
+    int r = d->disk_read(buffer, sector, count);
+    if(r == 0) {
+        for(uint32_t i = 0; i < cache_size; i++) {
+            cache_entry_t *e = &cache_entries[i];
+            if(e->valid && e->dirty && e->sector >= (uint32_t)sector && e->sector < (uint32_t)(sector + count))
+                memcpy(buffer + (e->sector - sector) * 512, cache_data(e), 512);
+        }
+    }
+    return r;
 }
 
-int SDFAT::disk_write(const char *buffer, int sector)
+int SDFAT::disk_write(const char *buffer, int sector, int count)
 {
-    return d->disk_write(buffer, sector);
+    if(cache_size == 0)
+        return d->disk_write(buffer, sector, count);
+    cache_check_host();
+
+    // the FAT is rewritten for every cluster a growing file takes, so hold it until sync
+    if(count == 1 && is_fat_sector(sector)) {
+        cache_store(sector, buffer, true);
+        return 0;
+    }
+
+    int r = d->disk_write(buffer, sector, count);
+    if(r != 0) return r;
+
+    // keep cached copies the same as the card
+    if(count == 1) {
+        cache_store(sector, buffer, false);
+    } else {
+        for(uint32_t i = 0; i < cache_size; i++) {
+            cache_entry_t *e = &cache_entries[i];
+            if(e->valid && e->sector >= (uint32_t)sector && e->sector < (uint32_t)(sector + count)) {
+                memcpy(cache_data(e), buffer + (e->sector - sector) * 512, 512);
+                e->dirty = false;
+            }
+        }
+    }
+    return 0;
 }
 
 int SDFAT::disk_sync()
 {
-    return d->disk_sync();
+    cache_check_host();
+    int r = cache_flush();
+    if(d->disk_sync() != 0) r = 1;
+    return r;
 }
 
 int SDFAT::disk_sectors()
 {
     return d->disk_sectors();
 }
+
 int SDFAT::remount() {
+    // the card may have been changed or written over USB
+    cache_check_host();
+    cache_flush();
+    cache_invalidate();
+
     f_mount(_fsid, NULL);
     f_mount(_fsid, &_fs);
-    
+
 	return 0;
-}
\ No newline at end of file
+}
+
+bool SDFAT::set_cache_size(uint32_t sectors)
+{
+    cache_flush();
+    if(cache != NULL) {
+        AHB0.dealloc(cache);
+        AHB0.dealloc(cache_entries);
+    }
+    cache = NULL;
+    cache_entries = NULL;
+    cache_size = 0;
+    if(sectors == 0) return true;
+
+    cache = (char *)AHB0.alloc(sectors * 512);
+    cache_entries = (cache_entry_t *)AHB0.alloc(sectors * sizeof(cache_entry_t));
+    if(cache == NULL || cache_entries == NULL) {
+        if(cache != NULL) AHB0.dealloc(cache);
+        if(cache_entries != NULL) AHB0.dealloc(cache_entries);
+        cache = NULL;
+        cache_entries = NULL;
+        return false;
+    }
+    cache_size = sectors;
+    cache_invalidate();
+    return true;
+}
+
+void SDFAT::report_cache(StreamOutput *stream)
+{
+    if(cache_size == 0) {
+        stream->printf("sd cache is disabled\n");
+        return;
+    }
+    uint32_t dirty = 0;
+    for(uint32_t i = 0; i < cache_size; i++) {
+        if(cache_entries[i].valid && cache_entries[i].dirty) dirty++;
+    }
+    uint32_t total = hits + misses;
+    stream->printf("sd cache %lu sectors, %lu dirty, hits %lu, misses %lu (%lu%% hit), FAT writebacks %lu\n",
+                   cache_size, dirty, hits, misses, total > 0 ? hits * 100 / total : 0, writebacks);
+}
+
+void SDFAT::reset_cache_stats()
+{
+    hits = misses = writebacks = 0;
+}
+
+SDFAT::cache_entry_t *SDFAT::cache_find(uint32_t sector)
+{
+    for(uint32_t i = 0; i < cache_size; i++) {
+        if(cache_entries[i].valid && cache_entries[i].sector == sector) return &cache_entries[i];
+    }
+    return NULL;
+}
+
+// least recently used entry, written back first if it is dirty, NULL if that failed
+SDFAT::cache_entry_t *SDFAT::cache_victim()
+{
+    cache_entry_t *v = &cache_entries[0];
+    for(uint32_t i = 0; i < cache_size; i++) {
+        cache_entry_t *e = &cache_entries[i];
+        if(!e->valid) return e;
+        if(e->last_used < v->last_used) v = e;
+    }
+    if(v->dirty) {
+        if(d->disk_write(cache_data(v), v->sector, 1) != 0) return NULL;
+        writebacks++;
+    }
+    v->valid = false;
+    return v;
+}
+
+void SDFAT::cache_store(uint32_t sector, const char *buffer, bool dirty)
+{
+    cache_entry_t *e = cache_find(sector);
+    if(e == NULL) {
+        e = cache_victim();
+        if(e == NULL) {
+            // could not make room, a dirty sector must still reach the card
+            if(dirty) d->disk_write(buffer, sector, 1);
+            return;
+        }
+    }
+    memcpy(cache_data(e), buffer, 512);
+    e->sector = sector;
+    e->last_used = ++cache_clock;
+    e->valid = true;
+    e->dirty = dirty;
+}
+
+int SDFAT::cache_flush()
+{
+    int r = 0;
+    for(uint32_t i = 0; i < cache_size; i++) {
+        cache_entry_t *e = &cache_entries[i];
+        if(e->valid && e->dirty) {
+            if(d->disk_write(cache_data(e), e->sector, 1) != 0) {
+                r = 1;
+                continue;
+            }
+            e->dirty = false;
+            writebacks++;
+        }
+    }
+    return r;
+}
+
+void SDFAT::cache_invalidate()
+{
+    for(uint32_t i = 0; i < cache_size; i++) {
+        cache_entries[i].valid = false;
+        cache_entries[i].dirty = false;
+    }
+}
+
+// the host's copy of the card wins, dirty sectors are dropped rather than written over what it wrote
+void SDFAT::cache_check_host()
+{
+    uint32_t w = d->host_writes;
+    if(w == seen_host_writes) return;
+    seen_host_writes = w;
+    cache_invalidate();
+}
+
+// all copies of the FAT, only known once the volume has been mounted
+bool SDFAT::is_fat_sector(uint32_t sector) const
+{
+    return _fs.fs_type != 0 && sector >= _fs.fatbase && sector < _fs.fatbase + _fs.fsize * _fs.n_fats;
+}
@@ -4,21 +4,54 @@
 #include "disk.h"
 #include "FATFileSystem.h"
 
+class StreamOutput;
+
 class SDFAT : public mbed::FATFileSystem {
 public:
     SDFAT(const char *n, MSD_Disk *disk);
 
     virtual int disk_initialize();
     virtual int disk_status();
-    virtual int disk_read(char *buffer, int sector);
-    virtual int disk_write(const char *buffer, int sector);
+    virtual int disk_read(char *buffer, int sector, int count);
+    virtual int disk_write(const char *buffer, int sector, int count);
     virtual int disk_sync();
     virtual int disk_sectors();
 
     int remount();
 
+    // LRU cache of single sector accesses in AHB0, FAT sectors are written back on sync,
+    // everything it holds is dropped once the USB host has written to the card
+    bool set_cache_size(uint32_t sectors);
+    void report_cache(StreamOutput *stream);
+    void reset_cache_stats();
+
 protected:
+    struct cache_entry_t {
+        uint32_t sector;
+        uint32_t last_used;
+        bool valid:1;
+        bool dirty:1;
+    };
+
+    char *cache_data(cache_entry_t *e) { return cache + (e - cache_entries) * 512; }
+    cache_entry_t *cache_find(uint32_t sector);
+    cache_entry_t *cache_victim();
+    void cache_store(uint32_t sector, const char *buffer, bool dirty);
+    int cache_flush();
+    void cache_invalidate();
+    void cache_check_host();
+    bool is_fat_sector(uint32_t sector) const;
+
     MSD_Disk *d;
+
+    cache_entry_t *cache_entries;
+    char *cache;
+    uint32_t cache_size;
+    uint32_t cache_clock;
+    uint32_t seen_host_writes;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t writebacks;
 };
 
 #endif /* _SDFAT_H */
@@ -0,0 +1,183 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SPIDMA.h"
+
+// GPDMA channel control and config bits
+#define DMA_CONTROL_SBSIZE_4    (1 << 12)
+#define DMA_CONTROL_DBSIZE_4    (1 << 15)
+#define DMA_CONTROL_SI          (1 << 26)
+#define DMA_CONTROL_DI          (1 << 27)
+#define DMA_CONTROL_I           (1UL << 31)
+#define DMA_CONFIG_E            (1 << 0)
+#define DMA_CONFIG_SRC(p)       ((p) << 1)
+#define DMA_CONFIG_DEST(p)      ((p) << 6)
+#define DMA_CONFIG_M2P          (1 << 11)
+#define DMA_CONFIG_P2M          (2 << 11)
+#define DMA_CONFIG_IE           (1 << 14)
+#define DMA_CONFIG_ITC          (1 << 15)
+
+// peripheral request lines, tx is the even one
+#define DMA_CONN_SSP0_TX        0
+#define DMA_CONN_SSP1_TX        2
+
+#define SSP_SR_RNE              (1 << 2)
+#define SSP_SR_BSY              (1 << 4)
+#define SSP_DMACR_RX_TX         3
+
+#define PCONP_PCGPDMA           (1 << 29)
+
+SPIDMA *SPIDMA::owners[2];
+
+// sent when there is no tx buffer, kept in RAM so the DMA reads it from the same place as the buffers
+static uint8_t fill_byte = 0xFF;
+// where received bytes go when there is no rx buffer
+static uint8_t discard_byte;
+
+SPIDMA::SPIDMA(PinName mosi, PinName miso, PinName sclk)
+{
+    this->ssp = nullptr;
+    this->active = false;
+    this->done = nullptr;
+    this->object = nullptr;
+
+    // same pin mapping as the SSP ports the mbed::SPI will use
+    if(mosi == P0_9 && miso == P0_8 && sclk == P0_7) {
+        this->port = 1;
+    } else if((mosi == P0_18 && miso == P0_17 && sclk == P0_15) || (mosi == P1_24 && miso == P1_23 && sclk == P1_20)) {
+        this->port = 0;
+    } else {
+        return;
+    }
+
+    if(owners[this->port] != nullptr) return;
+    owners[this->port] = this;
+
+    // SSP1 uses channels 0 and 1, SSP0 uses 2 and 3, lower channels have the higher priority
+    if(this->port == 1) {
+        this->ssp = LPC_SSP1;
+        this->rx_channel = LPC_GPDMACH0;
+        this->tx_channel = LPC_GPDMACH1;
+        this->rx_mask = 1 << 0;
+        this->tx_mask = 1 << 1;
+    } else {
+        this->ssp = LPC_SSP0;
+        this->rx_channel = LPC_GPDMACH2;
+        this->tx_channel = LPC_GPDMACH3;
+        this->rx_mask = 1 << 2;
+        this->tx_mask = 1 << 3;
+    }
+
+    LPC_SC->PCONP |= PCONP_PCGPDMA;
+    LPC_GPDMA->DMACConfig = 1; // enabled, little endian
+    NVIC_EnableIRQ(DMA_IRQn);
+}
+
+SPIDMA::~SPIDMA()
+{
+    if(this->ssp == nullptr) return;
+    wait();
+    owners[this->port] = nullptr;
+}
+
+bool SPIDMA::setup(const uint8_t *tx, uint8_t *rx, uint16_t length, bool interrupt)
+{
+    if(this->ssp == nullptr || length == 0 || length > max_length) return false;
+    wait();
+
+    // start from an idle port with an empty receive FIFO
+    while(this->ssp->SR & SSP_SR_BSY) ;
+    while(this->ssp->SR & SSP_SR_RNE) (void)this->ssp->DR;
+
+    uint32_t conn = this->port == 0 ? DMA_CONN_SSP0_TX : DMA_CONN_SSP1_TX;
+    LPC_GPDMA->DMACIntTCClear = this->rx_mask | this->tx_mask;
+    LPC_GPDMA->DMACIntErrClr = this->rx_mask | this->tx_mask;
+
+    this->rx_channel->DMACCSrcAddr = (uint32_t)&this->ssp->DR;
+    this->rx_channel->DMACCDestAddr = (uint32_t)(rx != nullptr ? rx : &discard_byte);
+    this->rx_channel->DMACCLLI = 0;
+    this->rx_channel->DMACCControl = length | DMA_CONTROL_SBSIZE_4 | DMA_CONTROL_DBSIZE_4 | DMA_CONTROL_I | (rx != nullptr ? DMA_CONTROL_DI : 0);
+
+    this->tx_channel->DMACCSrcAddr = (uint32_t)(tx != nullptr ? tx : &fill_byte);
+    this->tx_channel->DMACCDestAddr = (uint32_t)&this->ssp->DR;
+    this->tx_channel->DMACCLLI = 0;
+    this->tx_channel->DMACCControl = length | DMA_CONTROL_SBSIZE_4 | DMA_CONTROL_DBSIZE_4 | (tx != nullptr ? DMA_CONTROL_SI : 0);
+
+    this->active = true;
+
+    // only the receive channel interrupts, and only when someone is waiting for the callback
+    this->rx_channel->DMACCConfig = DMA_CONFIG_E | DMA_CONFIG_SRC(conn + 1) | DMA_CONFIG_P2M | DMA_CONFIG_IE | (interrupt ? DMA_CONFIG_ITC : 0);
+    this->tx_channel->DMACCConfig = DMA_CONFIG_E | DMA_CONFIG_DEST(conn) | DMA_CONFIG_M2P;
+    this->ssp->DMACR = SSP_DMACR_RX_TX;
+    return true;
+}
+
+bool SPIDMA::transfer(const uint8_t *tx, uint8_t *rx, uint16_t length)
+{
+    wait();
+    this->done = nullptr;
+    if(!setup(tx, rx, length, false)) return false;
+    wait();
+    return true;
+}
+
+bool SPIDMA::start(const uint8_t *tx, uint8_t *rx, uint16_t length, done_t done, void *object)
+{
+    // set before the channels run, a short transfer can be done before setup returns
+    wait();
+    this->done = done;
+    this->object = object;
+    if(!setup(tx, rx, length, true)) {
+        this->done = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void SPIDMA::wait()
+{
+    while(this->active) {
+        // polled as well, the interrupt may be masked by whoever is waiting
+        if(LPC_GPDMA->DMACRawIntTCStat & this->rx_mask || LPC_GPDMA->DMACRawIntErrStat & (this->rx_mask | this->tx_mask)) {
+            __disable_irq();
+            if(this->active) finish();
+            __enable_irq();
+        }
+    }
+}
+
+void SPIDMA::finish()
+{
+    LPC_GPDMA->DMACIntTCClear = this->rx_mask | this->tx_mask;
+    LPC_GPDMA->DMACIntErrClr = this->rx_mask | this->tx_mask;
+    this->rx_channel->DMACCConfig = 0;
+    this->tx_channel->DMACCConfig = 0;
+    this->ssp->DMACR = 0;
+    this->active = false;
+
+    if(this->done != nullptr) {
+        done_t d = this->done;
+        this->done = nullptr;
+        d(this->object);
+    }
+}
+
+void SPIDMA::irq()
+{
+    uint32_t tc = LPC_GPDMA->DMACIntTCStat;
+    uint32_t err = LPC_GPDMA->DMACIntErrStat;
+    for(SPIDMA *d : owners) {
+        if(d != nullptr && d->active && ((tc & d->rx_mask) || (err & (d->rx_mask | d->tx_mask)))) {
+            d->finish();
+        }
+    }
+}
+
+extern "C" void DMA_IRQHandler(void)
+{
+    SPIDMA::irq();
+}
@@ -0,0 +1,61 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPIDMA_H
+#define SPIDMA_H
+
+#include <stdint.h>
+#include "PinNames.h"
+#include "LPC17xx.h"
+
+// GPDMA transfers on one of the SSP ports, used next to the mbed::SPI that owns the pins, clock and format.
+// Each SSP gets a fixed pair of channels, the receive channel always runs too so completion means the last
+// byte has been clocked out, and it has the higher priority so the receive FIFO cannot overflow.
+// Only the first user of an SSP gets DMA, a second one on the same port sees available() false and must
+// clock bytes through its mbed::SPI as before.
+class SPIDMA {
+    public:
+        typedef void (*done_t)(void *object);
+
+        SPIDMA(PinName mosi, PinName miso, PinName sclk);
+        ~SPIDMA();
+
+        bool available() const { return ssp != nullptr; }
+        bool busy() const { return active; }
+
+        // blocking transfer, polls for completion so it is safe from any interrupt
+        // tx NULL sends 0xFF, rx NULL discards what is received, length is at most max_length
+        bool transfer(const uint8_t *tx, uint8_t *rx, uint16_t length);
+
+        // returns as soon as the transfer is running, done is called from the DMA interrupt when it has finished
+        bool start(const uint8_t *tx, uint8_t *rx, uint16_t length, done_t done, void *object);
+
+        // wait for a started transfer to finish
+        void wait();
+
+        static const uint16_t max_length = 4095;
+
+        static void irq();
+
+    private:
+        bool setup(const uint8_t *tx, uint8_t *rx, uint16_t length, bool interrupt);
+        void finish();
+
+        static SPIDMA *owners[2];
+
+        LPC_SSP_TypeDef *ssp;
+        LPC_GPDMACH_TypeDef *rx_channel;
+        LPC_GPDMACH_TypeDef *tx_channel;
+        done_t done;
+        void *object;
+        uint8_t port;
+        uint8_t rx_mask;
+        uint8_t tx_mask;
+        volatile bool active;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SamplingProfiler.h"
+#include "StreamOutput.h"
+#include "platform_memory.h"
+#include "sLPC17xx.h"
+#include "system_LPC17xx.h" // for SystemCoreClock
+
+uint32_t *SamplingProfiler::samples = nullptr;
+uint32_t SamplingProfiler::size = 0;
+volatile uint32_t SamplingProfiler::head = 0;
+volatile uint32_t SamplingProfiler::count = 0;
+uint32_t SamplingProfiler::frequency = 0;
+bool SamplingProfiler::running = false;
+
+// the exception frame is r0, r1, r2, r3, r12, lr, pc, xpsr
+extern "C" void sampling_profiler_sample(uint32_t *frame)
+{
+    SamplingProfiler::sample(frame[6]);
+}
+
+// find the stack the exception frame was pushed on and pass it to sampling_profiler_sample,
+// naked as the compiler generated prologue would move the stack pointer
+extern "C" __attribute__((naked)) void SysTick_Handler(void)
+{
+    __asm volatile(
+        "mrs   r0, msp                      \n"
+        "tst   lr, #4                       \n"
+        "beq   1f                           \n"
+        "mrs   r0, psp                      \n"
+        "1:                                 \n"
+        "b     sampling_profiler_sample     \n"
+    );
+}
+
+// start sampling frequency times a second, keeping the last size samples, returns false if there is not enough AHB0 memory
+bool SamplingProfiler::start(uint32_t frequency, uint32_t size)
+{
+    stop();
+
+    if(size != SamplingProfiler::size) {
+        if(samples != nullptr) AHB0.dealloc(samples);
+        SamplingProfiler::size = 0;
+        samples = (uint32_t *)AHB0.alloc(size * sizeof(uint32_t));
+        if(samples == nullptr) return false;
+        SamplingProfiler::size = size;
+    }
+
+    SamplingProfiler::frequency = frequency;
+    head = 0;
+    count = 0;
+
+    SysTick->LOAD = SystemCoreClock / frequency - 1;
+    SysTick->VAL = 0;
+    NVIC_SetPriority(SysTick_IRQn, 1);
+    SysTick->CTRL = 7; // core clock, interrupt and counter enabled
+    running = true;
+    return true;
+}
+
+void SamplingProfiler::stop()
+{
+    SysTick->CTRL = 0;
+    running = false;
+}
+
+// print the samples oldest first, sampling is paused while printing
+void SamplingProfiler::dump(StreamOutput *stream)
+{
+    bool was_running = running;
+    SysTick->CTRL = 0;
+
+    uint32_t n = count < size ? count : size;
+    uint32_t i = count < size ? 0 : head;
+    stream->printf("profile samples %lu of %lu at %lu Hz\r\n", n, count, frequency);
+    for (uint32_t c = 0; c < n; c++) {
+        stream->printf(c % 8 == 7 || c == n - 1 ? "%08lx\r\n" : "%08lx ", samples[i]);
+        if(++i >= size) i = 0;
+    }
+    stream->printf("profile end\r\n");
+
+    if(was_running) SysTick->CTRL = 7;
+}
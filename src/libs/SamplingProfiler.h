@@ -0,0 +1,43 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SAMPLINGPROFILER_H
+#define SAMPLINGPROFILER_H
+
+#include <stdint.h>
+
+class StreamOutput;
+
+// Statistical profiler, SysTick interrupts the firmware at a fixed rate and records the PC it interrupted
+// into a ring buffer in AHB0 RAM, so it sees everything including mbed, ChaNFS and uIP code.
+// SysTick runs at priority 1 so it also samples the step ticker and the other interrupts, only TIMER1 is not seen.
+// profile dump prints the samples as hex, smoothie-profile.py symbolizes them against the elf on the host.
+class SamplingProfiler {
+    public:
+        static bool start(uint32_t frequency, uint32_t size);
+        static void stop();
+        static bool is_running() { return running; }
+        static void dump(StreamOutput *stream);
+
+        // called from the SysTick interrupt
+        static inline void sample(uint32_t pc)
+        {
+            samples[head] = pc;
+            if(++head >= size) head = 0;
+            count++;
+        }
+
+    private:
+        static uint32_t *samples;
+        static uint32_t size;
+        static volatile uint32_t head;
+        static volatile uint32_t count;
+        static uint32_t frequency;
+        static bool running;
+};
+
+#endif
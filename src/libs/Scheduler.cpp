@@ -0,0 +1,125 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Scheduler.h"
+#include "libs/Kernel.h"
+#include "libs/StreamOutput.h"
+#include "us_ticker_api.h" // mbed.h lib
+
+#include <algorithm>
+
+Scheduler::Scheduler()
+{
+    this->budget_us = 2000;
+    this->reset_stats();
+}
+
+// Add a task, the name is not copied so it should be a string literal
+// period_ms is 0 to run every pass, or ON_DEMAND to only run after wake() is called
+Scheduler::Task *Scheduler::add_task(const char *name, task_function_t function, void *object, priority_t priority, uint32_t period_ms)
+{
+    Task *task = new Task;
+    task->name = name;
+    task->function = function;
+    task->object = object;
+    task->period_us = (period_ms == ON_DEMAND) ? ON_DEMAND : period_ms * 1000;
+    task->last_run = us_ticker_read();
+    task->stats = {0, 0, 0};
+    task->priority = priority;
+    task->woken = false;
+    task->deferrals = 0;
+
+    // after the tasks of the same priority, so they run in the order they were added
+    auto it = std::upper_bound(this->tasks.begin(), this->tasks.end(), task,
+                               [](const Task * a, const Task * b) { return a->priority < b->priority; });
+    this->tasks.insert(it, task);
+    return task;
+}
+
+// Call the function and add the time it took to the stats, less any time spent in ON_IDLE while it ran
+void Scheduler::timed_call(Stats &stats, task_function_t function, void *object)
+{
+    uint64_t idle_before = this->idle.total_us;
+    uint32_t start = us_ticker_read();
+
+    function(object);
+
+    uint32_t us = (us_ticker_read() - start) - (uint32_t)(this->idle.total_us - idle_before);
+    stats.total_us += us;
+    stats.calls++;
+    if(us > stats.max_us) stats.max_us = us;
+}
+
+// One pass of the main loop
+void Scheduler::run_pass()
+{
+    uint32_t start = us_ticker_read();
+
+    timed_call(this->main_loop, [](void *) { THEKERNEL->call_event(ON_MAIN_LOOP); }, nullptr);
+
+    for (Task *t : this->tasks) {
+        uint32_t now = us_ticker_read();
+        if(t->period_us == ON_DEMAND) {
+            if(!t->woken) continue;
+        } else if(t->period_us > 0 && now - t->last_run < t->period_us) {
+            continue;
+        }
+
+        if(t->priority == LOW_PRIORITY && now - start > this->budget_us && t->deferrals < max_deferrals) {
+            t->deferrals++;
+            continue;
+        }
+
+        // cleared before the call so a wake() while it runs is not lost
+        t->woken = false;
+        t->deferrals = 0;
+        t->last_run = now;
+        timed_call(t->stats, t->function, t->object);
+    }
+
+    // the Kernel adds the time this takes to the idle stats
+    THEKERNEL->call_event(ON_IDLE);
+
+    uint32_t now = us_ticker_read();
+    this->elapsed_us += now - this->last_pass;
+    this->last_pass = now;
+}
+
+static void print_stats(StreamOutput *stream, const char *name, const char *priority, const Scheduler::Stats &stats, float elapsed)
+{
+    stream->printf("%-14s %-6s %10lu %10.1f %10lu %6.1f%%\r\n", name, priority, stats.calls,
+                   stats.calls > 0 ? (float)stats.total_us / stats.calls : 0.0F, stats.max_us, stats.total_us * 100.0F / elapsed);
+}
+
+// print where the main loop time went since the last reset
+void Scheduler::report(StreamOutput *stream) const
+{
+    static const char *priorities[] = { "high", "normal", "low" };
+    float elapsed = this->elapsed_us > 0 ? this->elapsed_us : 1;
+    uint64_t accounted = this->main_loop.total_us + this->idle.total_us;
+
+    stream->printf("%-14s %-6s %10s %10s %10s %7s\r\n", "task", "prio", "calls", "avg us", "max us", "share");
+    print_stats(stream, "ON_MAIN_LOOP", "-", this->main_loop, elapsed);
+    for (const Task *t : this->tasks) {
+        print_stats(stream, t->name, priorities[t->priority], t->stats, elapsed);
+        accounted += t->stats.total_us;
+    }
+    print_stats(stream, "ON_IDLE", "-", this->idle, elapsed);
+
+    float other = this->elapsed_us > accounted ? this->elapsed_us - accounted : 0;
+    stream->printf("%-14s %-6s %10s %10s %10s %6.1f%%\r\n", "loop overhead", "-", "", "", "", other * 100.0F / elapsed);
+    stream->printf("%1.1f seconds since reset, low priority budget %lu us per pass\r\n", this->elapsed_us / 1000000.0F, this->budget_us);
+}
+
+void Scheduler::reset_stats()
+{
+    for (Task *t : this->tasks) t->stats = {0, 0, 0};
+    this->main_loop = {0, 0, 0};
+    this->idle = {0, 0, 0};
+    this->elapsed_us = 0;
+    this->last_pass = us_ticker_read();
+}
@@ -0,0 +1,70 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <vector>
+
+class StreamOutput;
+
+// Cooperative scheduler for the main loop, each pass calls ON_MAIN_LOOP, then the due tasks in priority order, then ON_IDLE.
+// A task runs every pass, every period_ms, or for on demand tasks once after each wake().
+// Once a pass has used up its budget the low priority tasks wait for the next pass, but never more than max_deferrals passes in a row.
+// Tasks run to completion and are never called from inside ON_IDLE, so like ON_MAIN_LOOP they may queue gcodes.
+//
+// The time spent in each task and event is kept for the tasks shell command, time spent in ON_IDLE while a task waits
+// ( for instance for room in the queue ) is counted as idle time, not as the task's. Interrupts are counted as part of whatever they interrupted.
+// ON_MAIN_LOOP is timed as a whole, so main loop work should be a task of its own to show up on its own line.
+class Scheduler {
+    public:
+        typedef void (*task_function_t)(void *object);
+        enum priority_t { HIGH_PRIORITY, NORMAL_PRIORITY, LOW_PRIORITY };
+        static const uint32_t ON_DEMAND = UINT32_MAX;
+        struct Task;
+
+        Scheduler();
+        Task *add_task(const char *name, task_function_t function, void *object, priority_t priority, uint32_t period_ms = 0);
+        void wake(Task *task) { task->woken = true; } // can be called from an interrupt
+        void run_pass();
+        void add_idle_time(uint32_t us) { idle.total_us += us; idle.calls++; if(us > idle.max_us) idle.max_us = us; }
+        void set_budget_us(uint32_t us) { budget_us = us; }
+        void report(StreamOutput *stream) const;
+        void reset_stats();
+
+        struct Stats {
+            uint64_t total_us;
+            uint32_t calls;
+            uint32_t max_us;
+        };
+
+        struct Task {
+            const char *name;
+            task_function_t function;
+            void *object;
+            uint32_t period_us; // 0 to run every pass, or ON_DEMAND
+            uint32_t last_run;
+            Stats stats;
+            priority_t priority;
+            volatile bool woken;
+            uint8_t deferrals;
+        };
+
+    private:
+        void timed_call(Stats &stats, task_function_t function, void *object);
+
+        static const uint8_t max_deferrals = 10;
+        std::vector<Task *> tasks; // sorted by priority
+        Stats main_loop;
+        Stats idle;
+        uint64_t elapsed_us;
+        uint32_t last_pass;
+        uint32_t budget_us;
+};
+
+#endif
@@ -13,6 +13,8 @@
 #include "libs/Kernel.h"
 #include "StepperMotor.h"
 #include "StreamOutputPool.h"
+#include "CycleCounter.h"
+#include "Profiler.h"
 #include "system_LPC17xx.h" // mbed.h lib
 #include <math.h>
 #include <mri.h>
@@ -53,6 +55,9 @@ StepTicker::StepTicker(){
     LPC_RIT->RICTRL &= ~(8L); // disable
     //NVIC_SetVector(RIT_IRQn, (uint32_t)&_ritisr);
 
+    // used to time the acceleration tick
+    enable_cycle_counter();
+
     // Default start values
     this->a_move_finished = false;
     this->do_move_finished = 0;
@@ -63,6 +68,7 @@ StepTicker::StepTicker(){
     this->num_motors= 0;
     this->active_motor.reset();
     this->tick_cnt= 0;
+    this->max_acceleration_tick_cycles= 0;
 }
 
 StepTicker::~StepTicker() {
@@ -180,13 +186,22 @@ void StepTicker::PendSV_IRQHandler (void) {
 
 // run in RIT lower priority than PendSV
 void  StepTicker::acceleration_tick() {
+    PROFILE_SCOPE(PROFILE_ACCELERATION_TICK);
+    uint32_t start= cycle_count();
+
     // call registered acceleration handlers
     for (size_t i = 0; i < acceleration_tick_handlers.size(); ++i) {
         acceleration_tick_handlers[i]();
     }
+
+    // keep the worst case
+    uint32_t cycles= cycle_count() - start;
+    if(cycles > max_acceleration_tick_cycles) max_acceleration_tick_cycles= cycles;
 }
 
 void StepTicker::TIMER0_IRQHandler (void){
+    PROFILE_SCOPE(PROFILE_STEP_TICKER);
+
     // Reset interrupt register
     LPC_TIM0->IR |= 1 << 0;
     tick_cnt++; // count number of ticks
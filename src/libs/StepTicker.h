@@ -44,6 +44,10 @@ class StepTicker{
         void acceleration_tick();
         void synchronize_acceleration(bool fire_now);
 
+        // longest acceleration tick seen, in core clock cycles
+        uint32_t get_max_acceleration_tick_cycles() const { return max_acceleration_tick_cycles; }
+        void reset_max_acceleration_tick_cycles() { max_acceleration_tick_cycles= 0; }
+
         void start();
 
         friend class StepperMotor;
@@ -52,6 +56,7 @@ class StepTicker{
         float frequency;
         uint32_t period;
         volatile uint32_t tick_cnt;
+        volatile uint32_t max_acceleration_tick_cycles;
         std::vector<std::function<void(void)>> acceleration_tick_handlers;
         std::vector<StepperMotor*> motor;
         std::bitset<32> active_motor; // limit to 32 motors
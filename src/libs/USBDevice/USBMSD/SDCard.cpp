@@ -64,10 +64,11 @@
  * just always use the Standard Capacity cards with a block size of 512 bytes.
  * This is set with CMD16.
  *
- * You can read and write single blocks (CMD17, CMD25) or multiple blocks
- * (CMD18, CMD25). For simplicity, I'll just use single block accesses. When
- * the card gets a read command, it responds with a response token, and then
- * a data token or an error.
+ * You can read and write single blocks (CMD17, CMD24) or multiple blocks
+ * (CMD18, CMD25). Single blocks are used when only one is asked for, runs of
+ * consecutive blocks use the multiple block commands so the command round
+ * trip is only paid once per run. When the card gets a read command, it
+ * responds with a response token, and then a data token or an error.
  *
  * SPI Command Format
  * ------------------
@@ -115,19 +116,32 @@
  * +------+---------+---------+- -  - -+---------+-----------+----------+
  * | 0xFE | data[0] | data[1] |        | data[n] | crc[15:8] | crc[7:0] |
  * +------+---------+---------+- -  - -+---------+-----------+----------+
+ *
+ * Multiple Block Read and Write
+ * -----------------------------
+ *
+ * The card stays selected for the whole transfer. A multiple block read
+ * sends the same data blocks back to back until it gets STOP_TRANSMISSION
+ * (CMD12), which answers with a stuff byte, R1 and then busy. A multiple
+ * block write sends each block with a 0xFC start token, each one gets a data
+ * response token and busy, and the write is ended with a 0xFD stop token
+ * followed by busy.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "SDCard.h"
+#include "Profiler.h"
 
 static const uint8_t OXFF = 0xFF;
 
 #define SD_COMMAND_TIMEOUT 5000
+// bytes clocked while waiting for a data token, covers the 100ms read access time at 2.5MHz
+#define SD_DATA_TIMEOUT 50000
 
 SDCard::SDCard(PinName mosi, PinName miso, PinName sclk, PinName cs) :
-  _spi(mosi, miso, sclk), _cs(cs) {
+  _spi(mosi, miso, sclk), _dma(mosi, miso, sclk), _cs(cs) {
     _cs.output();
     _cs = 1;
     busyflag = false;
@@ -284,48 +298,99 @@ int SDCard::disk_initialize()
     return 0;
 }
 
-int SDCard::disk_write(const char *buffer, uint32_t block_number)
+int SDCard::disk_write(const char *buffer, uint32_t block_number, uint32_t count)
 {
     if (busyflag)
         return 0;
 
-    busyflag = true;
-
     if (cardtype == SDCARD_FAIL)
         return -1;
-    // set write address for single block (CMD24)
-    if(_cmd(SDCMD_WRITE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
-        return 1;
-    }
 
-    // send the data block
-    _write(buffer, 512);
+    busyflag = true;
+
+    int r = 0;
+    if (count == 1) {
+        // set write address for single block (CMD24)
+        if(_cmd(SDCMD_WRITE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+            busyflag = false;
+            return 1;
+        }
+
+        // send the data block
+        r = _write(buffer, 512);
+
+    } else {
+        // set write address for multiple blocks (CMD25), card stays selected until the stop token
+        if(_cmdx(SDCMD_WRITE_MULTIPLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+            _cs = 1;
+            _spi.write(0xFF);
+            busyflag = false;
+            return 1;
+        }
+        _spi.write(0xFF);
+
+        for(uint32_t i = 0; i < count && r == 0; i++) {
+            r = _write_data(0xFC, buffer, 512);
+            buffer += 512;
+        }
+
+        // the stop token is sent even after an error so the card leaves receive mode
+        _spi.write(0xFD);
+        _spi.write(0xFF);
+        if(_wait_not_busy() != 0) r = 1;
+
+        _cs = 1;
+        _spi.write(0xFF);
+    }
 
     busyflag = false;
 
-    return 0;
+    return r;
 }
 
-int SDCard::disk_read(char *buffer, uint32_t block_number)
+int SDCard::disk_read(char *buffer, uint32_t block_number, uint32_t count)
 {
+    PROFILE_SCOPE(PROFILE_SD_READ);
+
     if (busyflag)
         return 0;
 
-    busyflag = true;
-
     if (cardtype == SDCARD_FAIL)
         return -1;
-    // set read address for single block (CMD17)
-    if(_cmd(SDCMD_READ_SINGLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
-        return 1;
-    }
 
-    // receive the data
-    _read(buffer, 512);
+    busyflag = true;
+
+    int r = 0;
+    if (count == 1) {
+        // set read address for single block (CMD17)
+        if(_cmd(SDCMD_READ_SINGLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+            busyflag = false;
+            return 1;
+        }
+
+        // receive the data
+        r = _read(buffer, 512);
+
+    } else {
+        // set read address for multiple blocks (CMD18), card stays selected until CMD12
+        if(_cmdx(SDCMD_READ_MULTIPLE_BLOCK, BLOCK2ADDR(block_number)) != 0) {
+            _cs = 1;
+            _spi.write(0xFF);
+            busyflag = false;
+            return 1;
+        }
+
+        for(uint32_t i = 0; i < count && r == 0; i++) {
+            r = _read_data(buffer, 512);
+            buffer += 512;
+        }
+
+        if(_stop_transmission() != 0) r = 1;
+    }
 
     busyflag = false;
 
-    return 0;
+    return r;
 }
 
 int SDCard::disk_status() { return (_sectors > 0)?0:1; }
@@ -336,7 +401,7 @@ int SDCard::disk_sync() {
 uint32_t SDCard::disk_sectors() { return _sectors; }
 uint64_t SDCard::disk_size() { return ((uint64_t) _sectors) << 9; }
 uint32_t SDCard::disk_blocksize() { return (1<<9); }
-bool SDCard::disk_canDMA() { return false; }
+bool SDCard::disk_canDMA() { return _dma.available(); }
 
 SDCard::CARD_TYPE SDCard::card_type()
 {
@@ -456,38 +521,60 @@ int SDCard::_cmd8() {
 int SDCard::_read(char *buffer, int length) {
     _cs = 0;
 
-    // read until start byte (0xFF)
-    while(_spi.write(0xFF) != 0xFE);
-//     uint8_t r;
-//     while((r = _spi.write(0xFF)) != 0xFE)
-//     {
-//         iprintf("0x%02X ", r);
-//         for (volatile uint32_t j = 262144; j; j--);
-//     }
-//
-//     iprintf("Got start byte, reading data\n");
+    int r = _read_data(buffer, length);
+
+    _cs = 1;
+    _spi.write(0xFF);
+    return r;
+}
+
+// read one data block with the card already selected
+int SDCard::_read_data(char *buffer, int length) {
+    // read until start byte (0xFE), anything else that is not 0xFF is an error token
+    int token = 0xFF;
+    for(int i=0; i<SD_DATA_TIMEOUT && token == 0xFF; i++) {
+        token = _spi.write(0xFF);
+    }
+    if(token != 0xFE) {
+        return 1;
+    }
 
     // read data
-    for(int i=0; i<length; i++) {
-        buffer[i] = _spi.write(0xFF);
+    if(_dma.available()) {
+        _dma.transfer(NULL, (uint8_t *)buffer, length);
+    } else {
+        for(int i=0; i<length; i++) {
+            buffer[i] = _spi.write(0xFF);
+        }
     }
     _spi.write(0xFF); // checksum
     _spi.write(0xFF);
 
-    _cs = 1;
-    _spi.write(0xFF);
     return 0;
 }
 
 int SDCard::_write(const char *buffer, int length) {
     _cs = 0;
 
+    int r = _write_data(0xFE, buffer, length);
+
+    _cs = 1;
+    _spi.write(0xFF);
+    return r;
+}
+
+// write one data block with the card already selected, token is 0xFE for single writes and 0xFC inside multiple writes
+int SDCard::_write_data(uint8_t token, const char *buffer, int length) {
     // indicate start of block
-    _spi.write(0xFE);
+    _spi.write(token);
 
     // write the data
-    for(int i=0; i<length; i++) {
-        _spi.write(buffer[i]);
+    if(_dma.available()) {
+        _dma.transfer((const uint8_t *)buffer, NULL, length);
+    } else {
+        for(int i=0; i<length; i++) {
+            _spi.write(buffer[i]);
+        }
     }
 
     // write the checksum
@@ -496,17 +583,44 @@ int SDCard::_write(const char *buffer, int length) {
 
     // check the repsonse token
     if((_spi.write(0xFF) & 0x1F) != 0x05) {
-        _cs = 1;
-        _spi.write(0xFF);
         return 1;
     }
 
     // wait for write to finish
-    while(_spi.write(0xFF) == 0);
+    return _wait_not_busy();
+}
+
+// the card holds MISO low while it is busy programming
+int SDCard::_wait_not_busy() {
+    for(int i=0; i<SD_DATA_TIMEOUT * 10; i++) {
+        if(_spi.write(0xFF) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+// end a multiple block read, CMD12 is sent without deselecting the card
+int SDCard::_stop_transmission() {
+    _spi.write(0x40 | SDCMD_STOP_TRANSMISSION);
+    _spi.write(0x00);
+    _spi.write(0x00);
+    _spi.write(0x00);
+    _spi.write(0x00);
+    _spi.write(0x95);
+    _spi.write(0xFF); // stuff byte
+
+    int response = -1;
+    for(int i=0; i<SD_COMMAND_TIMEOUT; i++) {
+        response = _spi.write(0xFF);
+        if(!(response & 0x80))
+            break;
+    }
+
+    int r = (response == 0 && _wait_not_busy() == 0) ? 0 : 1;
 
     _cs = 1;
     _spi.write(0xFF);
-    return 0;
+    return r;
 }
 
 static int ext_bits(char *data, int msb, int lsb) {
@@ -28,12 +28,11 @@
 
 #include "spi.h"
 #include "gpio.h"
+#include "SPIDMA.h"
 
 #include "disk.h"
 #include "mbed.h"
 
-// #include "DMA.h"
-
 /** Access the filesystem on an SD Card using SPI
  *
  * @code
@@ -70,8 +69,8 @@ public:
     } CARD_TYPE;
 
     virtual int disk_initialize();
-    virtual int disk_write(const char *buffer, uint32_t block_number);
-    virtual int disk_read(char *buffer, uint32_t block_number);
+    virtual int disk_write(const char *buffer, uint32_t block_number, uint32_t count = 1);
+    virtual int disk_read(char *buffer, uint32_t block_number, uint32_t count = 1);
     virtual int disk_status();
     virtual int disk_sync();
     virtual uint32_t disk_sectors();
@@ -95,11 +94,16 @@ protected:
 
     int _read(char *buffer, int length);
     int _write(const char *buffer, int length);
+    int _read_data(char *buffer, int length);
+    int _write_data(uint8_t token, const char *buffer, int length);
+    int _wait_not_busy();
+    int _stop_transmission();
 
     uint32_t _sd_sectors();
     uint32_t _sectors;
 
     mbed::SPI _spi;
+    SPIDMA _dma;
     GPIO _cs;
 
     volatile bool busyflag;
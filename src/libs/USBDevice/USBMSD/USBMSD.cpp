@@ -70,6 +70,9 @@
 // max packet size
 #define MAX_PACKET  MAX_PACKET_SIZE_EPBULK
 
+// blocks read or written with one disk command, less if there is not enough AHB0 for them
+#define MAX_CHUNK_BLOCKS 8
+
 // #define iprintf(...) THEKERNEL->streams->printf(__VA_ARGS__)
 #define iprintf(...) do { } while (0)
 
@@ -191,7 +194,11 @@ bool USBMSD::connect()
     BlockSize = disk->disk_blocksize();
 
     if ((BlockCount > 0) && (BlockSize != 0)) {
-        page = (uint8_t*) AHB0.alloc(BlockSize);
+        for (chunk_blocks = MAX_CHUNK_BLOCKS; chunk_blocks > 0; chunk_blocks /= 2) {
+            page = (uint8_t*) AHB0.alloc(chunk_blocks * BlockSize);
+            if (page != NULL)
+                break;
+        }
         if (page == NULL)
             return false;
     } else {
@@ -304,33 +311,33 @@ bool USBMSD::USBEvent_EPIn(uint8_t bEP, uint8_t bEPStatus) {
 void USBMSD::memoryWrite (uint8_t * buf, uint16_t size) {
 
     if (lba > BlockCount) {
-        size = (BlockCount - lba) * BlockSize + addr_in_block;
+        size = (BlockCount - lba) * BlockSize + addr_in_chunk;
         stage = ERROR;
         usb->stallEndpoint(MSC_BulkOut.bEndpointAddress);
     }
 
-    // we fill an array in RAM of 1 block before writing it in memory
+    // we fill an array in RAM of up to chunk_blocks blocks before writing it in memory
     for (int i = 0; i < size; i++)
-        page[addr_in_block + i] = buf[i];
-
-    // if the array is filled, write it in memory
-    if ((addr_in_block + size) >= BlockSize) {
-        if (!(disk->disk_status() & WRITE_PROTECT)) {
-            disk->disk_write((const char *)page, lba);
-        }
-    }
+        page[addr_in_chunk + i] = buf[i];
 
-    addr_in_block += size;
+    addr_in_chunk += size;
     length -= size;
     csw.DataResidue -= size;
-    if (addr_in_block >= BlockSize)
-    {
-        addr_in_block = 0;
-        lba++;
+
+    // if the array is filled, or the transfer is done, write it in memory with one command
+    if ((addr_in_chunk >= chunk_blocks * BlockSize) || !length) {
+        uint32_t n = (addr_in_chunk + BlockSize - 1) / BlockSize;
+        if (!(disk->disk_status() & WRITE_PROTECT)) {
+            if (disk->disk_write((const char *)page, lba, n) != 0)
+                diskOK = false;
+            disk->host_writes++;
+        }
+        addr_in_chunk = 0;
+        lba += n;
     }
 
     if ((!length) || (stage != PROCESS_CBW)) {
-        csw.Status = (stage == ERROR) ? CSW_FAILED : CSW_PASSED;
+        csw.Status = (stage == ERROR || !diskOK) ? CSW_FAILED : CSW_PASSED;
         sendCSW();
     }
 }
@@ -643,41 +650,55 @@ void USBMSD::memoryRead (void) {
 
     if (lba > BlockCount) {
         iprintf("MSD:Attemt to read beyond end of disk! Read LBA %lu > Disk LBAs %lu\n", lba, BlockCount);
-        n = (BlockCount - lba) * BlockSize + addr_in_block;
+        n = (BlockCount - lba) * BlockSize + addr_in_chunk;
         stage = ERROR;
     }
 
-    // we read an entire block
-    if (addr_in_block == 0)
-    {
-        iprintf("MSD:LBA %lu:", lba);
-        disk->disk_read((char *)page, lba);
-    }
+    // the first chunk of the transfer, the rest are read ahead below
+    if (chunk_len == 0)
+        readChunk();
 
-    iprintf(" %u", addr_in_block / MAX_PACKET_SIZE_EPBULK);
+    iprintf(" %u", addr_in_chunk / MAX_PACKET_SIZE_EPBULK);
 
     // write data which are in RAM
-    usb->writeNB(MSC_BulkIn.bEndpointAddress, &page[addr_in_block], n, MAX_PACKET_SIZE_EPBULK);
+    usb->writeNB(MSC_BulkIn.bEndpointAddress, &page[addr_in_chunk], n, MAX_PACKET_SIZE_EPBULK);
 
-    addr_in_block += n;
+    addr_in_chunk += n;
 
     length -= n;
     csw.DataResidue -= n;
 
-    if (addr_in_block >= BlockSize)
+    if (addr_in_chunk >= chunk_len)
     {
         iprintf("\n");
-        addr_in_block = 0;
-        lba++;
+        addr_in_chunk = 0;
+        chunk_len = 0;
+        // the endpoint has its own copy of the packet just written, so the next chunk is read while it goes out
+        if (length && (stage == PROCESS_CBW))
+            readChunk();
     }
 
     if ( !length || (stage != PROCESS_CBW)) {
-        csw.Status = (stage == PROCESS_CBW) ? CSW_PASSED : CSW_FAILED;
+        csw.Status = (stage == PROCESS_CBW && diskOK) ? CSW_PASSED : CSW_FAILED;
         stage = (stage == PROCESS_CBW) ? SEND_CSW : stage;
     }
     usb->endpointSetInterrupt(MSC_BulkIn.bEndpointAddress, true);
 }
 
+// read as many of the blocks left in the transfer as fit in page, with one multiple block read
+void USBMSD::readChunk (void) {
+    uint32_t n = (length + BlockSize - 1) / BlockSize;
+    if (n > chunk_blocks)
+        n = chunk_blocks;
+
+    iprintf("MSD:LBA %lu+%lu:", lba, n);
+    if (disk->disk_read((char *)page, lba, n) != 0)
+        diskOK = false;
+
+    lba += n;
+    chunk_len = n * BlockSize;
+}
+
 bool USBMSD::infoTransfer (void) {
     // Logical Block Address of First Block
     lba = (cbw.CB[2] << 24) | (cbw.CB[3] << 16) | (cbw.CB[4] <<  8) | (cbw.CB[5] <<  0);
@@ -726,6 +747,9 @@ bool USBMSD::infoTransfer (void) {
     }
 
     addr_in_block = 0;
+    addr_in_chunk = 0;
+    chunk_len = 0;
+    diskOK = true;
 
 //     iprintf("MSD:transferring %lu blocks from LBA %lu.\n", blocks, lba);
 
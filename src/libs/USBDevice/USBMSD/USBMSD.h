@@ -158,8 +158,17 @@ private:
     // memory OK (after a memoryVerify)
     bool memOK;
 
+    // every disk read or write of the transfer succeeded
+    bool diskOK;
+
     // cache in RAM before writing in memory. Useful also to read a block.
+    // holds up to chunk_blocks blocks so runs of blocks go to and from the disk in one multiple block command
     uint8_t * page;
+    uint32_t chunk_blocks;
+
+    // bytes of the chunk held in page, and how far into it the transfer has got
+    uint32_t chunk_len;
+    uint32_t addr_in_chunk;
 
     // USB packet buffer
     uint8_t buffer[MAX_PACKET_SIZE_EPBULK];
@@ -176,6 +185,7 @@ private:
     bool readCapacity (void);
     bool infoTransfer (void);
     void memoryRead (void);
+    void readChunk (void);
     bool modeSense6 (void);
     void testUnitReady (void);
     bool requestSense (void);
@@ -185,4 +195,4 @@ private:
     void fail();
 };
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
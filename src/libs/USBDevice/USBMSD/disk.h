@@ -5,23 +5,27 @@
 
 class MSD_Disk {
 public:
+    MSD_Disk() : host_writes(0) {};
+
     /*
-     * read a block on a storage chip
+     * read consecutive blocks on a storage chip
      *
      * @param data pointer where will be stored read data
-     * @param block block number
+     * @param block first block number
+     * @param count number of blocks
      * @returns 0 if successful
      */
-    virtual int disk_read(char * data, uint32_t block) { return 0; };
+    virtual int disk_read(char * data, uint32_t block, uint32_t count = 1) { return 0; };
 
     /*
-     * write a block on a storage chip
+     * write consecutive blocks on a storage chip
      *
      * @param data data to write
-     * @param block block number
+     * @param block first block number
+     * @param count number of blocks
      * @returns 0 if successful
      */
-    virtual int disk_write(const char * data, uint32_t block) { return 0; };
+    virtual int disk_write(const char * data, uint32_t block, uint32_t count = 1) { return 0; };
 
     /*
      * Disk initilization
@@ -59,6 +63,11 @@ public:
     virtual int disk_sync() { return 0; };
 
     virtual bool busy() = 0;
+
+    /*
+     * counts the writes made by the USB host, a cache of the disk drops what it holds when this changes
+     */
+    volatile uint32_t host_writes;
 };
 
 #endif /* _DISK_H */
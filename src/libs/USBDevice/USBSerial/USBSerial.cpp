@@ -22,6 +22,7 @@
 #include "USBSerial.h"
 
 #include "libs/Kernel.h"
+#include "libs/Scheduler.h"
 #include "libs/SerialMessage.h"
 #include "StreamOutputPool.h"
 
@@ -196,8 +197,17 @@ bool USBSerial::USBEvent_EPOut(uint8_t bEP, uint8_t bEPStatus)
     iprintf("Read %ld bytes:\n\t", size);
     for (uint8_t i = 0; i < size; i++) {
 
+        // a ? at the start of a line may be a realtime status query, it is answered on idle and never queued
+        int n = query.receive(c[i]);
+        if (n == 0)
+            continue;
+
         if (flush_to_nl == false)
+        {
+            if (n == 2)
+                rxbuf.queue('?');
             rxbuf.queue(c[i]);
+        }
 
         if (c[i] >= 32 && c[i] < 128)
         {
@@ -258,7 +268,17 @@ bool USBSerial::ready()
 
 void USBSerial::on_module_loaded()
 {
-    this->register_for_event(ON_MAIN_LOOP);
+    THEKERNEL->scheduler->add_task("usb serial", [](void *serial) { static_cast<USBSerial *>(serial)->on_main_loop(nullptr); }, this, Scheduler::HIGH_PRIORITY);
+    this->register_for_event(ON_IDLE);
+}
+
+void USBSerial::on_idle(void *argument)
+{
+    if (query.take())
+    {
+        if (attached)
+            puts(THEKERNEL->get_query_string().c_str());
+    }
 }
 
 void USBSerial::on_main_loop(void *argument)
@@ -25,6 +25,7 @@
 
 #include "Module.h"
 #include "StreamOutput.h"
+#include "RealtimeQuery.h"
 
 class USBSerial_Receiver {
 protected:
@@ -49,6 +50,7 @@ public:
 
     void on_module_loaded(void);
     void on_main_loop(void *);
+    void on_idle(void *);
 
 protected:
 //     virtual bool EpCallback(uint8_t, uint8_t);
@@ -75,6 +77,9 @@ protected:
     // flushing until we find a newline.
     // this flag asserts when we are doing this
     bool flush_to_nl;
+
+    // ? realtime status queries received
+    RealtimeQuery query;
 private:
     USB *usb;
 //     mbed::FunctionPointer rx;
@@ -32,6 +32,10 @@ along with Grbl. If not, see <http://www.gnu.org/licenses/>.
 #define clear_vector(a) memset(a, 0, sizeof(a))
 #define clear_vector_float(a) memset(a, 0, sizeof(a))
 
+// positions can be held as integer nanometres so relative moves sum without float rounding drift
+#define mm_to_nm(mm) ((int64_t)llround((double)(mm) * 1000000.0))
+#define nm_to_mm(nm) ((float)((double)(nm) / 1000000.0))
+
 #define confine(value, min, max) (((value) < (min))?(min):(((value) > (max))?(max):(value)))
 
 #define dd(...) LPC_GPIO2->FIODIR = 0xffff; LPC_GPIO2->FIOCLR = 0xffff; LPC_GPIO2->FIOSET = __VA_ARGS__
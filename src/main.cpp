@@ -32,6 +32,7 @@
 #include "checksumm.h"
 #include "ConfigValue.h"
 #include "StepTicker.h"
+#include "Scheduler.h"
 
 // #include "libs/ChaNFSSD/SDFileSystem.h"
 #include "libs/nuts_bolts.h"
@@ -60,6 +61,7 @@
 #define disable_msd_checksum  CHECKSUM("msd_disable")
 #define disable_leds_checksum  CHECKSUM("leds_disable")
 #define dfu_enable_checksum  CHECKSUM("dfu_enable")
+#define sd_cache_sectors_checksum  CHECKSUM("sd_cache_sectors")
 
 // Watchdog wd(5000000, WDT_MRI);
 
@@ -116,6 +118,10 @@ void init() {
     bool sdok= (sd.disk_initialize() == 0);
     if(!sdok) kernel->streams->printf("SDCard is disabled\r\n");
 
+    if(sdok && !mounter.set_cache_size(kernel->config->value( sd_cache_sectors_checksum )->by_default(0)->as_number())) {
+        kernel->streams->printf("Not enough AHB0 memory for the sd cache\r\n");
+    }
+
 #ifdef DISABLEMSD
     // attempt to be able to disable msd in config
     if(sdok && !kernel->config->value( disable_msd_checksum )->by_default(false)->as_bool()){
@@ -255,7 +261,6 @@ int main()
             // flash led 2 to show we are alive
             leds[1]= (cnt++ & 0x1000) ? 1 : 0;
         }
-        THEKERNEL->call_event(ON_MAIN_LOOP);
-        THEKERNEL->call_event(ON_IDLE);
+        THEKERNEL->scheduler->run_pass();
     }
 }
@@ -22,6 +22,7 @@
 #include "ConfigValue.h"
 #include "PublicDataRequest.h"
 #include "PublicData.h"
+#include "PlayerPublicAccess.h"
 
 #define return_error_on_unhandled_gcode_checksum    CHECKSUM("return_error_on_unhandled_gcode")
 #define panel_display_message_checksum CHECKSUM("display_message")
@@ -164,14 +165,12 @@ try_again:
 
                                 this->upload_filename = "/sd/" + single_command.substr(4); // rest of line is filename
                                 // open file
-                                upload_fd = fopen(this->upload_filename.c_str(), "w");
-                                if(upload_fd != NULL) {
+                                if(this->upload_file.open(this->upload_filename.c_str())) {
                                     this->uploading = true;
                                     new_message.stream->printf("Writing to file: %s\r\nok\r\n", this->upload_filename.c_str());
                                 } else {
                                     new_message.stream->printf("open failed, File: %s.\r\nok\r\n", this->upload_filename.c_str());
                                 }
-                                //printf("Start Uploading file: %s, %p\n", upload_filename.c_str(), upload_fd);
                                 continue;
 
                             case 112: // emergency stop, do the best we can with this
@@ -248,41 +247,33 @@ try_again:
                 } else {
                     // we are uploading a file so save it
                     if(single_command.substr(0, 3) == "M29") {
-                        // done uploading, close file
-                        fclose(upload_fd);
-                        upload_fd = NULL;
+                        // done uploading, what is still buffered is written before the file is closed
+                        if(upload_file.is_open() && !upload_file.close()) {
+                            new_message.stream->printf("Error:error writing to file.\r\n");
+                        }
                         uploading = false;
+                        // let the player index it in the background
+                        PublicData::set_value(player_checksum, index_file_checksum, &upload_filename);
                         upload_filename.clear();
                         new_message.stream->printf("Done saving file.\r\nok\r\n");
                         continue;
                     }
 
-                    if(upload_fd == NULL) {
+                    if(!upload_file.is_open()) {
                         // error detected writing to file so discard everything until it stops
                         new_message.stream->printf("ok\r\n");
                         continue;
                     }
 
+                    // buffered and written a sector at a time in later passes of the main loop
                     single_command.append("\n");
-                    static int cnt = 0;
-                    if(fwrite(single_command.c_str(), 1, single_command.size(), upload_fd) != single_command.size()) {
-                        // error writing to file
+                    if(!upload_file.write(single_command.c_str(), single_command.size())) {
+                        // error writing this or an earlier line to file
                         new_message.stream->printf("Error:error writing to file.\r\n");
-                        fclose(upload_fd);
-                        upload_fd = NULL;
+                        upload_file.close();
                         continue;
-
-                    } else {
-                        cnt += single_command.size();
-                        if (cnt > 400) {
-                            // HACK ALERT to get around fwrite corruption close and re open for append
-                            fclose(upload_fd);
-                            upload_fd = fopen(upload_filename.c_str(), "a");
-                            cnt = 0;
-                        }
-                        new_message.stream->printf("ok\r\n");
-                        //printf("uploading file write ok\n");
                     }
+                    new_message.stream->printf("ok\r\n");
                 }
             }
 
@@ -9,6 +9,7 @@
 #define GCODE_DISPATCH_H
 
 #include "libs/Module.h"
+#include "libs/FileIO.h"
 
 #include <stdio.h>
 #include <string>
@@ -26,7 +27,7 @@ public:
 private:
     int currentline;
     string upload_filename;
-    FILE *upload_fd;
+    FileIOWriter upload_file;
     uint8_t last_g;
     struct {
         bool uploading: 1;
@@ -10,6 +10,7 @@
 using std::string;
 #include "libs/Module.h"
 #include "libs/Kernel.h"
+#include "libs/Scheduler.h"
 #include "libs/nuts_bolts.h"
 #include "SerialConsole.h"
 #include "libs/RingBuffer.h"
@@ -30,8 +31,11 @@ void SerialConsole::on_module_loaded() {
     // We want to be called every time a new char is received
     this->serial->attach(this, &SerialConsole::on_serial_char_received, mbed::Serial::RxIrq);
 
-    // We only call the command dispatcher in the main loop, nowhere else
-    this->register_for_event(ON_MAIN_LOOP);
+    // We only call the command dispatcher in the main loop, nowhere else, it is high priority as it refills the queue
+    THEKERNEL->scheduler->add_task("serial", [](void *console) { static_cast<SerialConsole *>(console)->on_main_loop(nullptr); }, this, Scheduler::HIGH_PRIORITY);
+
+    // Status queries are answered on idle, so they also get answered while the main loop waits on a full queue
+    this->register_for_event(ON_IDLE);
 
     // Add to the pack of streams kernel can call to, for example for broadcasting
     THEKERNEL->streams->append_stream(this);
@@ -43,7 +47,10 @@ void SerialConsole::on_serial_char_received(){
         char received = this->serial->getc();
         // convert CR to NL (for host OSs that don't send NL)
         if( received == '\r' ){ received = '\n'; }
-        this->buffer.push_back(received);
+        // a ? at the start of a line may be a realtime status query, which never goes in the line buffer
+        int n = this->query.receive(received);
+        if( n == 2 ){ this->buffer.push_back('?'); }
+        if( n > 0 ){ this->buffer.push_back(received); }
     }
 }
 
@@ -68,6 +75,12 @@ void SerialConsole::on_main_loop(void * argument){
     }
 }
 
+// Answer a pending status query
+void SerialConsole::on_idle(void * argument){
+    if( this->query.take() ){
+        this->puts(THEKERNEL->get_query_string().c_str());
+    }
+}
 
 int SerialConsole::puts(const char* s)
 {
@@ -9,6 +9,7 @@
 #include "Gcode.h"
 #include "libs/StreamOutput.h"
 #include "utils.h"
+#include "Profiler.h"
 #include <stdlib.h>
 #include <algorithm>
 
@@ -158,6 +159,8 @@ std::map<char,float> Gcode::get_args() const
 // Cache some of this command's properties, so we don't have to parse the string every time we want to look at them
 void Gcode::prepare_cached_values(bool strip)
 {
+    PROFILE_SCOPE(PROFILE_GCODE_PARSE);
+
     char *p= nullptr;
     if( this->has_letter('G') ) {
         this->has_g = true;
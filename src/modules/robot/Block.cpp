@@ -58,7 +58,10 @@ void Block::clear()
     nominal_length_flag = false;
     max_entry_speed     = 0.0F;
     is_ready            = false;
+    queued_at           = 0;
     times_taken         = 0;
+    follower_count      = 0;
+    for (int i = 0; i < max_followers; i++) extruder_mix[i] = (i == 0) ? 1.0F : 0.0F;
 }
 
 void Block::debug()
@@ -237,6 +240,28 @@ float Block::max_exit_speed()
     return min(max, nominal_speed);
 }
 
+// Seconds the planned trapezoid takes, worked out in mm from the entry, nominal and exit speeds rather than from the step rates
+float Block::duration() const
+{
+    if (this->millimeters <= 0.0F || this->nominal_speed <= 0.0F)
+        return 0.0F;
+
+    float v0 = this->entry_speed, v1 = this->exit_speed, vn = this->nominal_speed, a = this->acceleration;
+    if (a <= 0.0F)
+        return this->millimeters / vn;
+
+    float accelerate_mm = (vn * vn - v0 * v0) / (2.0F * a);
+    float decelerate_mm = (vn * vn - v1 * v1) / (2.0F * a);
+
+    if (accelerate_mm + decelerate_mm <= this->millimeters) {
+        return (vn - v0) / a + (vn - v1) / a + (this->millimeters - accelerate_mm - decelerate_mm) / vn;
+    }
+
+    // never gets to nominal speed, accelerates up to where it has to start braking
+    float peak = sqrtf((2.0F * a * this->millimeters + v0 * v0 + v1 * v1) / 2.0F);
+    return (max(peak - v0, 0.0F) + max(peak - v1, 0.0F)) / a;
+}
+
 // Gcodes are attached to their respective blocks so that on_gcode_execute can be called with it
 void Block::append_gcode(Gcode* gcode)
 {
@@ -271,6 +296,14 @@ void Block::ready()
     this->is_ready = true;
 }
 
+// Add a motor that steps along with the axes for this block, returns false if there is no room for it
+bool Block::add_follower(StepperMotor *motor)
+{
+    if(follower_count >= max_followers) return false;
+    followers[follower_count++] = motor;
+    return true;
+}
+
 // Mark the block as taken by one more module
 void Block::take()
 {
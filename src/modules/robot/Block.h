@@ -12,6 +12,7 @@
 #include <bitset>
 
 class Gcode;
+class StepperMotor;
 
 class Block {
     public:
@@ -26,6 +27,8 @@ class Block {
 
         float max_exit_speed();
 
+        float duration() const;
+
         void debug();
 
         void append_gcode(Gcode* gcode);
@@ -35,6 +38,8 @@ class Block {
 
         void ready();
 
+        bool add_follower(StepperMotor *motor);
+
         void clear();
 
         void begin();
@@ -57,8 +62,19 @@ class Block {
 
         float max_entry_speed;
 
+        uint32_t queued_at;   // us_ticker_read() when the Conveyor queued it, for the queue wait time
+
         short times_taken;    // A block can be "taken" by any number of modules, and the next block is not moved to until all the modules have "released" it. This value serves as a tracker.
 
+        // motors that are not axes but step along with them for this block, like extruders in FOLLOW mode,
+        // the Stepper sets their speed with the axes and only releases the block once they have finished too
+        static const int max_followers = 5;
+        StepperMotor  *followers[max_followers];
+        uint8_t        follower_count;
+
+        // share of the extrusion each motor of a mixing extruder moves, the mix set when the block was queued
+        float          extruder_mix[max_followers];
+
         std::bitset<3> direction_bits;     // Direction for each axis in bit form, relative to the direction port's mask
         struct {
             bool recalculate_flag:1;             // Planner flag to recalculate trapezoids on entry junction
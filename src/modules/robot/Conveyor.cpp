@@ -7,6 +7,7 @@
 
 using namespace std;
 #include <vector>
+#include <string.h>
 #include "libs/nuts_bolts.h"
 #include "libs/RingBuffer.h"
 #include "../communication/utils/Gcode.h"
@@ -22,6 +23,12 @@ using namespace std;
 #include "Config.h"
 #include "libs/StreamOutputPool.h"
 #include "ConfigValue.h"
+#include "StreamOutput.h"
+#include "PublicDataRequest.h"
+#include "PublicData.h"
+#include "PlayerPublicAccess.h"
+#include "us_ticker_api.h" // mbed.h lib
+#include "libs/Scheduler.h"
 
 #define planner_queue_size_checksum CHECKSUM("planner_queue_size")
 
@@ -57,12 +64,21 @@ Conveyor::Conveyor(){
     running = false;
     flush = false;
     halted= false;
+    ran_dry= false;
+    dry_run_done = nullptr;
+    dry_run_object = nullptr;
+    dry_run_queued = 0;
+    for (int i = 0; i < Block::max_followers; i++) extruder_mix[i] = (i == 0) ? 1.0F : 0.0F;
+    reset_stats();
 }
 
 void Conveyor::on_module_loaded(){
     register_for_event(ON_IDLE);
-    register_for_event(ON_MAIN_LOOP);
     register_for_event(ON_HALT);
+    // after the robot's task, so a path it releases starts in the same pass
+    THEKERNEL->scheduler->add_task("conveyor", [](void *conveyor) { static_cast<Conveyor *>(conveyor)->on_main_loop(nullptr); }, this, Scheduler::HIGH_PRIORITY);
+    register_for_event(ON_GET_PUBLIC_DATA);
+    register_for_gcode('M', 409);
 
     on_config_reload(this);
 }
@@ -79,10 +95,12 @@ void Conveyor::on_halt(void* argument){
 // Delete blocks here, because they can't be deleted in interrupt context ( see Block.cpp:release )
 // note that blocks get cleaned as they come off the tail, so head ALWAYS points to a cleaned block.
 void Conveyor::on_idle(void* argument){
-    if (queue.tail_i != gc_pending)
+    // free every block the stepper has finished with, not just one per call, so the queue refills without waiting for another pass
+    while (queue.tail_i != gc_pending)
     {
         if (queue.is_empty()) {
             __debugbreak();
+            break;
         }else{
             // Cleanly delete block
             Block* block = queue.tail_ref();
@@ -113,7 +131,16 @@ void Conveyor::on_idle(void* argument){
 
 void Conveyor::on_main_loop(void*)
 {
-    if (running)
+    if (ran_dry) {
+        // only count it as starved if there was more to come, the queue always runs dry at the end of a job
+        ran_dry = false;
+        void *returned_data;
+        if (PublicData::get_value( player_checksum, is_playing_checksum, &returned_data ) && *static_cast<bool *>(returned_data)) {
+            stats.starved_count++;
+        }
+    }
+
+    if (running || is_dry_run())
         return;
 
     if (queue.is_empty())
@@ -129,6 +156,19 @@ void Conveyor::on_main_loop(void*)
         ensure_running();
 }
 
+// Record how full the queue is and how long the block waited in it, called in interrupt context as well
+inline void Conveyor::block_starting(Block *block)
+{
+    unsigned int d = depth();
+    unsigned int bucket = d * QUEUE_DEPTH_BUCKETS / queue.length;
+    stats.depth_histogram[bucket < QUEUE_DEPTH_BUCKETS ? bucket : QUEUE_DEPTH_BUCKETS - 1]++;
+    stats.blocks++;
+
+    uint32_t wait = us_ticker_read() - block->queued_at;
+    stats.total_wait_us += wait;
+    if (wait > stats.max_wait_us) stats.max_wait_us = wait;
+}
+
 void Conveyor::on_config_reload(void* argument)
 {
     queue.resize(THEKERNEL->config->value(planner_queue_size_checksum)->by_default(32)->as_number());
@@ -140,6 +180,13 @@ void Conveyor::append_gcode(Gcode* gcode)
     queue.head_ref()->append_gcode(gcode);
 }
 
+// The block queued after block, nullptr if there is none yet, safe from the step interrupt as queued blocks do not change
+Block* Conveyor::next_block(const Block* block)
+{
+    unsigned int i = queue.next(block - queue.ring);
+    return (i == queue.head_i) ? nullptr : queue.item_ref(i);
+}
+
 // Process a new block in the queue
 void Conveyor::on_block_end(void* block)
 {
@@ -159,15 +206,68 @@ void Conveyor::on_block_end(void* block)
     if (gc_pending == queue.head_i)
     {
         running = false;
+        if (!flush && !halted) {
+            stats.dry_count++;
+            ran_dry = true;
+        }
         return;
     }
 
     // Get a new block
     Block* next = this->queue.item_ref(gc_pending);
 
+    block_starting(next);
     next->begin();
 }
 
+// M409 reports the queue telemetry, M409 R resets it after reporting
+void Conveyor::on_gcode_received(void *argument)
+{
+    Gcode *gcode = static_cast<Gcode *>(argument);
+    if (gcode->has_m && gcode->m == 409) {
+        report_stats(gcode->stream);
+        if (gcode->has_letter('R')) reset_stats();
+        gcode->mark_as_taken();
+    }
+}
+
+void Conveyor::on_get_public_data(void *argument)
+{
+    PublicDataRequest *pdr = static_cast<PublicDataRequest *>(argument);
+
+    if(!pdr->starts_with(conveyor_checksum)) return;
+
+    if(pdr->second_element_is(queue_stats_checksum)) {
+        static struct pad_queue_stats pad;
+        pad = stats;
+        pad.queue_size = queue.length;
+        pad.depth = depth();
+        pdr->set_data_ptr(&pad);
+        pdr->set_taken();
+    }
+}
+
+void Conveyor::report_stats(StreamOutput *stream)
+{
+    struct pad_queue_stats s = stats;
+    stream->printf("queue %u of %u blocks, %lu blocks started, ran dry %lu times, %lu while playing\r\n",
+                   depth(), queue.length, s.blocks, s.dry_count, s.starved_count);
+    stream->printf("wait in queue avg %1.1f ms, max %1.1f ms\r\n",
+                   s.blocks > 0 ? s.total_wait_us / 1000.0F / s.blocks : 0.0F, s.max_wait_us / 1000.0F);
+    stream->printf("queue depth when blocks started:");
+    for (int i = 0; i < QUEUE_DEPTH_BUCKETS; i++) {
+        stream->printf(" %d-%d%%: %lu", i * 100 / QUEUE_DEPTH_BUCKETS, (i + 1) * 100 / QUEUE_DEPTH_BUCKETS, s.depth_histogram[i]);
+    }
+    stream->printf("\r\n");
+}
+
+void Conveyor::reset_stats()
+{
+    __disable_irq();
+    memset(&stats, 0, sizeof(stats));
+    __enable_irq();
+}
+
 // Wait for the queue to be empty
 void Conveyor::wait_for_empty_queue()
 {
@@ -184,6 +284,11 @@ void Conveyor::queue_head_block()
 {
     // upstream caller will block on this until there is room in the queue
     while (queue.is_full()) {
+        if (is_dry_run()) {
+            // the oldest block would be running by now
+            dry_run_tail();
+            continue;
+        }
         ensure_running();
         THEKERNEL->call_event(ON_IDLE, this);
     }
@@ -195,18 +300,34 @@ void Conveyor::queue_head_block()
 
     }else{
         queue.head_ref()->ready();
+        queue.head_ref()->queued_at = us_ticker_read();
+        memcpy(queue.head_ref()->extruder_mix, extruder_mix, sizeof(extruder_mix));
         queue.produce_head();
+        if (is_dry_run()) dry_run_queued++;
     }
 }
 
+// a mix change is planned like a move, the blocks already queued keep the mix they were queued with
+void Conveyor::set_extruder_mix(const float *mix, int channels)
+{
+    for (int i = 0; i < Block::max_followers; i++) extruder_mix[i] = (i < channels) ? mix[i] : 0.0F;
+}
+
 void Conveyor::ensure_running()
 {
+    if (is_dry_run()) {
+        // nothing runs in a dry run, so anyone waiting for the queue gets it emptied
+        while (gc_pending != queue.head_i) dry_run_tail();
+        return;
+    }
+
     if (!running)
     {
         if (gc_pending == queue.head_i)
             return;
 
         running = true;
+        block_starting(queue.item_ref(gc_pending));
         queue.item_ref(gc_pending)->begin();
     }
 }
@@ -221,6 +342,41 @@ void Conveyor::ensure_running()
 
 */
 
+// The queue must be empty and stay that way until the dry run starts, as blocks queued before it would not be stepped either
+void Conveyor::start_dry_run(dry_run_done_t done, void *object)
+{
+    // gcodes still waiting on the head block are real, let them run first
+    if (queue.head_ref()->gcodes.size()) {
+        queue_head_block();
+    }
+    wait_for_empty_queue();
+    dry_run_object = object;
+    dry_run_queued = 0;
+    dry_run_done = done;
+}
+
+// whatever is still queued is handed to done first
+void Conveyor::stop_dry_run()
+{
+    if (!is_dry_run()) return;
+    wait_for_empty_queue();
+    // gcodes attached to the head by moves that made no block, like extruder only moves, must not run now
+    queue.head_ref()->clear();
+    dry_run_done = nullptr;
+    dry_run_object = nullptr;
+}
+
+// Hand the oldest block to the dry run instead of stepping it, and free it straight away
+void Conveyor::dry_run_tail()
+{
+    if (gc_pending == queue.head_i) return;
+
+    Block *block = queue.item_ref(gc_pending);
+    dry_run_done(dry_run_object, block);
+    gc_pending = queue.next(gc_pending);
+    on_idle(nullptr);
+}
+
 void Conveyor::flush_queue()
 {
     flush = true;
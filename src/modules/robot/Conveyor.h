@@ -10,13 +10,15 @@
 
 #include "libs/Module.h"
 #include "HeapRing.h"
+#include "ConveyorPublicAccess.h"
+#include "Block.h"
 
 using namespace std;
 #include <string>
 #include <vector>
 
 class Gcode;
-class Block;
+class StreamOutput;
 
 class Conveyor : public Module
 {
@@ -29,6 +31,8 @@ public:
     void on_block_end(void *);
     void on_halt(void *);
     void on_config_reload(void *);
+    void on_gcode_received(void *);
+    void on_get_public_data(void *);
 
     void notify_block_finished(Block *);
 
@@ -39,24 +43,51 @@ public:
     void ensure_running(void);
 
     void append_gcode(Gcode *);
+    Block *next_block(const Block *);
     void queue_head_block(void);
+    // the mix of a mixing extruder, every block queued from now on gets it
+    void set_extruder_mix(const float *mix, int channels);
 
     void dump_queue(void);
     void flush_queue(void);
     bool is_flushing() const { return flush; }
 
+    void report_stats(StreamOutput *stream);
+    void reset_stats();
+
+    // in a dry run blocks are planned as usual but never stepped, nor are their gcodes executed
+    // a block is handed to done instead of being run, when the queue is full or is being emptied
+    typedef void (*dry_run_done_t)(void *object, Block *block);
+    void start_dry_run(dry_run_done_t done, void *object);
+    void stop_dry_run();
+    bool is_dry_run() const { return dry_run_done != nullptr; }
+    uint32_t get_dry_run_queued() const { return dry_run_queued; }
+
     friend class Planner; // for queue
 
 private:
     typedef HeapRing<Block> Queue_t;
 
+    unsigned int depth() const { return (queue.head_i + queue.length - gc_pending) % queue.length; }
+    inline void block_starting(Block *);
+    void dry_run_tail();
+
     Queue_t queue;  // Queue of Blocks
     volatile unsigned int gc_pending;
 
+    struct pad_queue_stats stats;
+
+    dry_run_done_t dry_run_done;
+    void *dry_run_object;
+    uint32_t dry_run_queued; // blocks queued since the dry run started
+
+    float extruder_mix[Block::max_followers];
+
     struct {
         volatile bool running:1;
         volatile bool flush:1;
         volatile bool halted:1;
+        volatile bool ran_dry:1;
     };
 
 };
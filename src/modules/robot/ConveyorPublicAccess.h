@@ -0,0 +1,24 @@
+#ifndef __CONVEYORPUBLICACCESS_H_
+#define __CONVEYORPUBLICACCESS_H_
+
+#include <stdint.h>
+
+// addresses used for public data access
+#define conveyor_checksum                      CHECKSUM("conveyor")
+#define queue_stats_checksum                   CHECKSUM("queue_stats")
+
+#define QUEUE_DEPTH_BUCKETS 8
+
+// queue telemetry since the last reset ( M409 R or queue -r )
+struct pad_queue_stats {
+    uint32_t depth_histogram[QUEUE_DEPTH_BUCKETS]; // blocks that started with the queue 0-1/8 full, 1/8-2/8 full ...
+    uint32_t blocks;                               // blocks started
+    uint32_t dry_count;                            // times the queue ran dry
+    uint32_t starved_count;                        // times it ran dry while a file was playing
+    uint64_t total_wait_us;                        // time the blocks waited in the queue before starting
+    uint32_t max_wait_us;
+    uint16_t queue_size;
+    uint16_t depth;                                // blocks in the queue now
+};
+
+#endif
@@ -23,6 +23,7 @@ using namespace std;
 #include "Robot.h"
 #include "Stepper.h"
 #include "ConfigValue.h"
+#include "Profiler.h"
 
 #include <math.h>
 
@@ -182,6 +183,8 @@ void Planner::append_block( float actuator_pos[], float rate_mm_s, float distanc
 }
 
 void Planner::recalculate() {
+    PROFILE_SCOPE(PROFILE_PLANNER_RECALCULATE);
+
     Conveyor::Queue_t &queue = THEKERNEL->conveyor->queue;
 
     unsigned int block_index;
@@ -23,6 +23,8 @@ using std::string;
 #include "Gcode.h"
 #include "PublicDataRequest.h"
 #include "RobotPublicAccess.h"
+#include "PublicData.h"
+#include "ExtruderPublicAccess.h"
 #include "arm_solutions/BaseSolution.h"
 #include "arm_solutions/CartesianSolution.h"
 #include "arm_solutions/RotatableCartesianSolution.h"
@@ -36,6 +38,7 @@ using std::string;
 #include "ConfigValue.h"
 #include "libs/StreamOutput.h"
 #include "StreamOutputPool.h"
+#include "libs/Scheduler.h"
 
 #define  default_seek_rate_checksum          CHECKSUM("default_seek_rate")
 #define  default_feed_rate_checksum          CHECKSUM("default_feed_rate")
@@ -43,6 +46,9 @@ using std::string;
 #define  delta_segments_per_second_checksum  CHECKSUM("delta_segments_per_second")
 #define  mm_per_arc_segment_checksum         CHECKSUM("mm_per_arc_segment")
 #define  arc_correction_checksum             CHECKSUM("arc_correction")
+#define  path_blending_tolerance_checksum    CHECKSUM("path_blending_tolerance")
+#define  coalesce_tolerance_checksum         CHECKSUM("coalesce_tolerance")
+#define  coalesce_max_angle_checksum         CHECKSUM("coalesce_max_angle")
 #define  x_axis_max_speed_checksum           CHECKSUM("x_axis_max_speed")
 #define  y_axis_max_speed_checksum           CHECKSUM("y_axis_max_speed")
 #define  z_axis_max_speed_checksum           CHECKSUM("z_axis_max_speed")
@@ -116,6 +122,11 @@ using std::string;
 #define SPINDLE_DIRECTION_CW 0
 #define SPINDLE_DIRECTION_CCW 1
 
+static float point_distance(const float *a, const float *b)
+{
+    return sqrtf(powf(b[X_AXIS] - a[X_AXIS], 2) + powf(b[Y_AXIS] - a[Y_AXIS], 2) + powf(b[Z_AXIS] - a[Z_AXIS], 2));
+}
+
 // The Robot converts GCodes into actual movements, and then adds them to the Planner, which passes them to the Conveyor so they can be added to the queue
 // It takes care of cutting arcs into segments, same thing for line that are too long
 
@@ -126,12 +137,18 @@ Robot::Robot()
     this->motion_mode =  MOTION_MODE_SEEK;
     this->select_plane(X_AXIS, Y_AXIS, Z_AXIS);
     clear_vector(this->last_milestone);
+    clear_vector(this->last_milestone_nm);
     clear_vector(this->transformed_last_milestone);
     this->arm_solution = NULL;
     seconds_per_minute = 60.0F;
     this->clearToolOffset();
     this->compensationTransform= nullptr;
     this->halted= false;
+    this->blend_pending= false;
+    this->blend_gcode= nullptr;
+    this->blend_tail_count= 0;
+    this->path_tolerance= 0.0F;
+    this->coalesce_tolerance= 0.0F;
 }
 
 //Called when the module has just been loaded
@@ -141,6 +158,7 @@ void Robot::on_module_loaded()
     this->register_for_event(ON_GET_PUBLIC_DATA);
     this->register_for_event(ON_SET_PUBLIC_DATA);
     this->register_for_event(ON_HALT);
+    THEKERNEL->scheduler->add_task("robot", [](void *robot) { static_cast<Robot *>(robot)->on_main_loop(nullptr); }, this, Scheduler::HIGH_PRIORITY);
 
     // Configuration
     this->on_config_reload(this);
@@ -186,6 +204,12 @@ void Robot::on_config_reload(void *argument)
     this->delta_segments_per_second = THEKERNEL->config->value(delta_segments_per_second_checksum )->by_default(0.0f   )->as_number();
     this->mm_per_arc_segment  = THEKERNEL->config->value(mm_per_arc_segment_checksum  )->by_default(    0.5f)->as_number();
     this->arc_correction      = THEKERNEL->config->value(arc_correction_checksum      )->by_default(    5   )->as_number();
+    // if set corners are blended from boot, as if G64 P<path_blending_tolerance> was sent, 0 is exact path
+    this->default_path_tolerance = THEKERNEL->config->value(path_blending_tolerance_checksum)->by_default(0.0F)->as_number();
+    this->path_tolerance      = this->default_path_tolerance;
+    // merge runs of nearly collinear G1s whose corners are within coalesce_tolerance mm of the merged line, 0 disables it
+    this->coalesce_tolerance  = THEKERNEL->config->value(coalesce_tolerance_checksum  )->by_default(    0.0F)->as_number();
+    this->coalesce_cos_angle  = cosf(THEKERNEL->config->value(coalesce_max_angle_checksum)->by_default(5.0F)->as_number() * (float)M_PI / 180.0F);
 
     this->max_speeds[X_AXIS]  = THEKERNEL->config->value(x_axis_max_speed_checksum    )->by_default(60000.0F)->as_number() / 60.0F;
     this->max_speeds[Y_AXIS]  = THEKERNEL->config->value(y_axis_max_speed_checksum    )->by_default(60000.0F)->as_number() / 60.0F;
@@ -274,6 +298,20 @@ void Robot::check_max_actuator_speeds()
 void Robot::on_halt(void *arg)
 {
     halted= (arg == nullptr);
+    if(halted) {
+        clear_blend();
+        clear_coalesced();
+        // the held back end of the path is dropped, so the robot is where the last queued move ends
+        sync_milestone_nm();
+    }
+}
+
+// once the queue has run dry nothing else is coming soon, so queue the end of the path we were holding back
+void Robot::on_main_loop(void *argument)
+{
+    if(is_holding_path() && THEKERNEL->conveyor->is_queue_empty()) {
+        flush_held_path();
+    }
 }
 
 void Robot::on_get_public_data(void *argument)
@@ -290,9 +328,9 @@ void Robot::on_get_public_data(void *argument)
 
     } else if(pdr->second_element_is(current_position_checksum)) {
         static float return_data[3];
-        return_data[0] = from_millimeters(this->last_milestone[0]);
-        return_data[1] = from_millimeters(this->last_milestone[1]);
-        return_data[2] = from_millimeters(this->last_milestone[2]);
+        get_axis_position(return_data);
+        for (int i = X_AXIS; i <= Z_AXIS; i++)
+            return_data[i] = from_millimeters(return_data[i]);
 
         pdr->set_data_ptr(&return_data);
         pdr->set_taken();
@@ -315,14 +353,12 @@ void Robot::on_set_public_data(void *argument)
         pdr->set_taken();
     } else if(pdr->second_element_is(current_position_checksum)) {
         float *t = static_cast<float *>(pdr->get_data_ptr());
+        flush_held_path();
         for (int i = 0; i < 3; i++) {
-            this->last_milestone[i] = this->to_millimeters(t[i]);
+            this->last_milestone_nm[i] = mm_to_nm(this->to_millimeters(t[i]));
         }
 
-        float actuator_pos[3];
-        arm_solution->cartesian_to_actuator(last_milestone, actuator_pos);
-        for (int i = 0; i < 3; i++)
-            actuators[i]->change_last_milestone(actuator_pos[i]);
+        update_last_milestone();
 
         pdr->set_taken();
     }
@@ -336,6 +372,12 @@ void Robot::on_gcode_received(void *argument)
 
     this->motion_mode = -1;
 
+    // anything but another G1 that may continue it must happen at the end of the path that is being held back
+    if(is_holding_path() && !(gcode->has_g && gcode->g == 1 &&
+                              (gcode->has_letter('X') || gcode->has_letter('Y') || gcode->has_letter('Z')))) {
+        flush_held_path();
+    }
+
     //G-letter Gcodes are mostly what the Robot module is interrested in, other modules also catch the gcode event and do stuff accordingly
     if( gcode->has_g) {
         switch( gcode->g ) {
@@ -368,6 +410,16 @@ void Robot::on_gcode_received(void *argument)
             case 19: this->select_plane(Y_AXIS, Z_AXIS, X_AXIS); gcode->mark_as_taken();  break;
             case 20: this->inch_mode = true; gcode->mark_as_taken();  break;
             case 21: this->inch_mode = false; gcode->mark_as_taken();  break;
+            case 61: this->path_tolerance = 0.0F; gcode->mark_as_taken(); break; // exact path
+            case 64: // G64 Pnnn blend corners, keeping within nnn of the programmed path
+                if(gcode->has_letter('P')) {
+                    this->path_tolerance = this->to_millimeters(gcode->get_value('P'));
+                    if(this->path_tolerance < 0.0F) this->path_tolerance = 0.0F;
+                } else {
+                    this->path_tolerance = this->default_path_tolerance > 0.0F ? this->default_path_tolerance : 0.02F;
+                }
+                gcode->mark_as_taken();
+                break;
             case 90: this->absolute_mode = true; gcode->mark_as_taken();  break;
             case 91: this->absolute_mode = false; gcode->mark_as_taken();  break;
             case 92: {
@@ -408,10 +460,12 @@ void Robot::on_gcode_received(void *argument)
 
             case 114: {
                 char buf[64];
+                float pos[3];
+                get_axis_position(pos);
                 int n = snprintf(buf, sizeof(buf), "C: X:%1.3f Y:%1.3f Z:%1.3f A:%1.3f B:%1.3f C:%1.3f ",
-                                 from_millimeters(this->last_milestone[0]),
-                                 from_millimeters(this->last_milestone[1]),
-                                 from_millimeters(this->last_milestone[2]),
+                                 from_millimeters(pos[0]),
+                                 from_millimeters(pos[1]),
+                                 from_millimeters(pos[2]),
                                  actuators[X_AXIS]->get_current_position(),
                                  actuators[Y_AXIS]->get_current_position(),
                                  actuators[Z_AXIS]->get_current_position() );
@@ -583,6 +637,12 @@ void Robot::on_gcode_received(void *argument)
 
                 break;
             }
+
+            case 667: // M667 report the error map of the arm solution lookup table, if it has one
+                gcode->mark_as_taken();
+                if(!arm_solution->report_table(gcode->stream))
+                    gcode->stream->printf("arm solution has no lookup table\n");
+                break;
         }
     }
 
@@ -591,20 +651,25 @@ void Robot::on_gcode_received(void *argument)
 
     //Get parameters
     float target[3], offset[3];
+    int64_t target_nm[3];
     clear_vector(offset);
 
-    memcpy(target, this->last_milestone, sizeof(target));    //default to last target
+    memcpy(target_nm, this->last_milestone_nm, sizeof(target_nm));    //default to last target
 
     for(char letter = 'I'; letter <= 'K'; letter++) {
         if( gcode->has_letter(letter) ) {
             offset[letter - 'I'] = this->to_millimeters(gcode->get_value(letter));
         }
     }
+    // targets are worked out in integer nanometers so relative moves do not accumulate rounding errors
     for(char letter = 'X'; letter <= 'Z'; letter++) {
         if( gcode->has_letter(letter) ) {
-            target[letter - 'X'] = this->to_millimeters(gcode->get_value(letter)) + (this->absolute_mode ? this->toolOffset[letter - 'X'] : target[letter - 'X']);
+            int64_t v = mm_to_nm(this->to_millimeters(gcode->get_value(letter)));
+            target_nm[letter - 'X'] = v + (this->absolute_mode ? mm_to_nm(this->toolOffset[letter - 'X']) : target_nm[letter - 'X']);
         }
     }
+    for (int i = X_AXIS; i <= Z_AXIS; i++)
+        target[i] = nm_to_mm(target_nm[i]);
 
     if( gcode->has_letter('F') ) {
         if( this->motion_mode == MOTION_MODE_SEEK )
@@ -614,16 +679,22 @@ void Robot::on_gcode_received(void *argument)
     }
 
     //Perform any physical actions
+    bool moved = false;
     switch(this->motion_mode) {
         case MOTION_MODE_CANCEL: break;
-        case MOTION_MODE_SEEK  : this->append_line(gcode, target, this->seek_rate / seconds_per_minute ); break;
-        case MOTION_MODE_LINEAR: this->append_line(gcode, target, this->feed_rate / seconds_per_minute ); break;
+        case MOTION_MODE_SEEK  : moved = this->append_line(gcode, target, this->seek_rate / seconds_per_minute ); break;
+        case MOTION_MODE_LINEAR: moved = this->append_line(gcode, target, this->feed_rate / seconds_per_minute ); break;
         case MOTION_MODE_CW_ARC:
-        case MOTION_MODE_CCW_ARC: this->compute_arc(gcode, offset, target ); break;
+        case MOTION_MODE_CCW_ARC: moved = this->compute_arc(gcode, offset, target ); break;
     }
 
-    // last_milestone was set to target in append_milestone, no need to do it again
-
+    if(moved) {
+        // last_milestone was set to target in append_milestone, keep the exact integer position it came from
+        memcpy(this->last_milestone_nm, target_nm, sizeof(this->last_milestone_nm));
+    } else if(halted) {
+        // a halt stopped the segments of a line or an arc part way, last_milestone is the end of the last one queued
+        sync_milestone_nm();
+    }
 }
 
 // We received a new gcode, and one of the functions
@@ -638,45 +709,86 @@ void Robot::distance_in_gcode_is_known(Gcode *gcode)
 // reset the position for all axis (used in homing for delta as last_milestone may be bogus)
 void Robot::reset_axis_position(float x, float y, float z)
 {
-    this->last_milestone[X_AXIS] = x;
-    this->last_milestone[Y_AXIS] = y;
-    this->last_milestone[Z_AXIS] = z;
+    flush_held_path();
+    this->last_milestone_nm[X_AXIS] = mm_to_nm(x);
+    this->last_milestone_nm[Y_AXIS] = mm_to_nm(y);
+    this->last_milestone_nm[Z_AXIS] = mm_to_nm(z);
     this->transformed_last_milestone[X_AXIS] = x;
     this->transformed_last_milestone[Y_AXIS] = y;
     this->transformed_last_milestone[Z_AXIS] = z;
 
-    float actuator_pos[3];
-    arm_solution->cartesian_to_actuator(this->last_milestone, actuator_pos);
-    for (int i = 0; i < 3; i++)
-        actuators[i]->change_last_milestone(actuator_pos[i]);
+    update_last_milestone();
 }
 
 // Reset the position for an axis (used in homing and G92)
 void Robot::reset_axis_position(float position, int axis)
 {
-    this->last_milestone[axis] = position;
+    flush_held_path();
+    this->last_milestone_nm[axis] = mm_to_nm(position);
     this->transformed_last_milestone[axis] = position;
 
-    float actuator_pos[3];
-    arm_solution->cartesian_to_actuator(this->last_milestone, actuator_pos);
+    update_last_milestone();
+}
 
-    for (int i = 0; i < 3; i++)
-        actuators[i]->change_last_milestone(actuator_pos[i]);
+// Move the integer position to last_milestone, for when the path stops short of the target it was computed from
+void Robot::sync_milestone_nm()
+{
+    for (int i = X_AXIS; i <= Z_AXIS; i++)
+        this->last_milestone_nm[i] = mm_to_nm(this->last_milestone[i]);
 }
 
 // Use FK to find out where actuator is and reset lastmilestone to match
 void Robot::reset_position_from_current_actuator_position()
 {
+    flush_held_path();
     float actuator_pos[]= {actuators[X_AXIS]->get_current_position(), actuators[Y_AXIS]->get_current_position(), actuators[Z_AXIS]->get_current_position()};
-    arm_solution->actuator_to_cartesian(actuator_pos, this->last_milestone);
-    memcpy(this->transformed_last_milestone, this->last_milestone, sizeof(this->transformed_last_milestone));
+    float pos[3];
+    arm_solution->actuator_to_cartesian(actuator_pos, pos);
+    for (int i = X_AXIS; i <= Z_AXIS; i++)
+        this->last_milestone_nm[i] = mm_to_nm(pos[i]);
 
     // now reset actuator correctly, NOTE this may lose a little precision
+    update_last_milestone();
+    memcpy(this->transformed_last_milestone, this->last_milestone, sizeof(this->transformed_last_milestone));
+}
+
+// Refresh the float last_milestone from the integer one, and set the actuators to match
+void Robot::update_last_milestone()
+{
+    for (int i = X_AXIS; i <= Z_AXIS; i++)
+        this->last_milestone[i] = nm_to_mm(this->last_milestone_nm[i]);
+
+    float actuator_pos[3];
     arm_solution->cartesian_to_actuator(this->last_milestone, actuator_pos);
     for (int i = 0; i < 3; i++)
         actuators[i]->change_last_milestone(actuator_pos[i]);
 }
 
+// The commanded position, the end of the path may still be held back to be blended or merged with the next move
+void Robot::get_axis_position(float position[])
+{
+    for (int i = X_AXIS; i <= Z_AXIS; i++)
+        position[i] = nm_to_mm(this->last_milestone_nm[i]);
+}
+
+// Find where the tool is right now, even in the middle of a move, from the actuator step counters using FK
+void Robot::get_current_machine_position(float position[])
+{
+    int32_t steps[3];
+
+    // read all the counters without a step tick in between so they are from the same instant
+    __disable_irq();
+    for (int i = 0; i < 3; i++)
+        steps[i] = actuators[i]->current_position_steps;
+    __enable_irq();
+
+    float actuator_pos[3];
+    for (int i = 0; i < 3; i++)
+        actuator_pos[i] = steps[i] / actuators[i]->get_steps_per_mm();
+
+    arm_solution->actuator_to_cartesian(actuator_pos, position);
+}
+
 // Convert target from millimeters to steps, and append this to the planner
 void Robot::append_milestone( float target[], float rate_mm_s )
 {
@@ -738,20 +850,31 @@ void Robot::append_milestone( float target[], float rate_mm_s )
 
 }
 
-// Append a move to the queue ( cutting it into segments if needed )
-void Robot::append_line(Gcode *gcode, float target[], float rate_mm_s )
+// Append a move to the queue ( cutting it into segments if needed ), returns true if the move was queued all the way to target
+bool Robot::append_line(Gcode *gcode, float target[], float rate_mm_s )
 {
+    // when blending the previous line may not be queued all the way yet, this line still starts where it ended
+    const float *start = this->blend_pending ? this->blend_corner : (!this->coalesce_gcodes.empty() ? this->coalesce_end : this->last_milestone);
+
     // Find out the distance for this gcode
     // NOTE we need to do sqrt here as this setting of millimeters_of_travel is used by extruder and other modules even if there is no XYZ move
-    gcode->millimeters_of_travel = sqrtf(powf( target[X_AXIS] - this->last_milestone[X_AXIS], 2 ) +  powf( target[Y_AXIS] - this->last_milestone[Y_AXIS], 2 ) +  powf( target[Z_AXIS] - this->last_milestone[Z_AXIS], 2 ));
+    gcode->millimeters_of_travel = sqrtf(powf( target[X_AXIS] - start[X_AXIS], 2 ) +  powf( target[Y_AXIS] - start[Y_AXIS], 2 ) +  powf( target[Z_AXIS] - start[Z_AXIS], 2 ));
 
     // We ignore non- XYZ moves ( for example, extruder moves are not XYZ moves )
     if( gcode->millimeters_of_travel < 0.00001F ) {
-        return;
+        return false;
     }
 
-    // Mark the gcode as having a known distance
-    this->distance_in_gcode_is_known( gcode );
+    // do not go faster than the extruder can follow, or than the hotend can melt plastic
+    if(gcode->has_letter('E')) {
+        pad_extruder_follow pef;
+        pef.gcode = gcode;
+        pef.millimeters = gcode->millimeters_of_travel;
+        pef.max_speed = rate_mm_s;
+        if(PublicData::set_value(extruder_checksum, follow_speed_limit_checksum, &pef)) {
+            rate_mm_s = pef.max_speed;
+        }
+    }
 
     // We cut the line into smaller segments. This is not usefull in a cartesian robot, but necessary for robots with rotational axes.
     // In cartesian robot, a high "mm_per_line_segment" setting will prevent waste.
@@ -776,21 +899,41 @@ void Robot::append_line(Gcode *gcode, float target[], float rate_mm_s )
         }
     }
 
+    // corners are only blended between unsegmented feed moves
+    if(this->path_tolerance > 0.0F && segments == 1 && this->motion_mode == MOTION_MODE_LINEAR) {
+        return append_blended_line(gcode, target, rate_mm_s);
+    }
+
+    // on the exact path, runs of nearly collinear unsegmented feed moves are merged
+    if(this->path_tolerance == 0.0F && this->coalesce_tolerance > 0.0F && segments == 1 && this->motion_mode == MOTION_MODE_LINEAR) {
+        return append_coalesced_line(gcode, target, rate_mm_s);
+    }
+
+    // anything else starts from the real end of the path
+    flush_held_path();
+
+    // Mark the gcode as having a known distance
+    this->distance_in_gcode_is_known( gcode );
+
     if (segments > 1) {
         // A vector to keep track of the endpoint of each segment
+        float segment_start[3];
         float segment_delta[3];
         float segment_end[3];
 
         // How far do we move each segment?
-        for (int i = X_AXIS; i <= Z_AXIS; i++)
+        for (int i = X_AXIS; i <= Z_AXIS; i++) {
+            segment_start[i] = last_milestone[i];
             segment_delta[i] = (target[i] - last_milestone[i]) / segments;
+        }
 
         // segment 0 is already done - it's the end point of the previous move so we start at segment 1
         // We always add another point after this loop so we stop at segments-1, ie i < segments
         for (int i = 1; i < segments; i++) {
-            if(halted) return; // don't queue any more segments
+            if(halted) return false; // don't queue any more segments
+            // work out each end point from the start so rounding errors do not add up over the segments
             for(int axis = X_AXIS; axis <= Z_AXIS; axis++ )
-                segment_end[axis] = last_milestone[axis] + segment_delta[axis];
+                segment_end[axis] = segment_start[axis] + segment_delta[axis] * i;
 
             // Append the end of this segment to the queue
             this->append_milestone(segment_end, rate_mm_s);
@@ -802,11 +945,281 @@ void Robot::append_line(Gcode *gcode, float target[], float rate_mm_s )
 
     // if adding these blocks didn't start executing, do that now
     THEKERNEL->conveyor->ensure_running();
+
+    return true;
+}
+
+
+// Append a line with its start corner rounded off, the corner is a quadratic bezier that stays within path_tolerance of it.
+// The end of the line is held back in blend_corner until the next move shows which way the path turns there.
+// Each gcode is attached once its part of the path is known, from the middle of its start corner to the middle of its
+// end corner, so what follows the robot's travel, like an extruder, spreads what it asked for over that part.
+bool Robot::append_blended_line(Gcode *gcode, float target[], float rate_mm_s)
+{
+    if(halted) return false;
+
+    // where the path held back so far ends, the corner into the held line may not be queued yet
+    const float *from = this->blend_tail_count > 0 ? this->blend_tail[this->blend_tail_count - 1] : this->last_milestone;
+
+    float u1[3], u2[3];
+    float l1 = 0.0F, l2 = 0.0F;
+    if(this->blend_pending) {
+        for (int i = X_AXIS; i <= Z_AXIS; i++) {
+            u1[i] = this->blend_corner[i] - from[i];
+            u2[i] = target[i] - this->blend_corner[i];
+            l1 += u1[i] * u1[i];
+            l2 += u2[i] * u2[i];
+        }
+        l1 = sqrtf(l1);
+        l2 = sqrtf(l2);
+    }
+
+    float cos_theta = -1.0F;
+    if(l1 > 0.00001F && l2 > 0.00001F) {
+        for (int i = X_AXIS; i <= Z_AXIS; i++) {
+            u1[i] /= l1;
+            u2[i] /= l2;
+        }
+        cos_theta = u1[X_AXIS] * u2[X_AXIS] + u1[Y_AXIS] * u2[Y_AXIS] + u1[Z_AXIS] * u2[Z_AXIS];
+    }
+
+    if(cos_theta < -0.95F || cos_theta > 0.99999F) {
+        // nothing held back, a reversal, or straight on, there is no corner worth rounding
+        flush_blend();
+
+    } else {
+        // the bezier from A to B with its control point on the corner comes within L*sin(theta/2)/2 of it,
+        // L is capped so it never uses more than what is left of the previous line, or half of this one
+        float sin_half = sqrtf(0.5F * (1.0F - cos_theta));
+        float L = min(2.0F * this->path_tolerance / sin_half, min(l1, l2 * 0.5F));
+
+        // more chords for sharper corners so each chord junction stays gentle, always an even count so the middle is a chord end
+        int n = cos_theta > 0.7071F ? 2 : (cos_theta > -0.5F ? 4 : max_blend_chords);
+
+        float a[3], b[3];
+        float points[max_blend_chords][3];
+        for (int i = X_AXIS; i <= Z_AXIS; i++) {
+            a[i] = this->blend_corner[i] - L * u1[i];
+            b[i] = this->blend_corner[i] + L * u2[i];
+        }
+        for (int j = 1; j <= n; j++) {
+            float t = (float)j / n;
+            for (int i = X_AXIS; i <= Z_AXIS; i++)
+                points[j - 1][i] = (1.0F - t) * (1.0F - t) * a[i] + 2.0F * t * (1.0F - t) * this->blend_corner[i] + t * t * b[i];
+        }
+
+        // the held line's part of the path: the rest of its start corner, the rest of the line, the first half of this corner
+        bool straight = (l1 - L > 0.00001F);
+        const float *prev = from;
+        float span = held_tail_length();
+        if(straight) {
+            span += point_distance(prev, a);
+            prev = a;
+        }
+        for (int j = 0; j < n / 2; j++) {
+            span += point_distance(prev, points[j]);
+            prev = points[j];
+        }
+
+        if(!queue_held_tail(span)) return false;
+        if(straight)
+            this->append_milestone(a, this->blend_rate);
+        for (int j = 0; j < n / 2; j++) {
+            if(halted) return false;
+            this->append_milestone(points[j], this->blend_rate);
+        }
+
+        // the second half of this corner is this line's, it is held until the rest of its part is known
+        for (int j = n / 2; j < n; j++)
+            memcpy(this->blend_tail[j - n / 2], points[j], sizeof(this->blend_tail[0]));
+        this->blend_tail_count = n - n / 2;
+    }
+    if(halted) return false;
+
+    // the gcode is attached when its part of the path is queued
+    gcode->mark_as_taken();
+    this->blend_gcode = new Gcode(*gcode);
+    memcpy(this->blend_corner, target, sizeof(this->blend_corner));
+    this->blend_rate = rate_mm_s;
+    this->blend_pending = true;
+
+    // if adding these blocks didn't start executing, do that now
+    THEKERNEL->conveyor->ensure_running();
+
+    return true;
 }
 
+// Add a line to the run of merged moves, or queue the run and start a new one with this line if it does not fit.
+// The merged line goes from the start of the run to the end of this line.
+bool Robot::append_coalesced_line(Gcode *gcode, float target[], float rate_mm_s)
+{
+    if(halted) return false;
+
+    bool extrudes = gcode->has_letter('E');
+    float dir[3];
+    float len = 0.0F;
+    const float *from = this->coalesce_gcodes.empty() ? this->last_milestone : this->coalesce_end;
+    for (int i = X_AXIS; i <= Z_AXIS; i++) {
+        dir[i] = target[i] - from[i];
+        len += dir[i] * dir[i];
+    }
+    len = sqrtf(len);
+    for (int i = X_AXIS; i <= Z_AXIS; i++)
+        dir[i] /= len;
+
+    if(!this->coalesce_gcodes.empty()) {
+        // the moves must look alike so one block can stand in for them
+        bool fits = this->coalesce_gcodes.size() < max_coalesced_moves && rate_mm_s == this->coalesce_rate && extrudes == this->coalesce_extrudes &&
+                    (dir[X_AXIS] * this->coalesce_dir[X_AXIS] + dir[Y_AXIS] * this->coalesce_dir[Y_AXIS] + dir[Z_AXIS] * this->coalesce_dir[Z_AXIS]) >= this->coalesce_cos_angle;
+
+        if(fits) {
+            // every corner that would be removed, including the one this move adds, must be close to the merged line
+            float chord[3];
+            float chord_len = 0.0F;
+            for (int i = X_AXIS; i <= Z_AXIS; i++) {
+                chord[i] = target[i] - this->last_milestone[i];
+                chord_len += chord[i] * chord[i];
+            }
+            chord_len = sqrtf(chord_len);
+            for (int i = X_AXIS; i <= Z_AXIS; i++)
+                chord[i] /= chord_len;
+
+            int corners = this->coalesce_gcodes.size() - 1;
+            for (int c = 0; c <= corners && fits; c++) {
+                const float *p = (c < corners) ? this->coalesce_corners[c] : this->coalesce_end;
+                float v[3], along = 0.0F, dist = 0.0F;
+                for (int i = X_AXIS; i <= Z_AXIS; i++) {
+                    v[i] = p[i] - this->last_milestone[i];
+                    along += v[i] * chord[i];
+                }
+                for (int i = X_AXIS; i <= Z_AXIS; i++)
+                    dist += powf(v[i] - along * chord[i], 2);
+                fits = dist <= this->coalesce_tolerance * this->coalesce_tolerance;
+            }
+        }
+
+        if(fits) {
+            memcpy(this->coalesce_corners[this->coalesce_gcodes.size() - 1], this->coalesce_end, sizeof(this->coalesce_end));
+        } else {
+            flush_coalesced();
+        }
+    }
+
+    // the gcode is attached when the merged block is queued
+    gcode->mark_as_taken();
+    this->coalesce_gcodes.push_back(new Gcode(*gcode));
+    memcpy(this->coalesce_end, target, sizeof(this->coalesce_end));
+    memcpy(this->coalesce_dir, dir, sizeof(this->coalesce_dir));
+    this->coalesce_rate = rate_mm_s;
+    this->coalesce_extrudes = extrudes;
 
-// Append an arc to the queue ( cutting it into segments as needed )
-void Robot::append_arc(Gcode *gcode, float target[], float offset[], float radius, bool is_clockwise )
+    return true;
+}
+
+// queue the merged run as one block, with all its gcodes attached in order
+void Robot::flush_coalesced()
+{
+    if(this->coalesce_gcodes.empty()) return;
+
+    // the merged line is a little shorter than the moves it replaces, scale their lengths so anything
+    // following the robot's travel, like an extruder, still gets exactly what each gcode asked for
+    float sum = 0.0F;
+    for (auto g : this->coalesce_gcodes)
+        sum += g->millimeters_of_travel;
+    float chord = sqrtf(powf(this->coalesce_end[X_AXIS] - this->last_milestone[X_AXIS], 2) + powf(this->coalesce_end[Y_AXIS] - this->last_milestone[Y_AXIS], 2) + powf(this->coalesce_end[Z_AXIS] - this->last_milestone[Z_AXIS], 2));
+    for (auto g : this->coalesce_gcodes) {
+        if(sum > 0.0F) g->millimeters_of_travel *= chord / sum;
+        this->distance_in_gcode_is_known(g);
+    }
+
+    float end[3];
+    memcpy(end, this->coalesce_end, sizeof(end));
+    float rate = this->coalesce_rate;
+    clear_coalesced();
+
+    this->append_milestone(end, rate);
+    THEKERNEL->conveyor->ensure_running();
+}
+
+void Robot::clear_coalesced()
+{
+    for (auto g : this->coalesce_gcodes)
+        delete g;
+    this->coalesce_gcodes.clear();
+}
+
+// queue whatever part of the path is being held back, it ends in the current coordinates so this must be done
+// before they are reset, on a halt it is discarded instead and there is nothing left to queue
+void Robot::flush_held_path()
+{
+    flush_coalesced();
+    flush_blend();
+}
+
+// queue the end of the path held back for blending
+void Robot::flush_blend()
+{
+    if(!this->blend_pending) return;
+    this->blend_pending = false;
+
+    const float *from = this->blend_tail_count > 0 ? this->blend_tail[this->blend_tail_count - 1] : this->last_milestone;
+    float d = point_distance(from, this->blend_corner);
+    if(!queue_held_tail(held_tail_length() + (d < 0.00001F ? 0.0F : d))) return;
+
+    // the last corner may have used up all of the line
+    if(d < 0.00001F) {
+        memcpy(this->last_milestone, this->blend_corner, sizeof(this->last_milestone));
+        return;
+    }
+
+    this->append_milestone(this->blend_corner, this->blend_rate);
+    THEKERNEL->conveyor->ensure_running();
+}
+
+// length of the held back second half of the corner into the held line
+float Robot::held_tail_length() const
+{
+    float length = 0.0F;
+    const float *prev = this->last_milestone;
+    for (int j = 0; j < this->blend_tail_count; j++) {
+        length += point_distance(prev, this->blend_tail[j]);
+        prev = this->blend_tail[j];
+    }
+    return length;
+}
+
+// attach the held gcode, with span the length of the path it now covers, then queue the held back half corner.
+// returns false if a halt stopped it
+bool Robot::queue_held_tail(float span)
+{
+    Gcode *gcode = this->blend_gcode;
+    this->blend_gcode = nullptr;
+    int count = this->blend_tail_count;
+    this->blend_tail_count = 0;
+
+    if(gcode != nullptr) {
+        if(span > 0.00001F) gcode->millimeters_of_travel = span;
+        this->distance_in_gcode_is_known(gcode);
+        delete gcode;
+    }
+
+    for (int j = 0; j < count; j++) {
+        if(halted) return false;
+        this->append_milestone(this->blend_tail[j], this->blend_rate);
+    }
+    return !halted;
+}
+
+void Robot::clear_blend()
+{
+    this->blend_pending = false;
+    this->blend_tail_count = 0;
+    delete this->blend_gcode;
+    this->blend_gcode = nullptr;
+}
+
+// Append an arc to the queue ( cutting it into segments as needed ), returns true if the arc was queued all the way to target
+bool Robot::append_arc(Gcode *gcode, float target[], float offset[], float radius, bool is_clockwise )
 {
 
     // Scary math
@@ -832,7 +1245,7 @@ void Robot::append_arc(Gcode *gcode, float target[], float offset[], float radiu
 
     // We don't care about non-XYZ moves ( for example the extruder produces some of those )
     if( gcode->millimeters_of_travel < 0.00001F ) {
-        return;
+        return false;
     }
 
     // Mark the gcode as having a known distance
@@ -879,10 +1292,10 @@ void Robot::append_arc(Gcode *gcode, float target[], float offset[], float radiu
     int8_t count = 0;
 
     // Initialize the linear axis
-    arc_target[this->plane_axis_2] = this->last_milestone[this->plane_axis_2];
+    float linear_start = this->last_milestone[this->plane_axis_2];
 
     for (i = 1; i < segments; i++) { // Increment (segments-1)
-        if(halted) return; // don't queue any more segments
+        if(halted) return false; // don't queue any more segments
 
         if (count < this->arc_correction ) {
             // Apply vector rotation matrix
@@ -903,7 +1316,7 @@ void Robot::append_arc(Gcode *gcode, float target[], float offset[], float radiu
         // Update arc_target location
         arc_target[this->plane_axis_0] = center_axis0 + r_axis0;
         arc_target[this->plane_axis_1] = center_axis1 + r_axis1;
-        arc_target[this->plane_axis_2] += linear_per_segment;
+        arc_target[this->plane_axis_2] = linear_start + linear_per_segment * i;
 
         // Append this segment to the queue
         this->append_milestone(arc_target, this->feed_rate / seconds_per_minute);
@@ -912,10 +1325,12 @@ void Robot::append_arc(Gcode *gcode, float target[], float offset[], float radiu
 
     // Ensure last segment arrives at target location.
     this->append_milestone(target, this->feed_rate / seconds_per_minute);
+
+    return true;
 }
 
 // Do the math for an arc and add it to the queue
-void Robot::compute_arc(Gcode *gcode, float offset[], float target[])
+bool Robot::compute_arc(Gcode *gcode, float offset[], float target[])
 {
 
     // Find the radius
@@ -928,7 +1343,7 @@ void Robot::compute_arc(Gcode *gcode, float offset[], float target[])
     }
 
     // Append arc
-    this->append_arc(gcode, target, offset,  radius, is_clockwise );
+    return this->append_arc(gcode, target, offset,  radius, is_clockwise );
 
 }
 
@@ -13,6 +13,7 @@ using std::string;
 #include <string.h>
 #include <functional>
 #include <stack>
+#include <vector>
 
 #include "libs/Module.h"
 
@@ -28,12 +29,14 @@ class Robot : public Module {
         void on_gcode_received(void* argument);
         void on_get_public_data(void* argument);
         void on_set_public_data(void* argument);
+        void on_main_loop(void* argument);
         void on_halt(void *arg);
 
         void reset_axis_position(float position, int axis);
         void reset_axis_position(float x, float y, float z);
         void reset_position_from_current_actuator_position();
         void get_axis_position(float position[]);
+        void get_current_machine_position(float position[]);
         float to_millimeters(float value);
         float from_millimeters(float value);
         float get_seconds_per_minute() const { return seconds_per_minute; }
@@ -57,12 +60,24 @@ class Robot : public Module {
     private:
         void distance_in_gcode_is_known(Gcode* gcode);
         void append_milestone( float target[], float rate_mm_s);
-        void append_line( Gcode* gcode, float target[], float rate_mm_s);
+        bool append_line( Gcode* gcode, float target[], float rate_mm_s);
+        bool append_blended_line( Gcode* gcode, float target[], float rate_mm_s);
+        void flush_blend();
+        float held_tail_length() const;
+        bool queue_held_tail(float span);
+        void clear_blend();
+        bool append_coalesced_line( Gcode* gcode, float target[], float rate_mm_s);
+        void flush_coalesced();
+        void flush_held_path();
+        void clear_coalesced();
+        bool is_holding_path() const { return this->blend_pending || !this->coalesce_gcodes.empty(); }
         //void append_arc(float theta_start, float angular_travel, float radius, float depth, float rate);
-        void append_arc( Gcode* gcode, float target[], float offset[], float radius, bool is_clockwise );
+        bool append_arc( Gcode* gcode, float target[], float offset[], float radius, bool is_clockwise );
 
 
-        void compute_arc(Gcode* gcode, float offset[], float target[]);
+        bool compute_arc(Gcode* gcode, float offset[], float target[]);
+        void update_last_milestone();
+        void sync_milestone_nm();
 
         float theta(float x, float y);
         void select_plane(uint8_t axis_0, uint8_t axis_1, uint8_t axis_2);
@@ -72,6 +87,7 @@ class Robot : public Module {
         typedef std::tuple<float, float, bool> saved_state_t; // save current feedrate and absolute mode
         std::stack<saved_state_t> state_stack;               // saves state from M120
         float last_milestone[3];                             // Last position, in millimeters
+        int64_t last_milestone_nm[3];                        // Last position, in nanometers, what new targets are computed from
         float transformed_last_milestone[3];                 // Last transformed position
         int8_t motion_mode;                                  // Motion mode for the current received Gcode
         uint8_t plane_axis_0, plane_axis_1, plane_axis_2;    // Current plane ( XY, XZ, YZ )
@@ -80,6 +96,25 @@ class Robot : public Module {
         float mm_per_line_segment;                           // Setting : Used to split lines into segments
         float mm_per_arc_segment;                            // Setting : Used to split arcs into segmentrs
         float delta_segments_per_second;                     // Setting : Used to split lines into segments for delta based on speed
+        float path_tolerance;                                // G64 P, how far corners may be rounded off, 0 follows the exact path (G61)
+        float default_path_tolerance;                        // Setting : Used by G64 without P
+        float blend_corner[3];                               // End of the last G1, not queued yet as the corner needs the next move to be rounded
+        float blend_rate;                                    // Rate for the part of the path still to be queued
+        static const int max_blend_chords = 6;
+        Gcode *blend_gcode;                                  // copy of the held line's gcode, attached once its part of the path is known
+        float blend_tail[max_blend_chords / 2][3];           // second half of the corner into the held line, not queued yet
+        uint8_t blend_tail_count;
+
+        // consecutive nearly collinear G1s are merged into one block, the run is held back until a move does not fit it
+        static const int max_coalesced_moves = 8;
+        float coalesce_tolerance;                            // Setting : how far the merged line may pass from the corners it removes, 0 disables merging
+        float coalesce_cos_angle;                            // Setting : cosine of the largest direction change between merged moves
+        std::vector<Gcode*> coalesce_gcodes;                 // copies of the merged gcodes, attached to the block when it is queued
+        float coalesce_corners[max_coalesced_moves][3];      // the points between merged moves
+        float coalesce_end[3];                               // end of the merged run
+        float coalesce_dir[3];                               // direction of the last merged move
+        float coalesce_rate;
+        bool coalesce_extrudes;                              // merged moves either all have E or none do
         float seconds_per_minute;                            // for realtime speed change
 
         // Number of arc generation iterations by small angle approximation before exact arc trajectory
@@ -102,6 +137,7 @@ class Robot : public Module {
 
         struct {
             bool halted:1;
+            bool blend_pending:1;                             // blend_corner holds a path end still to be queued
         };
 };
 
@@ -112,8 +148,4 @@ inline float Robot::to_millimeters( float value ){
 inline float Robot::from_millimeters( float value){
     return this->inch_mode ? value/25.4 : value;
 }
-inline void Robot::get_axis_position(float position[]){
-    memcpy(position, this->last_milestone, sizeof(float)*3 );
-}
-
 #endif
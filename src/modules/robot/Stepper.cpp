@@ -38,6 +38,7 @@ Stepper::Stepper()
     this->paused = false;
     this->force_speed_update = false;
     this->halted= false;
+    this->rate_listener_count= 0;
 }
 
 //Called when the module has just been loaded
@@ -217,6 +218,11 @@ uint32_t Stepper::stepper_motor_finished_move(uint32_t dummy)
     if( THEKERNEL->robot->alpha_stepper_motor->moving || THEKERNEL->robot->beta_stepper_motor->moving || THEKERNEL->robot->gamma_stepper_motor->moving ) {
         return 0;
     }
+    if( this->current_block != NULL ) {
+        for (int i = 0; i < this->current_block->follower_count; i++) {
+            if(this->current_block->followers[i]->moving) return 0;
+        }
+    }
 
     // This block is finished, release it
     if( this->current_block != NULL ) {
@@ -227,6 +233,13 @@ uint32_t Stepper::stepper_motor_finished_move(uint32_t dummy)
 }
 
 
+inline void Stepper::call_rate_listeners(float steps_per_second)
+{
+    for (int i = 0; i < this->rate_listener_count; i++) {
+        this->rate_listeners[i].listener(this->rate_listeners[i].object, steps_per_second);
+    }
+}
+
 // This is called ACCELERATION_TICKS_PER_SECOND times per second by the step_event
 // interrupt. It can be assumed that the trapezoid-generator-parameters and the
 // current_block stays untouched by outside handlers for the duration of this function call.
@@ -252,8 +265,9 @@ void Stepper::trapezoid_generator_tick(void)
 
             } else if (trapezoid_adjusted_rate == current_block->rate_delta * 0.5F) {
                 for (auto i : THEKERNEL->robot->actuators) i->move(i->direction, 0); // stop motors
+                for (int i = 0; i < current_block->follower_count; i++) current_block->followers[i]->move(current_block->followers[i]->direction, 0);
                 if (current_block) current_block->release();
-                THEKERNEL->call_event(ON_SPEED_CHANGE, 0); // tell others we stopped
+                call_rate_listeners(0); // tell others we stopped
                 return;
 
             } else {
@@ -295,6 +309,26 @@ void Stepper::trapezoid_generator_tick(void)
     }
 }
 
+// Which part of the trapezoid the current block is in, 1 accelerating, -1 decelerating and 0 cruising or idle
+// uses the same tests as trapezoid_generator_tick so it agrees with what the last tick did
+int Stepper::get_trapezoid_phase() const
+{
+    if(this->current_block == nullptr || this->paused || !this->main_stepper->moving) return 0;
+    if(THEKERNEL->conveyor->is_flushing()) return -1;
+
+    uint32_t current_steps_completed = this->main_stepper->stepped;
+    if(current_steps_completed <= this->current_block->accelerate_until) return 1;
+    if(current_steps_completed > this->current_block->decelerate_after) return -1;
+    return 0;
+}
+
+// Steps the axis with the most steps has taken of the current block, the count the trapezoid runs on
+uint32_t Stepper::get_steps_completed() const
+{
+    if(this->current_block == nullptr || this->main_stepper == nullptr) return 0;
+    return this->main_stepper->stepped;
+}
+
 // Initializes the trapezoid generator from the current block. Called whenever a new
 // block begins.
 inline void Stepper::trapezoid_generator_reset()
@@ -318,9 +352,24 @@ void Stepper::set_step_events_per_second( float steps_per_second )
     if( THEKERNEL->robot->gamma_stepper_motor->moving ) {
         THEKERNEL->robot->gamma_stepper_motor->set_speed(isps * this->current_block->steps[GAMMA_STEPPER]);
     }
+    for (int i = 0; i < this->current_block->follower_count; i++) {
+        StepperMotor *m = this->current_block->followers[i];
+        if( m->moving ) m->set_speed(isps * m->steps_to_move);
+    }
 
     // Other modules might want to know the speed changed
-    THEKERNEL->call_event(ON_SPEED_CHANGE, this);
+    call_rate_listeners(steps_per_second);
+}
+
+// Add a function to be called with the new step rate, returns false if there is no room left
+// must be called from on_module_loaded or on_config_reload, before any block is executed
+bool Stepper::register_rate_listener(rate_listener_t listener, void *object)
+{
+    if(this->rate_listener_count >= max_rate_listeners) return false;
+    this->rate_listeners[this->rate_listener_count].listener= listener;
+    this->rate_listeners[this->rate_listener_count].object= object;
+    this->rate_listener_count++;
+    return true;
 }
 
 
@@ -38,12 +38,28 @@ public:
 
     float get_trapezoid_adjusted_rate() const { return trapezoid_adjusted_rate; }
     const Block *get_current_block() const { return current_block; }
+    int get_trapezoid_phase() const;
+    uint32_t get_steps_completed() const;
+
+    // Rate listeners are called from the acceleration tick interrupt every time the step rate changes,
+    // and with 0 when a flush stops the current block. They must be short and must not call into the kernel.
+    typedef void (*rate_listener_t)(void *object, float steps_per_second);
+    bool register_rate_listener(rate_listener_t listener, void *object);
 
 private:
+    inline void call_rate_listeners(float steps_per_second);
+
     Block *current_block;
     float trapezoid_adjusted_rate;
     StepperMotor *main_stepper;
 
+    static const int max_rate_listeners = 8;
+    struct {
+        rate_listener_t listener;
+        void *object;
+    } rate_listeners[max_rate_listeners];
+    uint8_t rate_listener_count;
+
     struct {
         bool enable_pins_status:1;
         bool force_speed_update:1;
@@ -4,6 +4,7 @@
 
 #include <map>
 class Config;
+class StreamOutput;
 
 class BaseSolution {
     public:
@@ -15,6 +16,7 @@ class BaseSolution {
         typedef std::map<char, float> arm_options_t;
         virtual bool set_optional(const arm_options_t& options) { return false; };
         virtual bool get_optional(arm_options_t& options) { return false; };
+        virtual bool report_table(StreamOutput* stream) { return false; };
 };
 
 #endif
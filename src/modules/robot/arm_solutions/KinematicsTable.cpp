@@ -0,0 +1,192 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "KinematicsTable.h"
+#include "checksumm.h"
+#include "ConfigValue.h"
+#include "libs/Kernel.h"
+#include "libs/Config.h"
+#include "libs/utils.h"
+#include "libs/nuts_bolts.h"
+#include "libs/StreamOutput.h"
+#include "StreamOutputPool.h"
+#include "platform_memory.h"
+
+#include <math.h>
+#include <vector>
+
+#define kinematics_table_enable_checksum      CHECKSUM("kinematics_table_enable")
+#define kinematics_table_min_checksum         CHECKSUM("kinematics_table_min")
+#define kinematics_table_max_checksum         CHECKSUM("kinematics_table_max")
+#define kinematics_table_divisions_checksum   CHECKSUM("kinematics_table_divisions")
+#define kinematics_table_max_span_checksum    CHECKSUM("kinematics_table_max_span")
+
+KinematicsTable::KinematicsTable()
+{
+    this->data = nullptr;
+    this->enabled = false;
+    this->outputs = 0;
+    this->max_span = 90.0F;
+    for (int a = 0; a < 3; a++) {
+        this->min[a] = 0.0F;
+        this->step[a] = 1.0F;
+        this->inv_step[a] = 1.0F;
+        this->nodes[a] = 1;
+    }
+}
+
+KinematicsTable::~KinematicsTable()
+{
+    clear();
+}
+
+void KinematicsTable::clear()
+{
+    if(this->data != nullptr) AHB0.dealloc(this->data);
+    this->data = nullptr;
+}
+
+// read the grid settings, outputs is how many actuators the table holds, use_z is false if the actuators do not depend on Z
+void KinematicsTable::configure(Config* config, uint8_t outputs, bool use_z)
+{
+    this->outputs = outputs;
+    this->enabled = config->value(kinematics_table_enable_checksum)->by_default(false)->as_bool();
+    if(!this->enabled) return;
+
+    std::vector<float> mn = parse_number_list(config->value(kinematics_table_min_checksum)->by_default("-100,-100,0")->as_string().c_str());
+    std::vector<float> mx = parse_number_list(config->value(kinematics_table_max_checksum)->by_default("100,100,100")->as_string().c_str());
+    std::vector<float> dv = parse_number_list(config->value(kinematics_table_divisions_checksum)->by_default("20,20,4")->as_string().c_str());
+    this->max_span = config->value(kinematics_table_max_span_checksum)->by_default(90.0F)->as_number();
+
+    if(mn.size() < 3 || mx.size() < 3 || dv.size() < 3) {
+        THEKERNEL->streams->printf("WARNING: kinematics_table settings need three values, table disabled\n");
+        this->enabled = false;
+        return;
+    }
+
+    for (int a = 0; a < 3; a++) {
+        int divisions = (a == Z_AXIS && !use_z) ? 0 : (int)dv[a];
+        // X and Y need at least one cell
+        if(a != Z_AXIS && divisions < 1) divisions = 1;
+        if(divisions < 0) divisions = 0;
+
+        this->nodes[a] = divisions + 1;
+        this->min[a] = mn[a];
+        this->step[a] = divisions > 0 ? (mx[a] - mn[a]) / divisions : 1.0F;
+        if(this->step[a] <= 0.0F) {
+            THEKERNEL->streams->printf("WARNING: kinematics_table_max must be larger than kinematics_table_min, table disabled\n");
+            this->enabled = false;
+            return;
+        }
+        this->inv_step[a] = 1.0F / this->step[a];
+    }
+}
+
+// fill the table from the analytic solution, returns false if it is not enabled or there is not enough memory
+bool KinematicsTable::generate(solution_t solution)
+{
+    clear();
+    if(!this->enabled) return false;
+
+    size_t n = this->nodes[0] * this->nodes[1] * this->nodes[2];
+    this->data = (float *)AHB0.alloc(n * this->outputs * sizeof(float));
+    if(this->data == nullptr) {
+        THEKERNEL->streams->printf("WARNING: not enough AHB0 memory for a %u node kinematics table, using the analytic solution\n", n);
+        return false;
+    }
+
+    float cartesian[3], actuator[3];
+    for (int z = 0; z < this->nodes[2]; z++) {
+        for (int y = 0; y < this->nodes[1]; y++) {
+            for (int x = 0; x < this->nodes[0]; x++) {
+                cartesian[X_AXIS] = this->min[X_AXIS] + x * this->step[X_AXIS];
+                cartesian[Y_AXIS] = this->min[Y_AXIS] + y * this->step[Y_AXIS];
+                cartesian[Z_AXIS] = this->min[Z_AXIS] + z * this->step[Z_AXIS];
+                solution(cartesian, actuator);
+                float *p = node(x, y, z);
+                for (int o = 0; o < this->outputs; o++)
+                    p[o] = actuator[o];
+            }
+        }
+    }
+
+    // an actuator jumping by more than max_span between neighbouring nodes is an angle wrap or singularity,
+    // interpolating across it would be wrong, so both nodes are marked unusable
+    std::vector<bool> bad(n, false);
+    for (int z = 0; z < this->nodes[2]; z++) {
+        for (int y = 0; y < this->nodes[1]; y++) {
+            for (int x = 0; x < this->nodes[0]; x++) {
+                const int next[3][3] = { {x + 1, y, z}, {x, y + 1, z}, {x, y, z + 1} };
+                for (int a = 0; a < 3; a++) {
+                    if(next[a][0] >= this->nodes[0] || next[a][1] >= this->nodes[1] || next[a][2] >= this->nodes[2]) continue;
+                    float *p = node(x, y, z);
+                    float *q = node(next[a][0], next[a][1], next[a][2]);
+                    for (int o = 0; o < this->outputs; o++) {
+                        if(!(fabsf(p[o] - q[o]) <= this->max_span)) {
+                            bad[(z * this->nodes[1] + y) * this->nodes[0] + x] = true;
+                            bad[(next[a][2] * this->nodes[1] + next[a][1]) * this->nodes[0] + next[a][0]] = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        if(bad[i]) {
+            for (int o = 0; o < this->outputs; o++)
+                this->data[i * this->outputs + o] = NAN;
+        }
+    }
+
+    return true;
+}
+
+// print the worst interpolation error in each row of cells, measured at the cell centers where it is largest
+void KinematicsTable::report(solution_t solution, StreamOutput* stream) const
+{
+    if(this->data == nullptr) {
+        stream->printf("kinematics table is %s\n", this->enabled ? "not loaded" : "disabled");
+        return;
+    }
+
+    stream->printf("kinematics table %dx%dx%d nodes, %u bytes, X%1.3f Y%1.3f Z%1.3f step X%1.3f Y%1.3f Z%1.3f\n",
+                   this->nodes[0], this->nodes[1], this->nodes[2], this->nodes[0] * this->nodes[1] * this->nodes[2] * this->outputs * sizeof(float),
+                   this->min[X_AXIS], this->min[Y_AXIS], this->min[Z_AXIS], this->step[X_AXIS], this->step[Y_AXIS], this->step[Z_AXIS]);
+
+    float worst = 0.0F;
+    float sum = 0.0F;
+    int count = 0, fallback = 0;
+    int zcells = this->nodes[2] > 1 ? this->nodes[2] - 1 : 1;
+
+    float cartesian[3], exact[3], table[3];
+    for (int z = 0; z < zcells; z++) {
+        cartesian[Z_AXIS] = this->min[Z_AXIS] + (this->nodes[2] > 1 ? (z + 0.5F) * this->step[Z_AXIS] : 0.0F);
+        stream->printf(";Z%1.3f max error per cell, - uses the analytic solution\n", cartesian[Z_AXIS]);
+        for (int y = 0; y < this->nodes[1] - 1; y++) {
+            cartesian[Y_AXIS] = this->min[Y_AXIS] + (y + 0.5F) * this->step[Y_AXIS];
+            stream->printf("Y%1.2f", cartesian[Y_AXIS]);
+            for (int x = 0; x < this->nodes[0] - 1; x++) {
+                cartesian[X_AXIS] = this->min[X_AXIS] + (x + 0.5F) * this->step[X_AXIS];
+                if(!lookup(cartesian, table)) {
+                    stream->printf("     -");
+                    fallback++;
+                    continue;
+                }
+                solution(cartesian, exact);
+                float err = 0.0F;
+                for (int o = 0; o < this->outputs; o++)
+                    err = fmaxf(err, fabsf(table[o] - exact[o]));
+                worst = fmaxf(worst, err);
+                sum += err;
+                count++;
+                stream->printf(" %1.4f", err);
+            }
+            stream->printf("\n");
+        }
+    }
+    stream->printf("max error %1.5f, mean %1.5f, %d cells use the analytic solution\n", worst, count > 0 ? sum / count : 0.0F, fallback);
+}
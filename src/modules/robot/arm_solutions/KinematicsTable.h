@@ -0,0 +1,94 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KINEMATICSTABLE_H
+#define KINEMATICSTABLE_H
+
+#include <stdint.h>
+#include <functional>
+
+class Config;
+class StreamOutput;
+
+// Precomputed grid of actuator positions over the workspace, generated from an arm solution's analytic inverse kinematics.
+// Lookups are bi/trilinear interpolations, which are a lot cheaper than the trig in the SCARA and rotatable delta solutions.
+// The grid is held in AHB0 RAM. Points outside the grid, or in cells next to a singularity or angle wrap, return false
+// and the caller must use the analytic solution.
+class KinematicsTable {
+    public:
+        typedef std::function<void(float[], float[])> solution_t;
+
+        KinematicsTable();
+        ~KinematicsTable();
+
+        void configure(Config* config, uint8_t outputs, bool use_z);
+        bool generate(solution_t solution);
+        void clear();
+        bool is_enabled() const { return enabled; }
+        bool is_loaded() const { return data != nullptr; }
+
+        // interpolate the first outputs actuator positions for the given cartesian position
+        inline bool lookup(const float cartesian[], float actuator[]) const;
+
+        void report(solution_t solution, StreamOutput* stream) const;
+
+    private:
+        float* node(int x, int y, int z) const { return &data[((z * nodes[1] + y) * nodes[0] + x) * outputs]; }
+
+        float min[3];
+        float step[3];
+        float inv_step[3];
+        uint16_t nodes[3];
+        float max_span;
+        float* data;
+        uint8_t outputs;
+        bool enabled;
+};
+
+inline bool KinematicsTable::lookup(const float cartesian[], float actuator[]) const
+{
+    if(data == nullptr) return false;
+
+    float f[3];
+    int i[3];
+    for (int a = 0; a < 3; a++) {
+        if(nodes[a] < 2) {
+            f[a] = 0.0F;
+            i[a] = 0;
+            continue;
+        }
+        float p = (cartesian[a] - min[a]) * inv_step[a];
+        if(p < 0.0F || p > nodes[a] - 1) return false;
+        i[a] = (int)p;
+        if(i[a] == nodes[a] - 1) i[a]--; // on the far edge use the last cell
+        f[a] = p - i[a];
+    }
+
+    const int dx = outputs;
+    const int dy = nodes[0] * outputs;
+    const int dz = nodes[1] * dy;
+    const float* c = node(i[0], i[1], i[2]);
+
+    for (int o = 0; o < outputs; o++) {
+        const float* n = c + o;
+        float v00 = n[0]       + (n[dx]       - n[0])       * f[0];
+        float v10 = n[dy]      + (n[dy + dx]  - n[dy])      * f[0];
+        float v = v00 + (v10 - v00) * f[1];
+        if(nodes[2] > 1) {
+            float v01 = n[dz]      + (n[dz + dx]      - n[dz])      * f[0];
+            float v11 = n[dz + dy] + (n[dz + dy + dx] - n[dz + dy]) * f[0];
+            float vz = v01 + (v11 - v01) * f[1];
+            v += (vz - v) * f[2];
+        }
+        // nodes that could not be used are stored as NAN, so any cell touching one fails here
+        if(v != v) return false;
+        actuator[o] = v;
+    }
+    return true;
+}
+
+#endif // KINEMATICSTABLE_H
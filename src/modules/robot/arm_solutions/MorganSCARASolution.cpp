@@ -44,11 +44,15 @@ MorganSCARASolution::MorganSCARASolution(Config* config)
     // max: head on maximum reach
     morgan_undefined_max  = config->value(morgan_undefined_max_checksum)->by_default(0.95f)->as_number();
 
+    // optional lookup table for the arm angles, Z is not used by the arms
+    table.configure(config, 2, false);
+
     init();
 }
 
 void MorganSCARASolution::init() {
-
+    // (re)build the lookup table whenever the arm geometry changes
+    table.generate([this](float cartesian_mm[], float actuator_mm[]) { this->calculate_actuator(cartesian_mm, actuator_mm); });
 }
 
 float MorganSCARASolution::to_degrees(float radians) {
@@ -56,6 +60,22 @@ float MorganSCARASolution::to_degrees(float radians) {
 }
 
 void MorganSCARASolution::cartesian_to_actuator( float cartesian_mm[], float actuator_mm[] )
+{
+    if(table.lookup(cartesian_mm, actuator_mm)) {
+        actuator_mm[GAMMA_STEPPER] = cartesian_mm[Z_AXIS];
+        return;
+    }
+
+    calculate_actuator(cartesian_mm, actuator_mm);
+}
+
+bool MorganSCARASolution::report_table(StreamOutput* stream)
+{
+    table.report([this](float cartesian_mm[], float actuator_mm[]) { this->calculate_actuator(cartesian_mm, actuator_mm); }, stream);
+    return true;
+}
+
+void MorganSCARASolution::calculate_actuator( float cartesian_mm[], float actuator_mm[] )
 {
 
     float SCARA_pos[2],
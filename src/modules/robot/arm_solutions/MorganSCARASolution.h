@@ -2,6 +2,7 @@
 #define MORGANSCARASOLUTION_H
 //#include "libs/Module.h"
 #include "BaseSolution.h"
+#include "KinematicsTable.h"
 
 class Config;
 
@@ -13,9 +14,11 @@ class MorganSCARASolution : public BaseSolution {
 
         bool set_optional(const arm_options_t& options);
         bool get_optional(arm_options_t& options);
+        bool report_table(StreamOutput* stream);
 
     private:
         void init();
+        void calculate_actuator( float cartesian_mm[], float actuator_mm[] );
         float to_degrees(float radians);
 
         float arm1_length;
@@ -25,6 +28,8 @@ class MorganSCARASolution : public BaseSolution {
         float morgan_undefined_min;
         float morgan_undefined_max;
         float slow_rate;
+
+        KinematicsTable table;
 };
 
 #endif // MORGANSCARASOLUTION_H
@@ -50,6 +50,9 @@ RotatableDeltaSolution::RotatableDeltaSolution(Config* config)
 	// Distance between end effector ball joint plane and tip of tool (PnP)
 	tool_offset = config->value(tool_offset_checksum)->by_default(30.500F)->as_number();
 
+	// optional lookup table for the three arm angles
+	table.configure(config, 3, true);
+
 	init();
 }
 
@@ -131,9 +134,28 @@ void RotatableDeltaSolution::init() {
 
 	//these are calculated here and not in the config() as these variables can be fine tuned by the user.
 	z_calc_offset  = (delta_z_offset - tool_offset - delta_ee_offs)*-1.0F;
+
+	// (re)build the lookup table whenever the geometry changes, unreachable points are left for the analytic solution
+	table.generate([this](float cartesian_mm[], float actuator_mm[]) {
+		if(this->calculate_actuator(cartesian_mm, actuator_mm) != 0)
+			actuator_mm[ALPHA_STEPPER] = actuator_mm[BETA_STEPPER] = actuator_mm[GAMMA_STEPPER] = NAN;
+	});
 }
 
 void RotatableDeltaSolution::cartesian_to_actuator( float cartesian_mm[], float actuator_mm[] )
+{
+	if(table.lookup(cartesian_mm, actuator_mm)) return;
+
+	calculate_actuator(cartesian_mm, actuator_mm);
+}
+
+bool RotatableDeltaSolution::report_table(StreamOutput* stream)
+{
+	table.report([this](float cartesian_mm[], float actuator_mm[]) { this->calculate_actuator(cartesian_mm, actuator_mm); }, stream);
+	return true;
+}
+
+int RotatableDeltaSolution::calculate_actuator( float cartesian_mm[], float actuator_mm[] )
 {
 	//We need to translate the Cartesian coordinates in mm to the actuator position required in mm so the stepper motor  functions
 	float alpha_theta = 0.0F;
@@ -180,6 +202,7 @@ void RotatableDeltaSolution::cartesian_to_actuator( float cartesian_mm[], float
 //		  THEKERNEL->streams->printf(" z= %f\n\r",delta[Z_AXIS]);
 	  }
 
+	return status;
 }
 
 void RotatableDeltaSolution::actuator_to_cartesian( float actuator_mm[], float cartesian_mm[] )
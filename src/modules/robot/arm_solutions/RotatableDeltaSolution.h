@@ -2,6 +2,7 @@
 #define RotatableDeltaSolution_H
 #include "libs/Module.h"
 #include "BaseSolution.h"
+#include "KinematicsTable.h"
 
 class Config;
 
@@ -13,9 +14,11 @@ class RotatableDeltaSolution : public BaseSolution {
 
         bool set_optional(const arm_options_t& options);
         bool get_optional(arm_options_t& options);
+        bool report_table(StreamOutput* stream);
 
     private:
         void init();
+        int calculate_actuator( float cartesian_mm[], float actuator_mm[] );
         int delta_calcAngleYZ(float x0, float y0, float z0, float &theta);
         int delta_calcForward(float theta1, float theta2, float theta3, float &x0, float &y0, float &z0);
 
@@ -29,5 +32,7 @@ class RotatableDeltaSolution : public BaseSolution {
         float delta_ee_offs;		// Ball joint plane to bottom of end effector surface
         float tool_offset;		// Distance between end effector ball joint plane and tip of tool
         float z_calc_offset;
+
+        KinematicsTable table;
 };
 #endif // RotatableDeltaSolution_H
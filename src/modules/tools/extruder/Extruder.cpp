@@ -6,6 +6,7 @@
 */
 
 #include "Extruder.h"
+#include "StepCarry.h"
 
 #include "libs/Module.h"
 #include "libs/Kernel.h"
@@ -23,7 +24,10 @@
 #include "ConfigValue.h"
 #include "Gcode.h"
 #include "libs/StreamOutput.h"
+#include "StreamOutputPool.h"
 #include "PublicDataRequest.h"
+#include "ExtruderPublicAccess.h"
+#include "utils.h"
 
 #include <mri.h>
 
@@ -39,8 +43,6 @@
 #define extruder_default_feed_rate_checksum  CHECKSUM("extruder_default_feed_rate")
 
 // NEW config names
-#define extruder_checksum                    CHECKSUM("extruder")
-
 #define default_feed_rate_checksum           CHECKSUM("default_feed_rate")
 #define steps_per_mm_checksum                CHECKSUM("steps_per_mm")
 #define filament_diameter_checksum           CHECKSUM("filament_diameter")
@@ -60,6 +62,16 @@
 #define retract_zlift_length_checksum        CHECKSUM("retract_zlift_length")
 #define retract_zlift_feedrate_checksum      CHECKSUM("retract_zlift_feedrate")
 
+#define mix_step_pins_checksum               CHECKSUM("mix_step_pins")
+#define mix_dir_pins_checksum                CHECKSUM("mix_dir_pins")
+#define mix_en_pins_checksum                 CHECKSUM("mix_en_pins")
+
+#define max_volumetric_flow_checksum         CHECKSUM("max_volumetric_flow")
+#define max_volumetric_flow_diameter_checksum CHECKSUM("max_volumetric_flow_diameter")
+
+#define pressure_advance_checksum            CHECKSUM("pressure_advance")
+#define pressure_advance_smooth_time_checksum CHECKSUM("pressure_advance_smooth_time")
+
 #define save_state_checksum                  CHECKSUM("save_state")
 #define restore_state_checksum               CHECKSUM("restore_state")
 
@@ -87,24 +99,38 @@ Extruder::Extruder( uint16_t config_identifier, bool single )
     this->single_config = single;
     this->identifier = config_identifier;
     this->retracted = false;
+    this->coordinated = false;
+    this->advancing = false;
     this->volumetric_multiplier = 1.0F;
     this->extruder_multiplier = 1.0F;
     this->stepper_motor= nullptr;
+    this->mix_motors[0]= nullptr;
+    this->mix_channels= 1;
 
     memset(this->offset, 0, sizeof(this->offset));
 }
 
 Extruder::~Extruder()
 {
-    delete stepper_motor;
+    for (int c = 0; c < this->mix_channels; c++)
+        delete mix_motors[c];
 }
 
 void Extruder::on_halt(void *arg)
 {
     if(arg == nullptr) {
         // turn off motor
-        this->en_pin.set(1);
+        enable_motors(false);
     }
+    // wherever the filament was left it is not ahead of anything any more
+    this->advance.take_lead();
+}
+
+// the blocks queued while this is the active tool carry its mix
+void Extruder::enable()
+{
+    Tool::enable();
+    if(this->mix_channels > 1) THEKERNEL->conveyor->set_extruder_mix(this->planned_mix, this->mix_channels);
 }
 
 void Extruder::on_module_loaded()
@@ -115,7 +141,12 @@ void Extruder::on_module_loaded()
     // Start values
     this->target_position = 0;
     this->current_position = 0;
-    this->unstepped_distance = 0;
+    for (int c = 0; c < max_mix_channels; c++)
+        this->unstepped_distance[c] = 0;
+    this->follow_extrusion = 0;
+    this->follow_travel = 0;
+    this->planned.position = 0;
+    this->planned.absolute = this->absolute_mode;
     this->current_block = NULL;
     this->mode = OFF;
 
@@ -127,12 +158,14 @@ void Extruder::on_module_loaded()
     this->register_for_event(ON_PLAY);
     this->register_for_event(ON_PAUSE);
     this->register_for_event(ON_HALT);
-    this->register_for_event(ON_SPEED_CHANGE);
     this->register_for_event(ON_GET_PUBLIC_DATA);
     this->register_for_event(ON_SET_PUBLIC_DATA);
 
     // Update speed every *acceleration_ticks_per_second*
     THEKERNEL->step_ticker->register_acceleration_tick_handler([this](){acceleration_tick(); });
+
+    // a FOLLOW block we step on our own still follows the robot's rate, and stops when a flush stops it
+    THEKERNEL->stepper->register_rate_listener(&Extruder::rate_changed, this);
 }
 
 // Get config
@@ -182,6 +215,15 @@ void Extruder::on_config_reload(void *argument)
     this->retract_zlift_length     = THEKERNEL->config->value(extruder_checksum, this->identifier, retract_zlift_length_checksum)->by_default(0)->as_number();
     this->retract_zlift_feedrate   = THEKERNEL->config->value(extruder_checksum, this->identifier, retract_zlift_feedrate_checksum)->by_default(100*60)->as_number(); // mm/min
 
+    // the robot slows down moves that would need more than this many mm³/s of plastic, 0 disables it.
+    // The flow is worked out with max_volumetric_flow_diameter, so E can stay in mm of filament, or with filament_diameter
+    this->max_volumetric_flow      = THEKERNEL->config->value(extruder_checksum, this->identifier, max_volumetric_flow_checksum)->by_default(0)->as_number();
+    this->max_volumetric_flow_diameter = THEKERNEL->config->value(extruder_checksum, this->identifier, max_volumetric_flow_diameter_checksum)->by_default(0)->as_number();
+
+    // pressure advance K in seconds, the extruder is kept K times its speed ahead, its acceleration term smoothed over smooth_time seconds
+    set_pressure_advance(THEKERNEL->config->value(extruder_checksum, this->identifier, pressure_advance_checksum)->by_default(0)->as_number(),
+                         THEKERNEL->config->value(extruder_checksum, this->identifier, pressure_advance_smooth_time_checksum)->by_default(0)->as_number());
+
     if(filament_diameter > 0.01F) {
         this->volumetric_multiplier = 1.0F / (powf(this->filament_diameter / 2, 2) * PI);
     }
@@ -194,6 +236,38 @@ void Extruder::on_config_reload(void *argument)
     }else{
         this->stepper_motor->set_max_rate(THEKERNEL->config->value(extruder_checksum, this->identifier, max_speed_checksum)->by_default(1000)->as_number());
     }
+    this->mix_motors[0] = this->stepper_motor;
+    this->mix_channels = 1;
+
+    // a mixing extruder lists the pins for its other motors, they use the same steps_per_mm and max_speed
+    // all of them follow the robot's blocks, with room left on a block for one more follower
+    static_assert(max_mix_channels < Block::max_followers, "a mixing extruder must leave room for another follower");
+    if( !this->single_config ) {
+        vector<string> steps = split(THEKERNEL->config->value(extruder_checksum, this->identifier, mix_step_pins_checksum)->by_default("")->as_string().c_str(), ',');
+        vector<string> dirs  = split(THEKERNEL->config->value(extruder_checksum, this->identifier, mix_dir_pins_checksum )->by_default("")->as_string().c_str(), ',');
+        vector<string> ens   = split(THEKERNEL->config->value(extruder_checksum, this->identifier, mix_en_pins_checksum  )->by_default("")->as_string().c_str(), ',');
+        if(steps.size() + 1 > max_mix_channels || steps.size() != dirs.size()) {
+            THEKERNEL->streams->printf("Error in config: extruder mix_step_pins and mix_dir_pins must list the same number of pins, at most %d, mixing disabled\n", max_mix_channels - 1);
+            steps.clear();
+        }
+        for (size_t i = 0; i < steps.size(); i++) {
+            Pin step, dir, en;
+            step.from_string(steps[i])->as_output();
+            dir.from_string(dirs[i])->as_output();
+            en.from_string(i < ens.size() ? ens[i] : "nc")->as_output();
+            StepperMotor *m = new StepperMotor(step, dir, en);
+            m->attach(this, &Extruder::stepper_motor_finished_move );
+            m->set_max_rate(this->stepper_motor->get_max_rate());
+            this->mix_motors[this->mix_channels++] = m;
+        }
+    }
+
+    // all the plastic comes from the first motor until a mix is set
+    for (int c = 0; c < max_mix_channels; c++) {
+        this->mix[c] = (c == 0) ? 1.0F : 0.0F;
+        this->planned_mix[c] = this->mix[c];
+        this->pending_mix[c] = this->mix[c];
+    }
 }
 
 void Extruder::on_get_public_data(void* argument){
@@ -214,6 +288,31 @@ void Extruder::on_set_public_data(void *argument)
 
     if(!pdr->starts_with(extruder_checksum)) return;
 
+    if(pdr->second_element_is(follow_speed_limit_checksum)) {
+        if(!this->enabled) return;
+        pad_extruder_follow *pef = static_cast<pad_extruder_follow *>(pdr->get_data_ptr());
+        limit_follow_speed(pef);
+        pdr->set_taken();
+        return;
+    }
+
+    // a dry run plans the gcodes that change E without queueing anything, then puts the plan back
+    if(pdr->second_element_is(plan_gcode_checksum)) {
+        this->planned.plan(static_cast<Gcode *>(pdr->get_data_ptr()), this->enabled);
+        pdr->set_taken();
+        return;
+    }
+    if(pdr->second_element_is(save_plan_checksum)) {
+        this->saved_plan = this->planned;
+        pdr->set_taken();
+        return;
+    }
+    if(pdr->second_element_is(restore_plan_checksum)) {
+        this->planned = this->saved_plan;
+        pdr->set_taken();
+        return;
+    }
+
     // save or restore state
     if(pdr->second_element_is(save_state_checksum)) {
         this->saved_current_position= this->current_position;
@@ -222,6 +321,7 @@ void Extruder::on_set_public_data(void *argument)
     }else if(pdr->second_element_is(restore_state_checksum)) {
         this->current_position= this->saved_current_position;
         this->absolute_mode= this->saved_absolute_mode;
+        this->planned.absolute= this->saved_absolute_mode;
         pdr->set_taken();
     }
 }
@@ -230,20 +330,25 @@ void Extruder::on_set_public_data(void *argument)
 void Extruder::on_pause(void *argument)
 {
     this->paused = true;
-    this->stepper_motor->pause();
+    for (int c = 0; c < this->mix_channels; c++)
+        this->mix_motors[c]->pause();
 }
 
 // When the play/pause button is set to play, or a module calls the ON_PLAY event
 void Extruder::on_play(void *argument)
 {
     this->paused = false;
-    this->stepper_motor->unpause();
+    for (int c = 0; c < this->mix_channels; c++)
+        this->mix_motors[c]->unpause();
 }
 
 void Extruder::on_gcode_received(void *argument)
 {
     Gcode *gcode = static_cast<Gcode *>(argument);
 
+    // the robot has already planned a move with this, so E can be planned ahead of it too
+    this->planned.plan(gcode, this->enabled);
+
     // M codes most execute immediately, most only execute if enabled
     if (gcode->has_m) {
         if (gcode->m == 114 && this->enabled) {
@@ -301,6 +406,39 @@ void Extruder::on_gcode_received(void *argument)
             if(gcode->has_letter('F')) retract_recover_feedrate = gcode->get_value('F')/60.0F; // specified in mm/min converted to mm/sec
             gcode->mark_as_taken();
 
+        } else if (gcode->m == 900 && ( (this->enabled && !gcode->has_letter('P')) || (gcode->has_letter('P') && gcode->get_value('P') == this->identifier)) ) {
+            // M900 - set pressure advance K[seconds] S[smoothing time seconds], no parameters prints them
+            if(gcode->has_letter('K') || gcode->has_letter('S')) {
+                THEKERNEL->conveyor->wait_for_empty_queue(); // do not change it in the middle of a move
+                set_pressure_advance(gcode->has_letter('K') ? gcode->get_value('K') : this->pressure_advance,
+                                     gcode->has_letter('S') ? gcode->get_value('S') : this->pressure_advance_smooth_time);
+            } else {
+                gcode->stream->printf("Pressure advance K%1.4f S%1.4f\n", this->pressure_advance, this->pressure_advance_smooth_time);
+            }
+            gcode->mark_as_taken();
+
+        } else if ((gcode->m == 163 || gcode->m == 164) && this->enabled && this->mix_channels > 1) {
+            // M163 S<motor> P<weight> sets one motor's weight in the next mix, M164 makes it the mix used by the following moves
+            // the mix is planned like a move, each block carries the mix it was queued with
+            if(gcode->m == 163 && !gcode->has_letter('S')) {
+                gcode->stream->printf("Mix:");
+                for (int c = 0; c < this->mix_channels; c++)
+                    gcode->stream->printf(" %d:%1.3f", c, this->planned_mix[c]);
+                gcode->stream->printf("\n");
+            } else if(gcode->m == 163) {
+                int c = gcode->get_value('S');
+                if(c >= 0 && c < this->mix_channels) this->pending_mix[c] = max(0.0F, gcode->get_value('P'));
+            } else {
+                // the weights are normalized so the total extrusion does not change
+                float sum = 0;
+                for (int c = 0; c < this->mix_channels; c++) sum += this->pending_mix[c];
+                if(sum > 0.0F) {
+                    for (int c = 0; c < this->mix_channels; c++) this->planned_mix[c] = this->pending_mix[c] / sum;
+                    THEKERNEL->conveyor->set_extruder_mix(this->planned_mix, this->mix_channels);
+                }
+            }
+            gcode->mark_as_taken();
+
         } else if (gcode->m == 221 && this->enabled) { // M221 S100 change flow rate by percentage
             if(gcode->has_letter('S')) this->extruder_multiplier= gcode->get_value('S')/100.0F;
             gcode->mark_as_taken();
@@ -312,6 +450,7 @@ void Extruder::on_gcode_received(void *argument)
                 gcode->stream->printf(";E retract length, feedrate, zlift length, feedrate:\nM207 S%1.4f F%1.4f Z%1.4f Q%1.4f\n", this->retract_length, this->retract_feedrate*60.0F, this->retract_zlift_length, this->retract_zlift_feedrate);
                 gcode->stream->printf(";E retract recover length, feedrate:\nM208 S%1.4f F%1.4f\n", this->retract_recover_length, this->retract_recover_feedrate*60.0F);
                 gcode->stream->printf(";E acceleration mm/sec^2:\nM204 E%1.4f\n", this->acceleration);
+                gcode->stream->printf(";E pressure advance seconds, smoothing time:\nM900 K%1.4f S%1.4f\n", this->pressure_advance, this->pressure_advance_smooth_time);
 
             } else {
                 gcode->stream->printf(";E Steps per mm:\nM92 E%1.4f P%d\n", this->steps_per_millimeter, this->identifier);
@@ -319,6 +458,7 @@ void Extruder::on_gcode_received(void *argument)
                 gcode->stream->printf(";E retract length, feedrate:\nM207 S%1.4f F%1.4f Z%1.4f Q%1.4f P%d\n", this->retract_length, this->retract_feedrate*60.0F, this->retract_zlift_length, this->retract_zlift_feedrate, this->identifier);
                 gcode->stream->printf(";E retract recover length, feedrate:\nM208 S%1.4f F%1.4f P%d\n", this->retract_recover_length, this->retract_recover_feedrate*60.0F, this->identifier);
                 gcode->stream->printf(";E acceleration mm/sec^2:\nM204 E%1.4f P%d\n", this->acceleration, this->identifier);
+                gcode->stream->printf(";E pressure advance seconds, smoothing time:\nM900 K%1.4f S%1.4f P%d\n", this->pressure_advance, this->pressure_advance_smooth_time, this->identifier);
             }
             gcode->mark_as_taken();
         } else if( gcode->m == 17 || gcode->m == 18 || gcode->m == 82 || gcode->m == 83 || gcode->m == 84 ) {
@@ -350,6 +490,7 @@ void Extruder::on_gcode_received(void *argument)
                 this->retracted= false;
             } else
                 return; // ignore duplicates
+            this->planned.position += (gcode->g == 10) ? -retract_length : (retract_length + retract_recover_length);
 
             // now we do a special hack to add zlift if needed, this should go in Robot but if it did the zlift would be executed before retract which is bad
             // this way zlift will happen after retract, (or before for unretract) NOTE we call the robot->on_gcode_receive directly to avoid recursion
@@ -400,10 +541,10 @@ void Extruder::on_gcode_execute(void *argument)
     if( gcode->has_m ) {
         switch(gcode->m) {
         case 17:
-            this->en_pin.set(0);
+            enable_motors(true);
             break;
         case 18:
-            this->en_pin.set(1);
+            enable_motors(false);
             break;
         case 82:
             this->absolute_mode = true;
@@ -412,7 +553,7 @@ void Extruder::on_gcode_execute(void *argument)
             this->absolute_mode = false;
             break;
         case 84:
-            this->en_pin.set(1);
+            enable_motors(false);
             break;
         }
         return;
@@ -429,11 +570,11 @@ void Extruder::on_gcode_execute(void *argument)
             if( gcode->has_letter('E') ) {
                 this->current_position = gcode->get_value('E');
                 this->target_position  = this->current_position;
-                this->unstepped_distance = 0;
+                for (int c = 0; c < max_mix_channels; c++) this->unstepped_distance[c] = 0;
             } else if( gcode->get_num_args() == 0) {
                 this->current_position = 0.0;
                 this->target_position = this->current_position;
-                this->unstepped_distance = 0;
+                for (int c = 0; c < max_mix_channels; c++) this->unstepped_distance[c] = 0;
             }
 
         } else if (gcode->g == 10) {
@@ -442,7 +583,7 @@ void Extruder::on_gcode_execute(void *argument)
             this->mode = SOLO;
             this->travel_distance = -retract_length;
             this->target_position += this->travel_distance;
-            this->en_pin.set(0);
+            enable_motors(true);
 
         } else if (gcode->g == 11) {
             // un retract command
@@ -450,7 +591,7 @@ void Extruder::on_gcode_execute(void *argument)
             this->mode = SOLO;
             this->travel_distance = (retract_length + retract_recover_length);
             this->target_position += this->travel_distance;
-            this->en_pin.set(0);
+            enable_motors(true);
 
         } else if (gcode->g == 0 || gcode->g == 1) {
             // Extrusion length from 'G' Gcode
@@ -472,11 +613,14 @@ void Extruder::on_gcode_execute(void *argument)
                 } else {
                     // We move proportionally to the robot's movement
                     this->mode = FOLLOW;
-                    this->travel_ratio = (relative_extrusion_distance * this->volumetric_multiplier * this->extruder_multiplier) / gcode->millimeters_of_travel; // adjust for volumetric extrusion and extruder multiplier
-                    // TODO: check resulting flowrate, limit robot speed if it exceeds max_speed
+                    // adjust for volumetric extrusion and extruder multiplier, when moves were merged the ratio covers all of them
+                    this->follow_extrusion += relative_extrusion_distance * this->volumetric_multiplier * this->extruder_multiplier;
+                    this->follow_travel += gcode->millimeters_of_travel;
+                    this->travel_ratio = this->follow_extrusion / this->follow_travel;
+                    // the robot already limited its speed to what this needs, see limit_follow_speed()
                 }
 
-                this->en_pin.set(0);
+                enable_motors(true);
             }
 
             if (gcode->has_letter('F')) {
@@ -493,13 +637,24 @@ void Extruder::on_block_begin(void *argument)
 {
     if(!this->enabled) return;
 
+    // the next block starts new totals
+    this->follow_extrusion = 0;
+    this->follow_travel = 0;
+
     if( this->mode == OFF ) {
         this->current_block = NULL;
-        this->stepper_motor->set_moved_last_block(false);
+        this->advancing = false;
+        drop_pressure_advance_lead();
+        for (int c = 0; c < this->mix_channels; c++)
+            this->mix_motors[c]->set_moved_last_block(false);
         return;
     }
 
     Block *block = static_cast<Block *>(argument);
+    if(this->mix_channels > 1) {
+        // the mix the block was queued with, a later M164 does not change it
+        for (int c = 0; c < this->mix_channels; c++) this->mix[c] = block->extruder_mix[c];
+    }
     if( this->mode == FOLLOW ) {
         // In FOLLOW mode, we just follow the stepper module
         this->travel_distance = block->millimeters * this->travel_ratio;
@@ -508,38 +663,54 @@ void Extruder::on_block_begin(void *argument)
     // common for both FOLLOW and SOLO
     this->current_position += this->travel_distance ;
 
-    // round down, we take care of the fractional part next time
-    int steps_to_step = abs(floorf(this->steps_per_millimeter * (this->travel_distance + this->unstepped_distance) ));
+    // In FOLLOW mode we step along with the axes, the Stepper sets our speed whenever it sets theirs
+    // and releases the block once we have all finished. Otherwise we take the block, we have to release it or everything gets stuck
+    this->coordinated = (this->mode == FOLLOW && THEKERNEL->stepper->get_current_block() == block && block->follower_count + this->mix_channels <= Block::max_followers);
+    this->current_block = NULL;
 
-    // accumulate the fractional part
-    if ( this->travel_distance > 0 ) {
-        this->unstepped_distance += this->travel_distance - (steps_to_step / this->steps_per_millimeter);
+    // with pressure advance the extruder also moves the change in its lead over the block, the lead carries over to the
+    // next block, or is taken back in this one if the next does not extrude, which may make it a retract.
+    // current_position stays the nominal one
+    float travel = this->travel_distance;
+    this->advancing = (this->coordinated && this->pressure_advance > 0.0F && this->travel_distance > 0);
+    if(this->advancing) {
+        travel = this->advance.begin_block(this->travel_distance, block->initial_rate, block->final_rate, block->steps_event_count, follows_next(block));
     } else {
-        this->unstepped_distance += this->travel_distance + (steps_to_step / this->steps_per_millimeter);
+        drop_pressure_advance_lead();
     }
 
-    if( steps_to_step != 0 ) {
-        // We take the block, we have to release it or everything gets stuck
-        block->take();
-        this->current_block = block;
-        this->stepper_motor->move( (this->travel_distance > 0), steps_to_step);
+    // each motor of a mixing extruder moves its share, with its own fractional part so none of them drifts
+    for (int c = 0; c < this->mix_channels; c++) {
+        StepperMotor *motor = this->mix_motors[c];
+        float distance = travel * this->mix[c];
+
+        // whole steps, we take care of the fractional part next time
+        int steps = carry_steps(distance, this->unstepped_distance[c], this->steps_per_millimeter);
+        int steps_to_step = abs(steps);
+
+        if( steps_to_step == 0 ) {
+            // no steps to take this time
+            motor->set_moved_last_block(false);
+            continue;
+        }
+
+        if(this->current_block == NULL) {
+            if(!this->coordinated) block->take();
+            this->current_block = block;
+        }
+        if(this->coordinated) block->add_follower(motor);
+        motor->move( (steps > 0), steps_to_step);
 
         if(this->mode == FOLLOW) {
-            on_speed_change(this); // set initial speed
-            this->stepper_motor->set_moved_last_block(true);
+            motor->set_speed(follow_rate(c)); // set initial speed
+            motor->set_moved_last_block(true);
         }else{
             // SOLO
-            uint32_t target_rate = floorf(this->feed_rate * this->steps_per_millimeter);
-            this->stepper_motor->set_speed(min( target_rate, rate_increase() ));  // start at first acceleration step
-            this->stepper_motor->set_moved_last_block(false);
+            uint32_t target_rate = floorf(this->feed_rate * this->steps_per_millimeter * this->mix[c]);
+            motor->set_speed(min( target_rate, rate_increase() ));  // start at first acceleration step
+            motor->set_moved_last_block(false);
         }
-
-    } else {
-        // no steps to take this time
-        this->current_block = NULL;
-        this->stepper_motor->set_moved_last_block(false);
     }
-
 }
 
 // When a block ends, pause the stepping interrupt
@@ -554,41 +725,56 @@ uint32_t Extruder::rate_increase() const {
 }
 
 // Called periodically to change the speed to match acceleration or to match the speed of the robot
-// Only used in SOLO mode
+// Used in SOLO mode, and in FOLLOW mode when pressure advance is on
 void Extruder::acceleration_tick(void)
 {
     // Avoid trying to work when we really shouldn't ( between blocks or re-entry )
-    if(!this->enabled || this->mode != SOLO || this->current_block == NULL || !this->stepper_motor->is_moving() || this->paused ) {
+    if(!this->enabled || this->current_block == NULL || this->paused ) {
         return;
     }
 
-    uint32_t current_rate = this->stepper_motor->get_steps_per_second();
-    uint32_t target_rate = floorf(this->feed_rate * this->steps_per_millimeter);
+    if(this->mode == FOLLOW) {
+        if(!this->advancing) return;
 
-    if( current_rate < target_rate ) {
-        current_rate = min( target_rate, current_rate + rate_increase() );
-        // steps per second
-        this->stepper_motor->set_speed(current_rate);
+        // the Stepper's tick runs first, this sees the rate and steps it just set. It sets the speed without the
+        // advance every time the robot's rate changes, so it is set again on every tick
+        Stepper *stepper = THEKERNEL->stepper;
+        this->advance.tick(stepper->get_trapezoid_adjusted_rate(), stepper->get_steps_completed(), this->current_block->rate_delta, stepper->get_trapezoid_phase());
+        for (int c = 0; c < this->mix_channels; c++) {
+            if(this->mix_motors[c]->is_moving()) this->mix_motors[c]->set_speed(follow_rate(c));
+        }
+        return;
     }
 
-    return;
+    if(this->mode != SOLO) return;
+
+    for (int c = 0; c < this->mix_channels; c++) {
+        StepperMotor *motor = this->mix_motors[c];
+        if(!motor->is_moving()) continue;
+
+        uint32_t current_rate = motor->get_steps_per_second();
+        uint32_t target_rate = floorf(this->feed_rate * this->steps_per_millimeter * this->mix[c]);
+
+        if( current_rate < target_rate ) {
+            current_rate = min( target_rate, current_rate + rate_increase() );
+            // steps per second
+            motor->set_speed(current_rate);
+        }
+    }
 }
 
-// Speed has been updated for the robot's stepper, we must update accordingly
-void Extruder::on_speed_change( void *argument )
+// the FOLLOW mode rate, or the pressure advance one which paces the block's steps, lead change included
+float Extruder::follow_rate(int channel) const
 {
-    // Avoid trying to work when we really shouldn't ( between blocks or re-entry )
-    if(!this->enabled || this->current_block == NULL ||  this->paused || this->mode != FOLLOW || !this->stepper_motor->is_moving()) {
-        return;
+    StepperMotor *motor = this->mix_motors[channel];
+    if(this->advancing) {
+        return this->advance.motor_rate(this->steps_per_millimeter * this->mix[channel], motor->get_stepped(), motor->get_steps_to_move());
     }
 
-    // if we are flushing the queue we need to stop the motor when it has decelerated to zero, we get this call with argumnet == 0 when this happens
-    // this is what steppermotor does
-    if(argument == 0) {
-        this->stepper_motor->move(0, 0);
-        this->current_block->release();
-        this->current_block = NULL;
-        return;
+    // the Stepper is not stepping this block, the axes do not move on it, so it is spread over the time planned for it
+    if(THEKERNEL->stepper->get_current_block() != this->current_block) {
+        float duration = this->current_block->duration();
+        return (duration > 0.0F) ? motor->get_steps_to_move() / duration : motor->get_max_rate();
     }
 
     /*
@@ -599,8 +785,97 @@ void Extruder::on_speed_change( void *argument )
     * or simplified : extruder steps * ( stepper's steps per second ) ) / current block's steps
     * or even : ( stepper steps per second ) * ( extruder steps / current block's steps )
     */
+    float ratio = (float)motor->get_steps_to_move() / (float)this->current_block->steps_event_count;
+    return THEKERNEL->stepper->get_trapezoid_adjusted_rate() * ratio;
+}
+
+// lower the robot's speed for a move so neither the extruder's max_speed nor max_volumetric_flow is exceeded
+void Extruder::limit_follow_speed(pad_extruder_follow *pef) const
+{
+    if(pef->millimeters < 0.00001F) return;
+
+    float extrusion = this->planned.extrusion(pef->gcode);
+    // filament mm per mm of robot travel
+    float ratio = fabsf(extrusion * this->volumetric_multiplier * this->extruder_multiplier / pef->millimeters);
+    if(ratio < 0.000001F) return;
+
+    float max_speed = this->stepper_motor->get_max_rate() / ratio;
+    // does not depend on E being volumetric, the ratio is already in mm of filament either way
+    float diameter = (this->max_volumetric_flow_diameter > 0.01F) ? this->max_volumetric_flow_diameter : this->filament_diameter;
+    if(this->max_volumetric_flow > 0.0F && diameter > 0.01F && extrusion > 0.0F) {
+        // volumetric flow is filament speed times its cross section
+        float area = powf(diameter / 2, 2) * PI;
+        max_speed = min(max_speed, this->max_volumetric_flow / (area * ratio));
+    }
+    if(max_speed < pef->max_speed) pef->max_speed = max_speed;
+}
+
+void Extruder::enable_motors(bool on)
+{
+    this->en_pin.set(!on);
+    for (int c = 1; c < this->mix_channels; c++)
+        this->mix_motors[c]->enable(on);
+}
 
-    this->stepper_motor->set_speed(THEKERNEL->stepper->get_trapezoid_adjusted_rate() * (float)this->stepper_motor->get_steps_to_move() / (float)this->current_block->steps_event_count);
+void Extruder::rate_changed(void *extruder, float steps_per_second)
+{
+    static_cast<Extruder *>(extruder)->on_rate_change(steps_per_second);
+}
+
+// called by the Stepper whenever the robot's rate changes, coordinated motors have their speed set by it already.
+// 0 is a flush stopping the block, the Stepper stops its followers and releases the block, we stop the rest
+void Extruder::on_rate_change(float steps_per_second)
+{
+    if(!this->enabled || this->mode != FOLLOW || this->current_block == NULL) return;
+    if(THEKERNEL->stepper->get_current_block() != this->current_block) return;
+
+    if(steps_per_second == 0.0F) {
+        Block *block = this->current_block;
+        this->current_block = NULL;
+        this->advancing = false;
+        this->advance.take_lead();
+        if(this->coordinated) return;
+
+        for (int c = 0; c < this->mix_channels; c++) {
+            StepperMotor *motor = this->mix_motors[c];
+            if(motor->is_moving()) motor->move(motor->which_direction(), 0);
+        }
+        block->release();
+        return;
+    }
+
+    if(this->coordinated) return;
+    for (int c = 0; c < this->mix_channels; c++) {
+        if(this->mix_motors[c]->is_moving()) this->mix_motors[c]->set_speed(follow_rate(c));
+    }
+}
+
+void Extruder::set_pressure_advance(float k, float smooth_time)
+{
+    this->pressure_advance = k;
+    this->pressure_advance_smooth_time = smooth_time;
+    this->advance.configure(k, smooth_time, THEKERNEL->acceleration_ticks_per_second);
+}
+
+// whether we still follow the robot on the block queued after this one, the last gcode executed when it begins sets the
+// mode, see on_gcode_execute. If none is queued yet this block ends at a stop, where the lead is 0 anyway
+bool Extruder::follows_next(const Block *block) const
+{
+    const Block *next = THEKERNEL->conveyor->next_block(block);
+    if(next == nullptr || next->gcodes.empty()) return true;
+
+    const Gcode &gcode = next->gcodes.back();
+    return gcode.has_g && (gcode.g == 0 || gcode.g == 1) && gcode.has_letter('E') && fabs(gcode.millimeters_of_travel) >= 0.00001F;
+}
+
+// the lead is normally taken back by the end of the last block that extrudes, what is left when the path was cut short
+// is taken off the next steps of each motor so the filament ends up where it would have been without it
+void Extruder::drop_pressure_advance_lead()
+{
+    float lead = this->advance.take_lead();
+    if(lead == 0.0F) return;
+    for (int c = 0; c < this->mix_channels; c++)
+        this->unstepped_distance[c] -= lead * this->mix[c];
 }
 
 // When the stepper has finished it's move
@@ -608,12 +883,22 @@ uint32_t Extruder::stepper_motor_finished_move(uint32_t dummy)
 {
     if(!this->enabled) return 0;
 
+    // a mixing extruder is done when all its motors are
+    for (int c = 0; c < this->mix_channels; c++) {
+        if(this->mix_motors[c]->is_moving()) return 0;
+    }
+
     //printf("extruder releasing\r\n");
 
     if (this->current_block) { // this should always be true, but sometimes it isn't. TODO: find out why
         Block *block = this->current_block;
         this->current_block = NULL;
-        block->release();
+        if(this->coordinated) {
+            // the Stepper releases the block when the axes have finished too
+            THEKERNEL->stepper->stepper_motor_finished_move(0);
+        } else {
+            block->release();
+        }
     }
     return 0;
 
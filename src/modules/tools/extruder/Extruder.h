@@ -12,9 +12,13 @@
 
 #include "Tool.h"
 #include "Pin.h"
+#include "PressureAdvance.h"
+#include "ExtruderPlan.h"
 
 class StepperMotor;
 class Block;
+class Gcode;
+struct pad_extruder_follow;
 
 // NOTE Tool is also a module, no need for multiple inheritance here
 class Extruder : public Tool {
@@ -31,7 +35,7 @@ class Extruder : public Tool {
         void     on_play(void* argument);
         void     on_pause(void* argument);
         void     on_halt(void* argument);
-        void     on_speed_change(void* argument);
+        void     enable();
         void     acceleration_tick(void);
         uint32_t stepper_motor_finished_move(uint32_t dummy);
         Block*   append_empty_block();
@@ -40,15 +44,31 @@ class Extruder : public Tool {
         void on_get_public_data(void* argument);
         void on_set_public_data(void* argument);
         uint32_t rate_increase() const;
+        float follow_rate(int channel) const;
+        static void rate_changed(void *extruder, float steps_per_second);
+        void on_rate_change(float steps_per_second);
+        void enable_motors(bool on);
+        void set_pressure_advance(float k, float smooth_time);
+        void drop_pressure_advance_lead();
+        bool follows_next(const Block *block) const;
+        void limit_follow_speed(pad_extruder_follow *pef) const;
 
         StepperMotor*  stepper_motor;
         Pin            step_pin;                     // Step pin for the stepper driver
         Pin            dir_pin;                      // Dir pin for the stepper driver
         Pin            en_pin;
         float          target_position;              // End point ( in mm ) for the current move
-        float          unstepped_distance;           // overflow buffer for requested moves that are less than 1 step
         Block*         current_block;                // Current block we are stepping, same as Stepper's one
 
+        // a mixing extruder drives several motors into one nozzle, each gets its share of every extrusion
+        static const int max_mix_channels = 4;
+        StepperMotor*  mix_motors[max_mix_channels]; // [0] is stepper_motor
+        float          mix[max_mix_channels];        // share of each motor in the current block, adds up to 1
+        float          planned_mix[max_mix_channels];// set by M164, blocks queued after it carry it
+        float          pending_mix[max_mix_channels];// set by M163, used once M164 commits it
+        float          unstepped_distance[max_mix_channels]; // overflow buffer for requested moves that are less than 1 step
+        uint8_t        mix_channels;                 // 1 unless this is a mixing extruder
+
         // kept together so they can be passed as public data
         struct {
             float steps_per_millimeter;         // Steps to travel one millimeter
@@ -65,6 +85,18 @@ class Extruder : public Tool {
 
         float travel_ratio;
         float travel_distance;
+        float follow_extrusion;        // totals for all the gcodes on the current block, the robot may merge several moves into one block
+        float follow_travel;
+
+        // pressure advance, the extruder kept ahead in proportion to its speed in FOLLOW mode
+        float pressure_advance;        // seconds, 0 disables it
+        float pressure_advance_smooth_time;
+        PressureAdvance advance;
+
+        float max_volumetric_flow;     // mm³/s, 0 disables it
+        float max_volumetric_flow_diameter; // mm, filament diameter the flow is worked out with, 0 uses filament_diameter
+        ExtruderPlan planned;          // E as the gcodes are queued, target_position is only updated when they execute
+        ExtruderPlan saved_plan;       // put back after a dry run
 
         // for firmware retract
         float retract_feedrate;
@@ -77,6 +109,8 @@ class Extruder : public Tool {
             char mode:3;        // extruder motion mode,  OFF, SOLO, or FOLLOW
             bool absolute_mode:1; // absolute/relative coordinate mode switch
             bool saved_absolute_mode:1;
+            bool coordinated:1;   // stepping as a follower of the Stepper's current block
+            bool advancing:1;     // the current block is stepped with pressure advance
             bool paused:1;
             bool single_config:1;
             bool retracted:1;
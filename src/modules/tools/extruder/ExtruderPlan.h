@@ -0,0 +1,43 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EXTRUDERPLAN_H
+#define EXTRUDERPLAN_H
+
+#include "Gcode.h"
+
+// E position and mode as the gcodes are queued, the extruder's own only change when they execute,
+// but the robot needs to know how much a move extrudes when it plans it.
+// A dry run, like the estimate command, plans the same gcodes without queueing them for the extruder.
+struct ExtruderPlan {
+    float position;     // E position of the last gcode queued
+    bool absolute;      // E is where a move ends rather than how far it goes
+
+    // how far a move with E moves the filament
+    float extrusion(Gcode *gcode) const {
+        float e = gcode->get_value('E');
+        return absolute ? e - position : e;
+    }
+
+    // moves and G92 only count for the active extruder, the modes are global to all of them
+    void plan(Gcode *gcode, bool enabled) {
+        if(gcode->has_m) {
+            if(gcode->m == 82 || gcode->m == 83) absolute = (gcode->m == 82);
+        } else if(gcode->has_g) {
+            if(gcode->g == 90 || gcode->g == 91) {
+                absolute = (gcode->g == 90);
+            } else if(enabled && gcode->g == 92) {
+                if(gcode->has_letter('E')) position = gcode->get_value('E');
+                else if(gcode->get_num_args() == 0) position = 0;
+            } else if(enabled && gcode->g < 4 && gcode->has_letter('E')) {
+                position += extrusion(gcode);
+            }
+        }
+    }
+};
+
+#endif
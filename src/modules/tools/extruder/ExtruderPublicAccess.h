@@ -0,0 +1,21 @@
+#ifndef __EXTRUDERPUBLICACCESS_H_
+#define __EXTRUDERPUBLICACCESS_H_
+
+class Gcode;
+
+// addresses used for public data access
+#define extruder_checksum                    CHECKSUM("extruder")
+#define follow_speed_limit_checksum          CHECKSUM("follow_speed_limit")
+// for a dry run, the gcodes that change E are planned without queueing anything, and the plan is put back after
+#define plan_gcode_checksum                  CHECKSUM("plan_gcode")
+#define save_plan_checksum                   CHECKSUM("save_plan")
+#define restore_plan_checksum                CHECKSUM("restore_plan")
+
+// set by the robot for a move with E, the active extruder lowers max_speed to what it and the hotend can keep up with
+struct pad_extruder_follow {
+    Gcode *gcode;
+    float millimeters;  // length of the robot's move
+    float max_speed;    // mm/s
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PressureAdvance.h"
+
+PressureAdvance::PressureAdvance()
+{
+    this->k = 0;
+    this->smooth = 1.0F;
+    this->gain = 0;
+    this->ticks_per_second = 1000;
+    this->lead = 0;
+    this->lead0 = 0;
+    this->direction = 1.0F;
+    this->mm_per_step = 0;
+    this->spread = 0;
+    this->steps_event_count = 0;
+    this->advance = 0;
+    this->ref = 0;
+    this->feed = 0;
+    this->min_feed = 0;
+    this->robot_rate = 0;
+    this->robot_stepped = 0;
+}
+
+void PressureAdvance::configure(float k, float smooth_time, float ticks_per_second)
+{
+    this->k = k;
+    this->ticks_per_second = ticks_per_second;
+    float ticks = smooth_time * ticks_per_second;
+    this->smooth = (ticks > 1.0F) ? 1.0F / ticks : 1.0F;
+    // errors are corrected over a couple of ticks, or over the smoothing time so the correction does not undo it
+    this->gain = ticks_per_second / ((ticks > 1.0F ? ticks : 1.0F) + 1.0F);
+}
+
+float PressureAdvance::take_lead()
+{
+    float l = this->lead;
+    this->lead = 0;
+    this->advance = 0;
+    return l;
+}
+
+float PressureAdvance::begin_block(float distance, float initial_rate, float final_rate, uint32_t steps_event_count, bool hold_lead)
+{
+    this->steps_event_count = steps_event_count;
+    this->mm_per_step = distance / steps_event_count;
+    this->lead0 = this->k * initial_rate * this->mm_per_step;
+
+    float lead_start = this->lead;
+    float lead1 = this->k * final_rate * this->mm_per_step;
+    // the lead is all taken back by the end of a block the next one does not extrude after, or it would ooze on the travel.
+    // it may go back faster than the block extrudes, then the extruder retracts over the block
+    float lead_end = hold_lead ? lead1 : 0.0F;
+
+    // the rates account for lead1 - lead0, a jump in extrusion per step between blocks is spread over the block
+    this->spread = ((lead_end - lead_start) - (lead1 - this->lead0)) / steps_event_count;
+    this->lead = lead_end;
+
+    float move = distance + lead_end - lead_start;
+    this->direction = (move < 0.0F) ? -1.0F : 1.0F;
+
+    this->ref = 0;
+    this->robot_rate = initial_rate;
+    this->robot_stepped = 0;
+    this->feed = (this->mm_per_step + this->spread) * initial_rate + this->advance * this->mm_per_step;
+    this->min_feed = 0;
+    return move;
+}
+
+void PressureAdvance::tick(float robot_rate, uint32_t robot_stepped, float rate_delta, int phase)
+{
+    float target = phase * rate_delta * this->ticks_per_second * this->k;
+    this->advance += (target - this->advance) * this->smooth;
+
+    this->robot_rate = robot_rate;
+    this->robot_stepped = robot_stepped;
+    // where the extruder would be with no smoothing, it reaches the block's steps as the axes reach theirs
+    this->ref = (this->mm_per_step + this->spread) * robot_stepped + this->k * robot_rate * this->mm_per_step - this->lead0;
+    this->feed = (this->mm_per_step + this->spread) * robot_rate + this->advance * this->mm_per_step;
+    // never slow down so much that the extruder stops behind the robot
+    this->min_feed = rate_delta * this->mm_per_step;
+}
+
+float PressureAdvance::motor_rate(float steps_per_mm, uint32_t stepped, uint32_t steps_to_move) const
+{
+    // the motor only turns one way within a block, the rate is towards the block's move
+    float position = this->direction * stepped / steps_per_mm;
+    float rate = this->direction * (this->feed + (this->ref - position) * this->gain) * steps_per_mm;
+
+    // keep up with what is left of the block at the robot's current rate, the block is only done when we are
+    if(this->robot_stepped < this->steps_event_count) {
+        float needed = (float)(steps_to_move - stepped) * this->robot_rate / (this->steps_event_count - this->robot_stepped);
+        if(rate < needed) rate = needed;
+    }
+
+    float min_rate = this->min_feed * steps_per_mm;
+    return rate > min_rate ? rate : min_rate;
+}
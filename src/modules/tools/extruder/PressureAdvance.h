@@ -0,0 +1,70 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PRESSUREADVANCE_H
+#define PRESSUREADVANCE_H
+
+#include <stdint.h>
+
+// Pressure advance for an extruder that follows the robot: the filament is kept k * its speed ahead of where it
+// would be without it, the lead, so the nozzle pressure builds up and drops with the robot's speed.
+//
+// Each block gets the steps it extrudes plus the change in lead over it, the lead at its end being k times the
+// extruder speed at the block's exit rate, or 0 when the next block does not extrude. So the lead carries from block
+// to block through a ramp that spans many short blocks, it is all taken back by a stop or a travel move, retracting
+// if a decelerating block does not extrude enough for that, and the extruder still finishes each block with the axes.
+// Within a block the extruder follows a reference position worked out from the robot's progress and rate, with a
+// feed forward of the robot's rate plus k times its acceleration, which can be smoothed, and a correction towards
+// the reference. If it ever falls behind what is left of the block it speeds up so the axes never wait for it.
+//
+// Only plain arithmetic, so it can be simulated on a host.
+class PressureAdvance {
+    public:
+        PressureAdvance();
+
+        // k in seconds, 0 disables it, the acceleration term is smoothed over smooth_time seconds
+        void configure(float k, float smooth_time, float ticks_per_second);
+        bool enabled() const { return k > 0.0F; }
+
+        // the lead at the end of the last block, in mm of filament, given back and cleared when the path was cut short,
+        // or when a block does not extrude without the one before it knowing
+        float take_lead();
+
+        // a block that extrudes distance mm as the robot goes from initial_rate to final_rate over steps_event_count
+        // steps, hold_lead is false when the block after it does not extrude. returns the mm to actually move,
+        // less than 0 is a retract
+        float begin_block(float distance, float initial_rate, float final_rate, uint32_t steps_event_count, bool hold_lead);
+
+        // every acceleration tick, with the robot's rate and steps done in the block, and the acceleration it is
+        // ramping at, rate_delta per tick signed by the trapezoid phase
+        void tick(float robot_rate, uint32_t robot_stepped, float rate_delta, int phase);
+
+        // steps/sec for a motor doing steps_per_mm steps per mm of the extrusion, stepped of its steps_to_move so far
+        float motor_rate(float steps_per_mm, uint32_t stepped, uint32_t steps_to_move) const;
+
+    private:
+        float k;
+        float smooth;          // factor applied every tick, 1 is no smoothing
+        float gain;            // per second, how fast the extruder is pulled back to the reference
+        float ticks_per_second;
+
+        float lead;            // mm ahead of the nominal extrusion at the end of the current block
+        float lead0;           // k * extruder speed at the block's initial rate, where the reference starts
+        float direction;       // 1 or -1, the way the motor turns in this block
+        float mm_per_step;     // nominal extrusion per robot step
+        float spread;          // mm per robot step, the lead change the robot's rate change does not account for
+        uint32_t steps_event_count;
+
+        float advance;         // smoothed k * robot acceleration, robot steps/sec
+        float ref;             // mm the extruder should have moved in this block
+        float feed;            // mm/sec it should be moving at
+        float min_feed;        // mm/sec it never goes under
+        float robot_rate;
+        uint32_t robot_stepped;
+};
+
+#endif
@@ -0,0 +1,24 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STEPCARRY_H
+#define STEPCARRY_H
+
+#include <math.h>
+
+// Whole steps for a motor to move distance mm in a block, negative is backwards. The fraction of a step left over is
+// kept in unstepped and added to the next block, so the steps add up to the total distance however it is split.
+inline int carry_steps(float distance, float &unstepped, float steps_per_mm)
+{
+    float total = distance + unstepped;
+    // round towards zero, the rest is carried
+    int steps = (total >= 0.0F) ? floorf(total * steps_per_mm) : ceilf(total * steps_per_mm);
+    unstepped = total - steps / steps_per_mm;
+    return steps;
+}
+
+#endif
@@ -14,6 +14,7 @@
 #include "PublicData.h"
 #include "StreamOutputPool.h"
 #include "StreamOutput.h"
+#include "Scheduler.h"
 #include "SerialMessage.h"
 #include "FilamentDetector.h"
 #include "utils.h"
@@ -83,7 +84,7 @@ void FilamentDetector::on_module_loaded()
 
     // register event-handlers
     register_for_event(ON_SECOND_TICK);
-    register_for_event(ON_MAIN_LOOP);
+    THEKERNEL->scheduler->add_task("filament", [](void *detector) { static_cast<FilamentDetector *>(detector)->on_main_loop(nullptr); }, this, Scheduler::NORMAL_PRIORITY);
     register_for_event(ON_CONSOLE_LINE_RECEIVED);
     this->register_for_event(ON_GCODE_RECEIVED);
 }
@@ -64,11 +64,12 @@ void Laser::on_module_loaded() {
 
     //register for events
     this->register_for_event(ON_GCODE_EXECUTE);
-    this->register_for_event(ON_SPEED_CHANGE);
     this->register_for_event(ON_PLAY);
     this->register_for_event(ON_PAUSE);
     this->register_for_event(ON_BLOCK_BEGIN);
     this->register_for_event(ON_BLOCK_END);
+
+    THEKERNEL->stepper->register_rate_listener(&Laser::rate_changed, this);
 }
 
 // Turn laser off laser at the end of a move
@@ -112,16 +113,20 @@ void Laser::on_gcode_execute(void* argument){
 }
 
 // We follow the stepper module here, so speed must be proportional
-void Laser::on_speed_change(void* argument){
-    if( this->laser_on ){
-        this->set_proportional_power();
-    }
+// called from the acceleration tick interrupt
+void Laser::rate_changed(void *laser, float steps_per_second){
+    static_cast<Laser*>(laser)->set_proportional_power(steps_per_second);
 }
 
 void Laser::set_proportional_power(){
-    if( this->laser_on && THEKERNEL->stepper->get_current_block() ){
+    this->set_proportional_power(THEKERNEL->stepper->get_trapezoid_adjusted_rate());
+}
+
+void Laser::set_proportional_power(float steps_per_second){
+    const Block *block = THEKERNEL->stepper->get_current_block();
+    if( this->laser_on && block != nullptr && block->nominal_rate > 0 ){
         // adjust power to maximum power and actual velocity
-        float proportional_power = float(float(this->laser_max_power) * float(THEKERNEL->stepper->get_trapezoid_adjusted_rate()) / float(THEKERNEL->stepper->get_current_block()->nominal_rate));
+        float proportional_power = this->laser_max_power * steps_per_second / block->nominal_rate;
         this->laser_pin->write(this->laser_inverting ? 1 - proportional_power : proportional_power);
     }
 }
@@ -24,10 +24,11 @@ class Laser : public Module{
         void on_play(void* argument);
         void on_pause(void* argument);
         void on_gcode_execute(void* argument);
-        void on_speed_change(void* argument);
 
     private:
+        static void rate_changed(void *laser, float steps_per_second);
         void set_proportional_power();
+        void set_proportional_power(float steps_per_second);
         mbed::PwmOut *laser_pin;    // PWM output to regulate the laser power
         struct {
             bool laser_on:1;     // Laser status
@@ -112,7 +112,10 @@ void Spindle::on_module_loaded()
     }
     
     THEKERNEL->slow_ticker->attach(UPDATE_FREQ, this, &Spindle::on_update_speed);
-    register_for_event(ON_GCODE_RECEIVED);
+    register_for_gcode('M', 3);
+    register_for_gcode('M', 5);
+    register_for_gcode('M', 957);
+    register_for_gcode('M', 958);
     register_for_event(ON_GCODE_EXECUTE);
 }
 
@@ -53,13 +53,19 @@ void Switch::on_module_loaded()
 {
     this->switch_changed = false;
 
-    this->register_for_event(ON_GCODE_RECEIVED);
-    this->register_for_event(ON_MAIN_LOOP);
+    // the outputs are only updated when the switch changes
+    this->output_task = THEKERNEL->scheduler->add_task("switch", [](void *sw) { static_cast<Switch *>(sw)->on_main_loop(nullptr); }, this, Scheduler::NORMAL_PRIORITY, Scheduler::ON_DEMAND);
     this->register_for_event(ON_GET_PUBLIC_DATA);
     this->register_for_event(ON_SET_PUBLIC_DATA);
 
     // Settings
     this->on_config_reload(this);
+
+    // only the on and off commands are of any interest
+    if(input_on_command_letter != 0) this->register_for_gcode(input_on_command_letter, input_on_command_code);
+    if(input_off_command_letter != 0 && !(input_off_command_letter == input_on_command_letter && input_off_command_code == input_on_command_code)) {
+        this->register_for_gcode(input_off_command_letter, input_off_command_code);
+    }
 }
 
 
@@ -280,11 +286,13 @@ void Switch::on_set_public_data(void *argument)
         this->switch_state = t;
         pdr->set_taken();
         this->switch_changed= true;
+        THEKERNEL->scheduler->wake(this->output_task);
 
     } else if(pdr->third_element_is(value_checksum)) {
         float t = *static_cast<float *>(pdr->get_data_ptr());
         this->switch_value = t;
         this->switch_changed= true;
+        THEKERNEL->scheduler->wake(this->output_task);
         pdr->set_taken();
     }
 }
@@ -357,6 +365,7 @@ void Switch::flip()
 {
     this->switch_state = !this->switch_state;
     this->switch_changed = true;
+    THEKERNEL->scheduler->wake(this->output_task);
 }
 
 void Switch::send_gcode(std::string msg, StreamOutput *stream)
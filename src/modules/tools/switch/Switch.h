@@ -10,6 +10,7 @@
 
 #include "Pin.h"
 #include "Pwm.h"
+#include "Scheduler.h"
 #include <math.h>
 
 #include <string>
@@ -52,6 +53,7 @@ class Switch : public Module {
         };
         string    output_on_command;
         string    output_off_command;
+        Scheduler::Task *output_task;
         uint16_t  name_checksum;
         uint16_t  input_pin_behavior;
         uint16_t  input_on_command_code;
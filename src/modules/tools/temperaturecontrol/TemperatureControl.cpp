@@ -9,6 +9,7 @@
 
 #include "libs/Module.h"
 #include "libs/Kernel.h"
+#include "libs/Scheduler.h"
 #include <math.h>
 #include "TemperatureControl.h"
 #include "TemperatureControlPool.h"
@@ -95,7 +96,7 @@ void TemperatureControl::on_module_loaded()
 
     if(!this->readonly) {
         this->register_for_event(ON_SECOND_TICK);
-        this->register_for_event(ON_MAIN_LOOP);
+        THEKERNEL->scheduler->add_task("temperature", [](void *control) { static_cast<TemperatureControl *>(control)->on_main_loop(nullptr); }, this, Scheduler::LOW_PRIORITY, 100);
         this->register_for_event(ON_SET_PUBLIC_DATA);
         this->register_for_event(ON_HALT);
     }
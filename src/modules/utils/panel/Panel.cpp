@@ -6,6 +6,7 @@
 */
 
 #include "libs/Kernel.h"
+#include "libs/Scheduler.h"
 #include "Panel.h"
 #include "PanelScreen.h"
 
@@ -189,7 +190,7 @@ void Panel::on_module_loaded()
 
     // Register for events
     this->register_for_event(ON_IDLE);
-    this->register_for_event(ON_MAIN_LOOP);
+    THEKERNEL->scheduler->add_task("panel", [](void *panel) { static_cast<Panel *>(panel)->on_main_loop(nullptr); }, this, Scheduler::LOW_PRIORITY);
     this->register_for_event(ON_HALT);
     this->register_for_event(ON_SET_PUBLIC_DATA);
 
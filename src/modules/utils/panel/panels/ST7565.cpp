@@ -13,6 +13,7 @@
 #include "checksumm.h"
 #include "StreamOutputPool.h"
 #include "ConfigValue.h"
+#include "SPIDMA.h"
 
 
 
@@ -85,6 +86,8 @@ ST7565::ST7565(uint8_t variant)
 
     this->spi = new mbed::SPI(mosi, miso, sclk);
     this->spi->frequency(THEKERNEL->config->value(panel_checksum, spi_frequency_checksum)->by_default(1000000)->as_number()); //4Mhz freq, can try go a little lower
+    this->dma = new SPIDMA(mosi, miso, sclk); // not available if the sdcard is on the same port
+    this->pic_page = LCDPAGES;
 
     //chip select
     this->cs.from_string(THEKERNEL->config->value( panel_checksum, spi_cs_pin_checksum)->by_default("0.16")->as_string())->as_output();
@@ -153,6 +156,8 @@ ST7565::ST7565(uint8_t variant)
 
 ST7565::~ST7565()
 {
+    wait_pic();
+    delete this->dma;
     delete this->spi;
     AHB0.dealloc(framebuffer);
 }
@@ -160,6 +165,7 @@ ST7565::~ST7565()
 //send commands to lcd
 void ST7565::send_commands(const unsigned char *buf, size_t size)
 {
+    wait_pic();
     cs.set(0);
     a0.set(0);
     while(size-- > 0) {
@@ -171,6 +177,7 @@ void ST7565::send_commands(const unsigned char *buf, size_t size)
 //send data to lcd
 void ST7565::send_data(const unsigned char *buf, size_t size)
 {
+    wait_pic();
     cs.set(0);
     a0.set(1);
     while(size-- > 0) {
@@ -183,6 +190,7 @@ void ST7565::send_data(const unsigned char *buf, size_t size)
 //clearing screen
 void ST7565::clear()
 {
+    wait_pic(); // otherwise part of the blank screen can go out
     memset(framebuffer, 0, FB_SIZE);
     this->tx = 0;
     this->ty = 0;
@@ -190,12 +198,57 @@ void ST7565::clear()
 
 void ST7565::send_pic(const unsigned char *data)
 {
+    if(this->dma->available()) {
+        // skip this refresh if the last one is still going out
+        if(this->pic_page < LCDPAGES) return;
+        this->pic = data;
+        this->pic_page = 0;
+        send_page();
+        return;
+    }
+
     for (int i = 0; i < LCDPAGES; i++) {
         set_xy(0, i);
         send_data(data + i * LCDWIDTH, LCDWIDTH);
     }
 }
 
+// position the page then let the DMA send it, page_sent starts the next one
+void ST7565::send_page()
+{
+    unsigned char cmd[3];
+    cmd[0] = 0xb0 | (this->pic_page & 0x07);
+    cmd[1] = 0x10;
+    cmd[2] = 0x00;
+    cs.set(0);
+    a0.set(0);
+    for (int i = 0; i < 3; i++) {
+        spi->write(cmd[i]);
+    }
+    a0.set(1);
+    if(!this->dma->start(this->pic + this->pic_page * LCDWIDTH, NULL, LCDWIDTH, page_sent, this)) {
+        cs.set(1);
+        a0.set(0);
+        this->pic_page = LCDPAGES;
+    }
+}
+
+// called from the DMA interrupt
+void ST7565::page_sent(void *object)
+{
+    ST7565 *lcd = static_cast<ST7565 *>(object);
+    lcd->cs.set(1);
+    lcd->a0.set(0);
+    if(++lcd->pic_page < LCDPAGES) lcd->send_page();
+}
+
+void ST7565::wait_pic()
+{
+    while(this->pic_page < LCDPAGES) {
+        this->dma->wait();
+    }
+}
+
 // set column and page number
 void ST7565::set_xy(int x, int y)
 {
@@ -12,6 +12,8 @@
 #include "mbed.h"
 #include "libs/Pin.h"
 
+class SPIDMA;
+
 class ST7565: public LcdBase {
 public:
 	ST7565(uint8_t v= 0);
@@ -55,10 +57,17 @@ public:
     void setLed(int led, bool onoff);
 
 private:
+    // the picture goes out a page at a time from the DMA interrupt when the SPI port has DMA
+    void send_page();
+    static void page_sent(void *object);
+    void wait_pic();
 
     //buffer
 	unsigned char *framebuffer;
 	mbed::SPI* spi;
+	SPIDMA* dma;
+	const unsigned char* pic;
+	volatile uint8_t pic_page;
 	Pin cs;
 	Pin rst;
 	Pin a0;
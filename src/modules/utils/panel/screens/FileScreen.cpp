@@ -117,10 +117,12 @@ void FileScreen::clicked_line(uint16_t line)
 }
 
 // only filter files that have a .g, .ngc or .nc in them and does not start with a .
+// the .idx index the player keeps next to a gcode file is not one
 bool FileScreen::filter_file(const char *f)
 {
     string fn= lc(f);
     return (fn.at(0) != '.') &&
+             (fn.size() < 4 || fn.compare(fn.size() - 4, 4, ".idx") != 0) &&
              ((fn.find(".g") != string::npos) ||
               (fn.find(".ngc") != string::npos) ||
               (fn.find(".nc") != string::npos));
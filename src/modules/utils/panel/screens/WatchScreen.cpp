@@ -62,6 +62,8 @@ WatchScreen::WatchScreen()
     issue_change_speed = false;
     ipstr = nullptr;
     update_counts= 0;
+    remaining_time = 0;
+    layer = layers = 0;
 }
 
 WatchScreen::~WatchScreen()
@@ -240,11 +242,16 @@ void WatchScreen::get_sd_play_info()
         struct pad_progress p =  *static_cast<struct pad_progress *>(returned_data);
         this->elapsed_time = p.elapsed_secs;
         this->sd_pcnt_played = p.percent_complete;
+        this->remaining_time = p.remaining_secs;
+        this->layer = p.layer;
+        this->layers = p.layers;
         THEPANEL->set_playing_file(p.filename);
 
     } else {
         this->elapsed_time = 0;
         this->sd_pcnt_played = 0;
+        this->remaining_time = 0;
+        this->layer = this->layers = 0;
     }
 }
 
@@ -302,8 +309,18 @@ const char *WatchScreen::get_status()
     if (THEPANEL->is_suspended())
         return "Suspended";
 
-    if (THEPANEL->is_playing())
+    if (THEPANEL->is_playing()) {
+        // alternate every 5 seconds with the layer and time left when there are any
+        if ((this->layers > 0 || this->remaining_time > 0) && (update_counts / 100) % 2) {
+            int n = 0;
+            if (this->layers > 0)
+                n = snprintf(this->progressstr, sizeof(this->progressstr), "L%u/%u ", this->layer, this->layers);
+            if (this->remaining_time > 0)
+                snprintf(this->progressstr + n, sizeof(this->progressstr) - n, "%lu:%02lu left", this->remaining_time / 3600, (this->remaining_time / 60) % 60);
+            return this->progressstr;
+        }
         return THEPANEL->get_playing_file();
+    }
 
     if (!THEKERNEL->conveyor->is_queue_empty())
         return "Printing";
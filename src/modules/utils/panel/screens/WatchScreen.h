@@ -37,7 +37,11 @@ private:
     float pos[3];
     unsigned long elapsed_time;
     unsigned int sd_pcnt_played;
+    unsigned long remaining_time;
+    unsigned int layer;
+    unsigned int layers;
     char *ipstr;
+    char progressstr[20];
 
     struct {
         bool speed_changed:1;
@@ -0,0 +1,513 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GcodeIndex.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include <limits.h>
+
+#define X_AXIS 0
+#define Y_AXIS 1
+#define Z_AXIS 2
+
+static const char index_magic[4] = {'S', 'G', 'I', 'X'};
+
+static_assert(sizeof(GcodeIndex::header_t) == 36, "index header must be 36 bytes");
+static_assert(sizeof(GcodeIndex::entry_t) == 24, "index entry must be 24 bytes");
+
+GcodeIndex::GcodeIndex()
+{
+    this->file = NULL;
+    this->cache_valid = false;
+    this->cached_index = 0;
+    memset(&this->header, 0, sizeof(this->header));
+}
+
+GcodeIndex::~GcodeIndex()
+{
+    close();
+}
+
+bool GcodeIndex::open(const string &gcode_path, unsigned long source_size)
+{
+    close();
+
+    this->file = fopen(path_for(gcode_path).c_str(), "r");
+    if(this->file == NULL) return false;
+    // entries are read one at a time from all over the file, a stdio buffer would only get refilled each time
+    setvbuf(this->file, NULL, _IONBF, 0);
+
+    if(fread(&this->header, sizeof(this->header), 1, this->file) != 1 ||
+       memcmp(this->header.magic, index_magic, sizeof(index_magic)) != 0 ||
+       this->header.version != version ||
+       this->header.source_size != source_size ||
+       this->header.entries == 0) {
+        close();
+        return false;
+    }
+
+    // the size alone misses an edit that keeps it
+    FILE *gcode = fopen(gcode_path.c_str(), "r");
+    bool same = gcode != NULL && check_of(gcode) == this->header.source_check;
+    if(gcode != NULL) fclose(gcode);
+    if(!same) {
+        close();
+        return false;
+    }
+
+    this->cache_valid = false;
+    return true;
+}
+
+uint32_t GcodeIndex::check_of(FILE *gcode)
+{
+    uint32_t hash = 2166136261U;
+    long size = 0;
+    if(fseek(gcode, 0, SEEK_END) == 0) size = ftell(gcode);
+    // the last block is only read when it does not overlap the first
+    long starts[2] = {0, size > 1024 ? size - 512 : 512};
+    for (int b = 0; b < 2; b++) {
+        if(starts[b] >= size || fseek(gcode, starts[b], SEEK_SET) != 0) break;
+        char buf[512];
+        size_t n = fread(buf, 1, sizeof(buf), gcode);
+        for (size_t i = 0; i < n; i++) hash = (hash ^ (uint8_t)buf[i]) * 16777619U;
+    }
+    fseek(gcode, 0, SEEK_SET);
+    return hash;
+}
+
+void GcodeIndex::close()
+{
+    if(this->file != NULL) {
+        fclose(this->file);
+        this->file = NULL;
+    }
+    this->cache_valid = false;
+}
+
+bool GcodeIndex::read_entry(uint32_t i, entry_t &entry)
+{
+    if(this->file == NULL || i >= this->header.entries) return false;
+    if(fseek(this->file, sizeof(header_t) + i * sizeof(entry_t), SEEK_SET) != 0) return false;
+    return fread(&entry, sizeof(entry_t), 1, this->file) == 1;
+}
+
+// binary search for the last entry at or before line or offset, the first entry is always line 0 at offset 0
+bool GcodeIndex::find(unsigned long key, bool by_offset, entry_t &entry)
+{
+    if(this->file == NULL) return false;
+
+    uint32_t lo = 0, hi = this->header.entries - 1;
+    while(lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if(!read_entry(mid, entry)) return false;
+        if((by_offset ? entry.offset : entry.line) <= key) lo = mid;
+        else hi = mid - 1;
+    }
+
+    this->cached_index = lo;
+    return read_entry(lo, entry);
+}
+
+// binary search for the first entry of the layer, layer numbers never go down through the file
+bool GcodeIndex::find_layer(unsigned int layer, entry_t &entry)
+{
+    if(this->file == NULL || layer == 0 || layer > this->header.layers) return false;
+
+    uint32_t lo = 0, hi = this->header.entries - 1;
+    while(lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if(!read_entry(mid, entry)) return false;
+        if(entry.layer < layer) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return read_entry(lo, entry) && entry.layer == layer && (entry.flags & layer_start);
+}
+
+float GcodeIndex::time_at(unsigned long line)
+{
+    if(this->file == NULL) return 0;
+
+    // progress asks for nearby lines over and over, so keep the entries either side of the last one
+    if(!this->cache_valid || line < this->cached[0].line || line >= this->cached[1].line) {
+        this->cache_valid = false;
+        if(!find(line, false, this->cached[0])) return 0;
+        if(!read_entry(this->cached_index + 1, this->cached[1])) {
+            // past the last entry, the end of the file is the other side
+            this->cached[1].line = this->header.lines;
+            this->cached[1].time = this->header.total_time;
+        }
+        this->cache_valid = true;
+    }
+
+    const entry_t &a = this->cached[0];
+    const entry_t &b = this->cached[1];
+    if(line >= b.line || b.line <= a.line) return line >= b.line ? b.time : a.time;
+    return a.time + (b.time - a.time) * (line - a.line) / (b.line - a.line);
+}
+
+GcodeIndexer::GcodeIndexer()
+{
+    this->gcode = NULL;
+    this->index = NULL;
+    this->finished_ok = false;
+    this->batch_count = 0;
+    this->held_count = 0;
+}
+
+GcodeIndexer::~GcodeIndexer()
+{
+    abort();
+}
+
+bool GcodeIndexer::start(const string &gcode_path, uint16_t interval, float feed_rate, float seek_rate)
+{
+    abort();
+    this->finished_ok = false;
+    this->path = gcode_path;
+
+    this->gcode = fopen(gcode_path.c_str(), "r");
+    if(this->gcode == NULL) return false;
+
+    memset(&this->header, 0, sizeof(this->header));
+    this->header.version = GcodeIndex::version;
+    this->header.interval = interval > 0 ? interval : 1;
+    if(fseek(this->gcode, 0, SEEK_END) == 0) {
+        this->header.source_size = ftell(this->gcode);
+        fseek(this->gcode, 0, SEEK_SET);
+    }
+    this->header.source_check = GcodeIndex::check_of(this->gcode);
+
+    this->index = fopen(GcodeIndex::path_for(gcode_path).c_str(), "w");
+    if(this->index == NULL || !this->reader.start(this->gcode, 2)) {
+        abort();
+        return false;
+    }
+    // the entries are offsets into the gcode a compressed file decompresses to, and it is that size the player checks
+    if(this->reader.compressed()) this->header.source_size = this->reader.content_size();
+    setvbuf(this->index, NULL, _IONBF, 0);
+
+    // the magic is still zero, so this is not a valid index until finish() rewrites it
+    if(fwrite(&this->header, sizeof(this->header), 1, this->index) != 1) {
+        abort();
+        return false;
+    }
+
+    this->batch_count = 0;
+    this->held_count = 0;
+    this->last_added_line = ULONG_MAX;
+    this->next_entry_line = 0;
+    this->position[X_AXIS] = this->position[Y_AXIS] = this->position[Z_AXIS] = 0;
+    this->e_position = 0;
+    this->layer_z = NAN;
+    this->time = 0;
+    this->feed_rate = feed_rate;
+    this->seek_rate = seek_rate;
+    this->units = 1;
+    this->layer = 0;
+    this->motion = -1;
+    this->absolute = true;
+    this->e_absolute = true;
+    this->layer_pending = false;
+    this->layer_comments = false;
+    return true;
+}
+
+// closes everything, an unfinished index file is removed
+void GcodeIndexer::abort()
+{
+    this->reader.stop();
+    if(this->gcode != NULL) {
+        fclose(this->gcode);
+        this->gcode = NULL;
+    }
+    if(this->index != NULL) {
+        fclose(this->index);
+        this->index = NULL;
+        remove(GcodeIndex::path_for(this->path).c_str());
+    }
+}
+
+bool GcodeIndexer::step(unsigned int max_lines)
+{
+    if(this->gcode == NULL) return false;
+
+    for (unsigned int i = 0; i < max_lines; i++) {
+        size_t len;
+        bool too_long;
+        char *line = this->reader.next_line(len, too_long);
+        if(line == NULL) {
+            this->finished_ok = finish();
+            return false;
+        }
+        // lines too long to be played are counted but not parsed, the player skips them too
+        parse(line, this->reader.line() - 1, this->reader.offset_of(line));
+    }
+
+    if(this->index == NULL) {
+        // a write failed
+        abort();
+        return false;
+    }
+    return true;
+}
+
+bool GcodeIndexer::finish()
+{
+    // a layer change that was never confirmed is dropped, the entries held for it are not
+    this->layer_pending = false;
+    flush_held();
+    bool ok = write_entries();
+
+    this->header.lines = this->reader.line();
+    this->header.total_time = this->time;
+    memcpy(this->header.magic, index_magic, sizeof(index_magic));
+    ok = ok && fseek(this->index, 0, SEEK_SET) == 0 && fwrite(&this->header, sizeof(this->header), 1, this->index) == 1;
+
+    if(!ok) {
+        abort();
+        return false;
+    }
+
+    this->reader.stop();
+    fclose(this->gcode);
+    this->gcode = NULL;
+    fclose(this->index);
+    this->index = NULL;
+    return true;
+}
+
+bool GcodeIndexer::write_entries()
+{
+    if(this->index == NULL) return false;
+    if(this->batch_count > 0 && fwrite(this->batch, sizeof(GcodeIndex::entry_t), this->batch_count, this->index) != (size_t)this->batch_count) {
+        fclose(this->index);
+        this->index = NULL;
+        remove(GcodeIndex::path_for(this->path).c_str());
+        this->batch_count = 0;
+        return false;
+    }
+    this->header.entries += this->batch_count;
+    this->batch_count = 0;
+    return true;
+}
+
+void GcodeIndexer::push(const GcodeIndex::entry_t &entry)
+{
+    this->batch[this->batch_count++] = entry;
+    this->last_added_line = entry.line;
+    if(this->batch_count == batch_max) write_entries();
+}
+
+void GcodeIndexer::flush_held()
+{
+    for (int i = 0; i < this->held_count; i++) push(this->held[i]);
+    this->held_count = 0;
+}
+
+void GcodeIndexer::add_entry(const GcodeIndex::entry_t &entry)
+{
+    if(this->layer_pending) {
+        if(this->held_count < held_max) {
+            this->held[this->held_count++] = entry;
+            this->last_added_line = entry.line;
+            return;
+        }
+        // too long to be a layer change, the layer will start where something is extruded instead
+        this->layer_pending = false;
+        flush_held();
+    }
+    push(entry);
+}
+
+// the pending layer start is confirmed, it goes before the entries held since it was seen
+void GcodeIndexer::start_layer(GcodeIndex::entry_t &entry, float z)
+{
+    this->layer++;
+    this->header.layers++;
+    this->layer_z = z;
+    entry.layer = this->layer;
+    entry.z = z;
+    entry.flags = GcodeIndex::layer_start;
+    push(entry);
+
+    for (int i = 0; i < this->held_count; i++) {
+        if(this->held[i].line == entry.line) continue;
+        this->held[i].layer = this->layer;
+        push(this->held[i]);
+    }
+    this->held_count = 0;
+    this->layer_pending = false;
+}
+
+static bool is_layer_comment(const char *line)
+{
+    while(*line == ' ' || *line == '\t') line++;
+    return strncmp(line, ";LAYER:", 7) == 0 || strncmp(line, ";LAYER_CHANGE", 13) == 0;
+}
+
+void GcodeIndexer::parse(char *line, unsigned long line_no, unsigned long offset)
+{
+    this->line_start = {(uint32_t)line_no, (uint32_t)offset, this->time, this->position[Z_AXIS], this->layer, 0};
+    bool due = line_no >= this->next_entry_line;
+    if(due) this->next_entry_line = (line_no / this->header.interval + 1) * this->header.interval;
+
+    if(is_layer_comment(line)) {
+        // the slicer says where layers start, so there is no need to guess from the moves
+        if(this->layer_pending) {
+            this->layer_pending = false;
+            flush_held();
+        }
+        this->layer_comments = true;
+        start_layer(this->line_start, this->position[Z_AXIS]);
+        return;
+    }
+
+    // comments are dropped, ( ) comments take the rest of the line with them
+    char *c = strpbrk(line, ";(");
+    if(c != NULL) *c = '\0';
+
+    int g = -1, m = -1;
+    float value[3] = {0, 0, 0};
+    bool has[3] = {false, false, false};
+    float e = 0, f = 0, i = NAN, j = 0, p = 0, s = 0;
+    bool has_e = false, has_f = false, has_p = false, has_s = false;
+
+    for (char *cp = line; *cp != '\0';) {
+        char letter = toupper(*cp++);
+        if(!isalpha(letter)) continue;
+        char *end;
+        float v = strtof(cp, &end);
+        if(end == cp) continue;
+        cp = end;
+
+        switch(letter) {
+            case 'G': g = (int)v; break;
+            case 'M': m = (int)v; break;
+            case 'X': case 'Y': case 'Z': value[letter - 'X'] = v * this->units; has[letter - 'X'] = true; break;
+            case 'E': e = v * this->units; has_e = true; break;
+            case 'F': f = v * this->units; has_f = true; break;
+            case 'I': i = v * this->units; if(isnan(j)) j = 0; break;
+            case 'J': j = v * this->units; if(isnan(i)) i = 0; break;
+            case 'P': p = v; has_p = true; break;
+            case 'S': s = v; has_s = true; break;
+        }
+    }
+    bool has_axis = has[X_AXIS] || has[Y_AXIS] || has[Z_AXIS];
+
+    if(m == 82) this->e_absolute = true;
+    else if(m == 83) this->e_absolute = false;
+
+    switch(g) {
+        case 4: // dwell, P is milliseconds, S seconds
+            if(has_p) this->time += p / 1000.0F;
+            else if(has_s) this->time += s;
+            break;
+        case 20: this->units = 25.4F; break;
+        case 21: this->units = 1; break;
+        case 28: // homing, the time it takes is not known
+            for (int a = X_AXIS; a <= Z_AXIS; a++) {
+                if(has[a] || !has_axis) this->position[a] = 0;
+            }
+            break;
+        case 90: this->absolute = this->e_absolute = true; break;
+        case 91: this->absolute = this->e_absolute = false; break;
+        case 92:
+            for (int a = X_AXIS; a <= Z_AXIS; a++) {
+                if(has[a]) this->position[a] = value[a];
+            }
+            if(has_e) this->e_position = e;
+            break;
+        case -1: case 0: case 1: case 2: case 3:
+            // G0 to G3 are modal, so a line of just coordinates is a move too
+            if(g >= 0) this->motion = g;
+            if(m >= 0 || this->motion < 0) break;
+            if(has_f) {
+                if(this->motion == 0) this->seek_rate = f;
+                else this->feed_rate = f;
+            }
+            if(has_axis || has_e) {
+                float target[3];
+                for (int a = X_AXIS; a <= Z_AXIS; a++) {
+                    target[a] = !has[a] ? this->position[a] : this->absolute ? value[a] : this->position[a] + value[a];
+                }
+                move(target, e, has_e, i, j);
+            }
+            break;
+    }
+
+    if(due && this->last_added_line != line_no) {
+        // a line that confirmed a layer change is part of the new layer
+        this->line_start.layer = this->layer;
+        add_entry(this->line_start);
+    }
+}
+
+// adds the time a move takes, and works out where layers start, i is NAN when an arc has no center
+void GcodeIndexer::move(const float *target, float e, bool has_e, float i, float j)
+{
+    float dx = target[X_AXIS] - this->position[X_AXIS];
+    float dy = target[Y_AXIS] - this->position[Y_AXIS];
+    float dz = target[Z_AXIS] - this->position[Z_AXIS];
+    float de = has_e ? (this->e_absolute ? e - this->e_position : e) : 0;
+
+    float distance;
+    if((this->motion == 2 || this->motion == 3) && !isnan(i)) {
+        // arc around the center at I J from the start
+        float cx = this->position[X_AXIS] + i, cy = this->position[Y_AXIS] + j;
+        float radius = hypotf(i, j);
+        float sweep = atan2f(target[Y_AXIS] - cy, target[X_AXIS] - cx) - atan2f(-j, -i);
+        if(this->motion == 2 && sweep >= 0) sweep -= 2 * M_PI;
+        else if(this->motion == 3 && sweep <= 0) sweep += 2 * M_PI;
+        distance = hypotf(fabsf(sweep) * radius, dz);
+    } else {
+        distance = sqrtf(dx * dx + dy * dy + dz * dz);
+    }
+    if(distance == 0) distance = fabsf(de); // retract or prime
+
+    float rate = this->motion == 0 ? this->seek_rate : this->feed_rate;
+    if(rate > 0) this->time += distance * 60.0F / rate;
+
+    if(!this->layer_comments) {
+        if(dz != 0 && !this->layer_pending) {
+            // the first Z move after extruding may be a layer change, or just a hop
+            this->layer_pending = true;
+            this->pending_layer = this->line_start;
+        }
+
+        if(de > 0) {
+            if(this->layer_pending) {
+                if(target[Z_AXIS] != this->layer_z) {
+                    start_layer(this->pending_layer, target[Z_AXIS]);
+                } else {
+                    // back at the same height, it was a hop
+                    this->layer_pending = false;
+                    flush_held();
+                }
+            } else if(target[Z_AXIS] != this->layer_z) {
+                // never moved Z before extruding, the layer starts here
+                start_layer(this->line_start, target[Z_AXIS]);
+            }
+        }
+    }
+
+    this->position[X_AXIS] = target[X_AXIS];
+    this->position[Y_AXIS] = target[Y_AXIS];
+    this->position[Z_AXIS] = target[Z_AXIS];
+    if(has_e) this->e_position = this->e_absolute ? e : this->e_position + e;
+}
+
+unsigned int GcodeIndex::layer_at(unsigned long line)
+{
+    // layer starts always have an entry, so the layer of the entry before line is the layer of line
+    time_at(line);
+    return this->cache_valid ? this->cached[0].layer : 0;
+}
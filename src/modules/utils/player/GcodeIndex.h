@@ -0,0 +1,183 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GCODEINDEX_H
+#define GCODEINDEX_H
+
+#include "LineReader.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+using std::string;
+
+// Sidecar index for a gcode file, kept next to it as <file>.idx so a job can be restarted from a line or a layer,
+// and its progress reported by lines and estimated time instead of bytes.
+//
+// File format, all fields little endian:
+//
+//   header, 36 bytes
+//     char     magic[4]      "SGIX", written last so an unfinished index is never used
+//     uint16_t version       2
+//     uint16_t interval      an entry is written for the first line at or after every multiple of this
+//     uint32_t source_size   size of the gcode file when it was indexed, the index is ignored if that changed
+//                            for a compressed file the size it decompresses to
+//     uint32_t source_check  FNV-1a hash of the first and last 512 bytes of the file as stored, the index is ignored
+//                            if that changed, so an edit that keeps the size is caught as long as it touches either end
+//     uint32_t lines         number of lines in the gcode file
+//     uint32_t entries       number of entries following the header
+//     float    total_time    estimated seconds to run the whole file
+//     uint32_t layers        number of layer starts
+//     uint16_t flags         bit 0 set once the times have been replaced by a planner dry run ( the estimate command )
+//     uint16_t reserved      0
+//
+//   entries, 24 bytes each, in line order
+//     uint32_t line          number of lines before this one, the first line of the file is 0
+//     uint32_t offset        byte offset of the start of the line
+//     float    time          estimated seconds from the start of the file to the start of the line
+//     float    z             Z at the start of the line, for a layer start found from the moves the height of the layer
+//     uint32_t layer         layer the line belongs to, 0 before the first layer start
+//     uint16_t flags         bit 0 set for the first line of a layer
+//     uint16_t reserved      0
+//
+// Line numbers count every line ending, including blank lines, comments and lines too long to be played,
+// so they match what an editor shows less one.
+// Layer starts come from ;LAYER: or ;LAYER_CHANGE comments when the slicer writes them, otherwise a layer starts
+// at the first Z move after the last extrusion, once something is extruded at the new height ( so Z hops are not layers ).
+// The time estimate is distance over feedrate for each move plus dwells, it does not know about acceleration,
+// the estimate command can later rewrite the times with what the planner makes of the moves.
+// The index only records where things are, it is up to whoever restarts a job to heat up, home and set E first.
+class GcodeIndex {
+    public:
+        static const uint16_t version = 2;
+        static const uint16_t layer_start = 1;  // entry flags
+        static const uint16_t planned_times = 1; // header flags
+
+        struct header_t {
+            char magic[4];
+            uint16_t version;
+            uint16_t interval;
+            uint32_t source_size;
+            uint32_t source_check;
+            uint32_t lines;
+            uint32_t entries;
+            float total_time;
+            uint32_t layers;
+            uint16_t flags;
+            uint16_t reserved;
+        };
+
+        struct entry_t {
+            uint32_t line;
+            uint32_t offset;
+            float time;
+            float z;
+            uint32_t layer;
+            uint16_t flags;
+            uint16_t reserved;
+        };
+
+        static string path_for(const string &gcode_path) { return gcode_path + ".idx"; }
+
+        GcodeIndex();
+        ~GcodeIndex();
+
+        // opens the index for a gcode file of the given size, fails if there is none or it is stale
+        bool open(const string &gcode_path, unsigned long source_size);
+        // the source_check of a gcode file, leaves it at its start
+        static uint32_t check_of(FILE *gcode);
+        void close();
+        bool is_open() const { return file != NULL; }
+        const header_t &get_header() const { return header; }
+
+        // the last entry at or before line or offset, there is always one for line 0
+        bool find_line(unsigned long line, entry_t &entry) { return find(line, false, entry); }
+        bool find_offset(unsigned long offset, entry_t &entry) { return find(offset, true, entry); }
+        // the start of a layer, 1 is the first
+        bool find_layer(unsigned int layer, entry_t &entry);
+        // estimated seconds from the start of the file to the start of line, interpolated between entries
+        float time_at(unsigned long line);
+        unsigned int layer_at(unsigned long line);
+
+    private:
+        bool find(unsigned long key, bool by_offset, entry_t &entry);
+        bool read_entry(uint32_t i, entry_t &entry);
+
+        FILE *file;
+        header_t header;
+        entry_t cached[2]; // the entries either side of the last time_at
+        uint32_t cached_index;
+        bool cache_valid;
+};
+
+// Builds the index for a gcode file a few lines at a time, so it can run in the background while other things happen.
+// Only uses stdio, so it can be run on a host against any gcode file.
+class GcodeIndexer {
+    public:
+        GcodeIndexer();
+        ~GcodeIndexer();
+
+        // feedrates in mm/min, used until the file sets its own
+        bool start(const string &gcode_path, uint16_t interval, float feed_rate, float seek_rate);
+        // index up to max_lines more lines, returns false once finished or failed
+        bool step(unsigned int max_lines);
+        void abort();
+
+        bool is_running() const { return gcode != NULL; }
+        bool succeeded() const { return finished_ok; }
+        const string &get_path() const { return path; }
+
+    private:
+        void parse(char *line, unsigned long line_no, unsigned long offset);
+        void move(const float *target, float e, bool has_e, float i, float j);
+        void push(const GcodeIndex::entry_t &entry);
+        void add_entry(const GcodeIndex::entry_t &entry);
+        void flush_held();
+        void start_layer(GcodeIndex::entry_t &entry, float z);
+        bool write_entries();
+        bool finish();
+
+        static const int held_max = 4;
+        static const int batch_max = 16;
+
+        string path;
+        FILE *gcode;
+        FILE *index;
+        LineReader reader;
+        GcodeIndex::header_t header;
+
+        // entries not yet written
+        GcodeIndex::entry_t batch[batch_max];
+        int batch_count;
+        // entries held back while a layer change might be going on, as the layer start would come before them
+        GcodeIndex::entry_t held[held_max];
+        int held_count;
+        GcodeIndex::entry_t pending_layer; // where the layer will start if something is extruded at the new height
+        GcodeIndex::entry_t line_start;    // the line being parsed, as an entry
+        unsigned long next_entry_line;
+        unsigned long last_added_line;
+
+        // modal state of the gcode being indexed
+        float position[3];
+        float e_position;
+        float layer_z;
+        float time;
+        float feed_rate; // mm/min
+        float seek_rate; // mm/min
+        float units;     // mm per unit
+        uint32_t layer;
+        int8_t motion;   // modal G0 to G3, -1 before the first
+        struct {
+            bool absolute:1;
+            bool e_absolute:1;
+            bool layer_pending:1;
+            bool layer_comments:1;
+            bool finished_ok:1;
+        };
+};
+
+#endif // GCODEINDEX_H
@@ -0,0 +1,282 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LineReader.h"
+#include "ShrinkReader.h"
+
+#include <string.h>
+
+LineReader::LineReader(bool read_ahead)
+{
+    this->file = NULL;
+    this->decoder = NULL;
+    this->buffer = NULL;
+    this->ahead = NULL;
+    this->ahead_len = 0;
+    this->data = this->pos = this->end = NULL;
+    this->chunk = 0;
+    this->file_pos = 0;
+    this->lines = 0;
+    this->eof = true;
+    this->discarding = false;
+    this->partial = false;
+    this->read_ahead = read_ahead;
+    this->ahead_pending = false;
+}
+
+LineReader::~LineReader()
+{
+    stop();
+}
+
+// start reading file from its current position, which should be the start of the file to keep the reads aligned
+bool LineReader::start(FILE *file, size_t sectors)
+{
+    stop();
+
+    this->chunk = sectors * sector_size;
+    // spill area for a partial line, the chunk, and one more byte to terminate the last line of the file
+    this->buffer = new char[max_line + this->chunk + 1];
+    if(this->buffer == NULL) return false;
+    if(this->read_ahead) {
+        this->ahead = new char[max_line + this->chunk + 1];
+        if(this->ahead == NULL) {
+            stop();
+            return false;
+        }
+    }
+
+    // our buffer replaces the stdio one, must be done before the first read
+    setvbuf(file, NULL, _IONBF, 0);
+
+    if(ShrinkReader::is_compressed(file)) {
+        // the compressed data is read a sector at a time by the decoder, which fills our buffer
+        this->decoder = new ShrinkReader();
+        if(this->decoder == NULL || !this->decoder->start(file, sector_size)) {
+            stop();
+            return false;
+        }
+    }
+
+    this->file = file;
+    this->data = this->buffer + max_line;
+    this->pos = this->end = this->data;
+    this->file_pos = this->decoder != NULL ? 0 : ftell(file);
+    this->lines = 0;
+    this->eof = false;
+    this->discarding = false;
+    this->partial = false;
+    if(this->ahead != NULL) start_ahead();
+    return true;
+}
+
+// the read starts at the sector holding the byte before offset, so we can tell if offset is the start of a line
+bool LineReader::seek(unsigned long offset, unsigned long line)
+{
+    if(this->buffer == NULL) return false;
+
+    cancel_ahead();
+    unsigned long from = offset > 0 ? offset - 1 : 0;
+    unsigned long base = from - from % sector_size;
+    if(this->decoder != NULL) {
+        // there is no way into the middle of the stream, everything before base is decompressed and dropped
+        if(!this->decoder->rewind()) return false;
+        for(unsigned long left = base; left > 0; ) {
+            size_t n = this->decoder->read(this->data, left < this->chunk ? left : this->chunk);
+            if(n == 0) break;
+            left -= n;
+            seeking();
+        }
+    } else if(fseek(this->file, base, SEEK_SET) != 0) {
+        return false;
+    }
+
+    this->file_pos = base;
+    this->lines = line;
+    this->pos = this->end = this->data;
+    this->eof = false;
+    this->discarding = false;
+    if(this->ahead != NULL) {
+        start_ahead();
+        finish_read();
+    }
+    fill();
+
+    size_t skip = from - base;
+    this->pos = this->data + (skip < (size_t)(this->end - this->data) ? skip : this->end - this->data);
+    // anything up to the next line ending belongs to the line offset is in
+    this->partial = offset > 0;
+    if(this->partial && this->pos < this->end && *this->pos == '\n') {
+        // offset is the start of a line
+        this->pos++;
+        this->partial = false;
+    }
+    return true;
+}
+
+// move past the next line without handing it out, however long it is
+bool LineReader::skip_line()
+{
+    if(this->buffer == NULL) return false;
+
+    bool any = false;
+    for(;;) {
+        char *nl = (char *)memchr(this->pos, '\n', this->end - this->pos);
+        if(nl != NULL) {
+            this->pos = nl + 1;
+            break;
+        }
+        // nothing in this chunk is worth keeping
+        any = any || this->pos != this->end;
+        this->pos = this->end;
+        if(this->ahead_pending) finish_read();
+        if(this->eof || !fill()) {
+            if(!any) return false;
+            break;
+        }
+    }
+
+    if(this->partial) this->partial = false;
+    else this->lines++;
+    this->discarding = false;
+    return true;
+}
+
+// does not close the file, that belongs to the caller
+void LineReader::stop()
+{
+    cancel_ahead();
+    delete [] this->ahead;
+    this->ahead = NULL;
+    delete this->decoder;
+    this->decoder = NULL;
+    delete [] this->buffer;
+    this->buffer = NULL;
+    this->file = NULL;
+    this->data = this->pos = this->end = NULL;
+    this->eof = true;
+    this->discarding = false;
+    this->partial = false;
+}
+
+// keep the unfinished line, then read the next chunk behind it
+// with read ahead nothing changes until the next chunk is in
+bool LineReader::fill()
+{
+    if(this->ahead_pending) return false;
+
+    size_t left = this->end - this->pos;
+    if(left > max_line) {
+        // no line ending within max_line, drop it and skip up to the next one
+        this->discarding = true;
+        left = 0;
+    }
+
+    size_t n;
+    if(this->ahead == NULL) {
+        memmove(this->data - left, this->pos, left);
+        this->pos = this->data - left;
+        n = read(this->data, this->chunk);
+    } else {
+        // the next chunk is already in the other buffer, the unfinished line goes in front of it and they swap
+        char *next = this->ahead + max_line;
+        memcpy(next - left, this->pos, left);
+        this->ahead = this->buffer;
+        this->buffer = next - max_line;
+        this->data = next;
+        this->pos = next - left;
+        n = this->ahead_len;
+        // the buffer just finished with gets the chunk after, unless this one was the last
+        if(n == this->chunk) start_ahead();
+    }
+
+    this->end = this->data + n;
+    this->file_pos += n;
+    if(n < this->chunk) this->eof = true;
+    return n > 0;
+}
+
+void LineReader::start_ahead()
+{
+    this->ahead_pending = true;
+    this->ahead_len = 0;
+    start_read(this->ahead + max_line, this->chunk);
+}
+
+void LineReader::read_done(size_t n)
+{
+    this->ahead_len = n;
+    this->ahead_pending = false;
+}
+
+void LineReader::cancel_ahead()
+{
+    if(!this->ahead_pending) return;
+    cancel_read();
+    this->ahead_pending = false;
+}
+
+size_t LineReader::read(char *to, size_t len)
+{
+    return this->decoder != NULL ? this->decoder->read(to, len) : fread(to, 1, len, this->file);
+}
+
+unsigned long LineReader::content_size() const
+{
+    return this->decoder != NULL ? this->decoder->size() : 0;
+}
+
+unsigned long LineReader::size_of(FILE *file)
+{
+    long pos = ftell(file);
+    unsigned long size = 0;
+    if(fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+    fseek(file, pos, SEEK_SET);
+
+    ShrinkReader::is_compressed(file, &size);
+    return size;
+}
+
+char *LineReader::next_line(size_t &len, bool &too_long)
+{
+    too_long = false;
+    if(this->buffer == NULL) return NULL;
+
+    for(;;) {
+        char *nl = (char *)memchr(this->pos, '\n', this->end - this->pos);
+        if(nl == NULL) {
+            if(!this->eof && fill()) continue;
+            // the rest of the line is still being read
+            if(this->ahead_pending) return NULL;
+
+            // last line of the file has no line ending
+            if(this->pos == this->end) return NULL;
+            nl = this->end;
+        }
+
+        char *line = this->pos;
+        this->pos = (nl == this->end) ? nl : nl + 1;
+
+        if(this->partial) {
+            this->partial = false;
+            this->discarding = false;
+            continue;
+        }
+
+        this->lines++;
+        if(this->discarding || nl - line > (ptrdiff_t)max_line) {
+            this->discarding = false;
+            too_long = true;
+            continue;
+        }
+
+        if(nl > line && nl[-1] == '\r') nl--;
+        *nl = '\0';
+        len = nl - line;
+        return line;
+    }
+}
@@ -0,0 +1,111 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+class ShrinkReader;
+
+// Reads a file a few sectors at a time and hands out the lines in place, instead of a stdio call per line.
+// The file is switched to unbuffered so each refill is one read of whole sectors at a sector aligned offset,
+// which the filesystem can do straight into our buffer. The unfinished line at the end of a chunk is moved into
+// a spill area in front of the buffer, so the next chunk still lands on the same aligned address.
+// A file compressed by smoothie-compress.py is decompressed into the buffer instead, and everything here, offsets
+// included, is then about the gcode it decompresses to.
+// With read ahead there is a second buffer the next chunk is read into while the lines of this one are handed out.
+// The read is started through start_read(), which here reads straight away, a subclass can hand it to something
+// else and call read_done() when it is in.
+// Only uses stdio, so it can be timed on a host against a disk image or any file.
+class LineReader {
+    public:
+        static const size_t sector_size = 512;
+        static const size_t max_line = 128; // lines longer than this are skipped
+
+        LineReader(bool read_ahead = false);
+        // a subclass that overrides cancel_read() must call stop() in its own destructor
+        virtual ~LineReader();
+
+        // sectors are read at a time, with read ahead there are two buffers of them
+        bool start(FILE *file, size_t sectors = 4);
+        void stop();
+
+        // true once started on a compressed file
+        bool compressed() const { return decoder != NULL; }
+        // size of the gcode a compressed file decompresses to
+        unsigned long content_size() const;
+        // the size of what will be read from file, its size or for a compressed file what it decompresses to
+        // file is left where it was
+        static unsigned long size_of(FILE *file);
+
+        // continue from the first line that starts at or after offset, line is the number of lines before it
+        // a compressed file is decompressed again from its start up to offset, which takes about as long as reading
+        // that much of the file uncompressed, a few seconds for a large file. seeking() is called after every chunk
+        bool seek(unsigned long offset, unsigned long line = 0);
+
+        // returns the next line without its line ending, or NULL at the end of the file
+        // too_long is set when one or more lines over max_line were skipped before it
+        // with read ahead it is also NULL while the next chunk is still being read, see waiting()
+        char *next_line(size_t &len, bool &too_long);
+
+        // skips the next line, returns false at the end of the file, waits for the next chunk if it has to
+        bool skip_line();
+
+        // true while next_line() is held up by the read of the next chunk
+        bool waiting() const { return ahead_pending; }
+
+        // file offset of the first byte not yet handed out
+        unsigned long tell() const { return file_pos - (end - pos); }
+
+        // file offset of a line returned by the last next_line()
+        unsigned long offset_of(const char *line) const { return file_pos - (end - line); }
+
+        // lines handed out or skipped as too long since start or seek
+        unsigned long line() const { return lines; }
+
+    protected:
+        // read len bytes from where the file is into to, then call read_done() with how many there were
+        virtual void start_read(char *to, size_t len) { read_done(read(to, len)); }
+        // wait for the started read to be done
+        virtual void finish_read() {}
+        // forget the started read, read_done() is not called for it
+        virtual void cancel_read() {}
+        // called between the chunks a seek in a compressed file decompresses and drops
+        virtual void seeking() {}
+        void read_done(size_t n);
+
+        size_t read(char *to, size_t len);
+        FILE *get_file() const { return file; }
+
+    private:
+        bool fill();
+        void start_ahead();
+        void cancel_ahead();
+
+        FILE *file;
+        ShrinkReader *decoder;
+        char *buffer;
+        char *ahead;
+        size_t ahead_len;
+        char *data;
+        char *pos;
+        char *end;
+        size_t chunk;
+        unsigned long file_pos;
+        unsigned long lines;
+        struct {
+            bool eof:1;
+            bool discarding:1;
+            bool partial:1;
+            bool read_ahead:1;
+            bool ahead_pending:1;
+        };
+};
+
+#endif // LINEREADER_H
@@ -8,6 +8,7 @@
 #include "Player.h"
 
 #include "libs/Kernel.h"
+#include "libs/Scheduler.h"
 #include "Robot.h"
 #include "libs/nuts_bolts.h"
 #include "libs/utils.h"
@@ -41,6 +42,10 @@
 #define after_suspend_gcode_checksum      CHECKSUM("after_suspend_gcode")
 #define before_resume_gcode_checksum      CHECKSUM("before_resume_gcode")
 #define leave_heaters_on_suspend_checksum CHECKSUM("leave_heaters_on_suspend")
+#define gcode_index_enable_checksum       CHECKSUM("gcode_index_enable")
+#define gcode_index_interval_checksum     CHECKSUM("gcode_index_interval")
+#define default_feed_rate_checksum        CHECKSUM("default_feed_rate")
+#define default_seek_rate_checksum        CHECKSUM("default_seek_rate")
 
 
 #define extruder_checksum                 CHECKSUM("extruder")
@@ -59,12 +64,15 @@ Player::Player()
     this->halted= false;
     this->suspended= false;
     this->suspend_loops= 0;
+    this->index_task = nullptr;
+    this->index_enable = false;
+    this->line_known = true;
 }
 
 void Player::on_module_loaded()
 {
     this->register_for_event(ON_CONSOLE_LINE_RECEIVED);
-    this->register_for_event(ON_MAIN_LOOP);
+    THEKERNEL->scheduler->add_task("player", [](void *player) { static_cast<Player *>(player)->on_main_loop(nullptr); }, this, Scheduler::HIGH_PRIORITY);
     this->register_for_event(ON_SECOND_TICK);
     this->register_for_event(ON_GET_PUBLIC_DATA);
     this->register_for_event(ON_SET_PUBLIC_DATA);
@@ -79,11 +87,21 @@ void Player::on_module_loaded()
     std::replace( this->after_suspend_gcode.begin(), this->after_suspend_gcode.end(), '_', ' '); // replace _ with space
     std::replace( this->before_resume_gcode.begin(), this->before_resume_gcode.end(), '_', ' '); // replace _ with space
     this->leave_heaters_on = THEKERNEL->config->value(leave_heaters_on_suspend_checksum)->by_default(false)->as_bool();
+
+    this->index_enable = THEKERNEL->config->value(gcode_index_enable_checksum)->by_default(false)->as_bool();
+    if(this->index_enable) {
+        this->index_interval = THEKERNEL->config->value(gcode_index_interval_checksum)->by_default(500)->as_number();
+        // the estimate starts from the same rates the robot does
+        this->index_feed_rate = THEKERNEL->config->value(default_feed_rate_checksum)->by_default(100.0F)->as_number();
+        this->index_seek_rate = THEKERNEL->config->value(default_seek_rate_checksum)->by_default(100.0F)->as_number();
+        this->index_task = THEKERNEL->scheduler->add_task("indexer", [](void *player) { static_cast<Player *>(player)->index_step(); }, this, Scheduler::LOW_PRIORITY, Scheduler::ON_DEMAND);
+    }
 }
 
 void Player::on_halt(void *arg)
 {
     halted= (arg == nullptr);
+    if(halted) this->estimator.cancel();
 }
 
 void Player::on_second_tick(void *)
@@ -123,6 +141,7 @@ void Player::on_gcode_received(void *argument)
 
             if(this->current_file_handler != NULL) {
                 this->playing_file = false;
+                this->reader.stop();
                 fclose(this->current_file_handler);
             }
             this->current_file_handler = fopen( this->filename.c_str(), "r");
@@ -140,6 +159,9 @@ void Player::on_gcode_received(void *argument)
                     this->file_size = ftell(this->current_file_handler);
                     fseek(this->current_file_handler, 0, SEEK_SET);
                 }
+                this->reader.start(this->current_file_handler, QueuedLineReader::sectors);
+                if(this->reader.compressed()) this->file_size = this->reader.content_size();
+                open_index();
                 gcode->stream->printf("File opened:%s Size:%ld\r\n", this->filename.c_str(), this->file_size);
                 gcode->stream->printf("File selected\r\n");
             }
@@ -162,6 +184,14 @@ void Player::on_gcode_received(void *argument)
             gcode->mark_as_taken();
             this->playing_file = false;
 
+        } else if (gcode->m == 26 && gcode->has_letter('S')) { // set file position, like Marlin
+            gcode->mark_as_taken();
+            if(this->current_file_handler == NULL) {
+                gcode->stream->printf("No file loaded\r\n");
+            } else {
+                seek_to(gcode->get_value('S'), gcode->stream);
+            }
+
         } else if (gcode->m == 26) { // Reset print. Slightly different than M26 in Marlin and the rest
             gcode->mark_as_taken();
             if(this->current_file_handler != NULL) {
@@ -178,9 +208,11 @@ void Player::on_gcode_received(void *argument)
                     if(this->current_file_handler == NULL) {
                         gcode->stream->printf("file.open failed: %s\r\n", currentfn.c_str());
                     } else {
+                        this->reader.start(this->current_file_handler, QueuedLineReader::sectors);
                         this->filename = currentfn;
                         this->file_size = old_size;
                         this->current_stream = &(StreamOutput::NullStream);
+                        open_index();
                     }
                 }
             } else {
@@ -199,6 +231,7 @@ void Player::on_gcode_received(void *argument)
 
             if(this->current_file_handler != NULL) {
                 this->playing_file = false;
+                this->reader.stop();
                 fclose(this->current_file_handler);
             }
 
@@ -216,6 +249,9 @@ void Player::on_gcode_received(void *argument)
                         file_size = ftell(this->current_file_handler);
                         fseek(this->current_file_handler, 0, SEEK_SET);
                 }
+                this->reader.start(this->current_file_handler, QueuedLineReader::sectors);
+                if(this->reader.compressed()) this->file_size = this->reader.content_size();
+                open_index();
             }
 
             this->played_cnt = 0;
@@ -257,6 +293,10 @@ void Player::on_console_line_received( void *argument )
         this->suspend_command( possible_command, new_message.stream );
     }else if (cmd == "resume") {
         this->resume_command( possible_command, new_message.stream );
+    }else if (cmd == "seek") {
+        this->seek_command( possible_command, new_message.stream );
+    }else if (cmd == "estimate") {
+        this->estimate_command( possible_command, new_message.stream );
     }
 }
 
@@ -274,6 +314,7 @@ void Player::play_command( string parameters, StreamOutput *stream )
     }
 
     if(this->current_file_handler != NULL) { // must have been a paused print
+        this->reader.stop();
         fclose(this->current_file_handler);
     }
 
@@ -305,6 +346,13 @@ void Player::play_command( string parameters, StreamOutput *stream )
         fseek(this->current_file_handler, 0, SEEK_SET);
         stream->printf("  File size %ld\r\n", file_size);
     }
+    this->reader.start(this->current_file_handler, QueuedLineReader::sectors);
+    if(this->reader.compressed()) {
+        // progress, seeks and the index all go by the gcode it decompresses to
+        this->file_size = this->reader.content_size();
+        stream->printf("  Compressed, %ld bytes of gcode\r\n", this->file_size);
+    }
+    open_index();
     this->played_cnt = 0;
     this->elapsed_secs = 0;
 }
@@ -329,20 +377,23 @@ void Player::progress_command( string parameters, StreamOutput *stream )
     }
 
     if(file_size > 0) {
-        unsigned long est = 0;
-        if(this->elapsed_secs > 10) {
-            unsigned long bytespersec = played_cnt / this->elapsed_secs;
-            if(bytespersec > 0)
-                est = (file_size - played_cnt) / bytespersec;
-        }
+        bool indexed = this->index.is_open() && this->line_known;
+        unsigned long est = seconds_left();
 
-        unsigned int pcnt = (file_size - (file_size - played_cnt)) * 100 / file_size;
+        unsigned int pcnt = percent_complete();
         // If -b or -B is passed, report in the format used by Marlin and the others.
         if (!sdprinting) {
             stream->printf("file: %s, %u %% complete, elapsed time: %lu s", this->filename.c_str(), pcnt, this->elapsed_secs);
             if(est > 0) {
                 stream->printf(", est time: %lu s",  est);
             }
+            if(indexed) {
+                const GcodeIndex::header_t &h = this->index.get_header();
+                stream->printf(", line: %lu/%lu", this->reader.line(), (unsigned long)h.lines);
+                if(h.layers > 0) {
+                    stream->printf(", layer: %u/%lu", this->index.layer_at(this->reader.line()), h.layers);
+                }
+            }
             stream->printf("\r\n");
         } else {
             stream->printf("SD printing byte %lu/%lu\r\n", played_cnt, file_size);
@@ -353,6 +404,275 @@ void Player::progress_command( string parameters, StreamOutput *stream )
     }
 }
 
+// move a selected, paused or suspended file to a byte offset, or with an index to a line or a layer
+void Player::seek_command( string parameters, StreamOutput *stream )
+{
+    string what = shift_parameter( parameters );
+    if(what.empty()) {
+        stream->printf("Usage: seek byte_offset | seek line number | seek layer number\r\n");
+        return;
+    }
+    if(this->current_file_handler == NULL) {
+        stream->printf("No file loaded\r\n");
+        return;
+    }
+
+    bool ok;
+    if(what == "line" || what == "layer") {
+        unsigned long n = strtoul(shift_parameter( parameters ).c_str(), NULL, 10);
+        if(n == 0) {
+            stream->printf("Lines and layers are numbered from 1\r\n");
+            return;
+        }
+        if(!this->index.is_open()) {
+            stream->printf("No index for this file%s\r\n", this->indexer.is_running() || !this->index_queue.empty() ? " yet, it is being built" : "");
+            return;
+        }
+
+        if(what == "line") {
+            ok = seek_to_line(n - 1, stream);
+        } else {
+            GcodeIndex::entry_t entry;
+            if(!this->index.find_layer(n, entry)) {
+                stream->printf("No layer %lu, the file has %lu\r\n", n, this->index.get_header().layers);
+                return;
+            }
+            ok = seek_to_line(entry.line, stream);
+        }
+
+    } else {
+        ok = seek_to(strtoul(what.c_str(), NULL, 10), stream);
+    }
+
+    if(ok) {
+        if(this->line_known) {
+            stream->printf("Playing from line %lu, byte %lu/%lu\r\n", this->reader.line() + 1, this->played_cnt, this->file_size);
+        } else {
+            stream->printf("Playing from byte %lu/%lu\r\n", this->played_cnt, this->file_size);
+        }
+    }
+}
+
+// playing continues with the first whole line at or after offset
+// read only files get a cluster link map on their first seek, so this does not walk the FAT from the start of the file
+bool Player::seek_to(unsigned long offset, StreamOutput *stream)
+{
+    if(this->playing_file) {
+        stream->printf("Pause or suspend the print before seeking\r\n");
+        return false;
+    }
+
+    if(offset > (unsigned long)this->file_size) offset = this->file_size;
+
+    GcodeIndex::entry_t entry;
+    if(this->index.is_open() && this->index.find_offset(offset, entry)) {
+        // read on from the last line the index knows, so lines are still counted
+        if(!this->reader.seek(entry.offset, entry.line)) {
+            stream->printf("Seek failed\r\n");
+            return false;
+        }
+        while(this->reader.tell() < offset && this->reader.skip_line()) ;
+        this->line_known = true;
+        this->played_cnt = this->reader.tell();
+        return true;
+    }
+
+    if(!this->reader.seek(offset)) {
+        stream->printf("Seek failed\r\n");
+        return false;
+    }
+
+    this->line_known = false;
+    this->played_cnt = offset;
+    return true;
+}
+
+// line is the number of lines before the one to play next
+bool Player::seek_to_line(unsigned long line, StreamOutput *stream)
+{
+    if(this->playing_file) {
+        stream->printf("Pause or suspend the print before seeking\r\n");
+        return false;
+    }
+
+    GcodeIndex::entry_t entry;
+    if(!this->index.find_line(line, entry) || !this->reader.seek(entry.offset, entry.line)) {
+        stream->printf("Seek failed\r\n");
+        return false;
+    }
+    while(this->reader.line() < line && this->reader.skip_line()) ;
+
+    this->line_known = true;
+    this->played_cnt = this->reader.tell();
+    return true;
+}
+
+// by estimated time when the file has an index, by bytes otherwise
+// from the index when the line being played is known, otherwise from the rate the file has been read at so far, 0 if unknown
+unsigned long Player::seconds_left()
+{
+    if(this->index.is_open() && this->line_known) {
+        // what is left of the moves in the file
+        float left = this->index.get_header().total_time - this->index.time_at(this->reader.line());
+        return left > 0 ? left : 0;
+    }
+    if(this->elapsed_secs > 10) {
+        unsigned long bytespersec = played_cnt / this->elapsed_secs;
+        if(bytespersec > 0)
+            return (file_size - played_cnt) / bytespersec;
+    }
+    return 0;
+}
+
+unsigned int Player::percent_complete()
+{
+    if(this->index.is_open() && this->line_known && this->index.get_header().total_time > 0) {
+        return this->index.time_at(this->reader.line()) * 100 / this->index.get_header().total_time;
+    }
+    return (this->file_size - (this->file_size - this->played_cnt)) * 100 / this->file_size;
+}
+
+static bool is_gcode_file(const string &path)
+{
+    size_t dot = path.find_last_of('.');
+    if(dot == string::npos || path.find('/', dot) != string::npos) return false;
+
+    string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "g" || ext == "gc" || ext == "gco" || ext == "gcode" || ext == "nc" || ext == "ngc" || ext == "gcz";
+}
+
+// use the index of a file that was just opened, or build one in the background for next time
+void Player::open_index()
+{
+    // the reader was just started, so it counts from the first line
+    this->line_known = true;
+    this->index.close();
+    if(!this->index_enable || this->file_size <= 0) return;
+
+    if(!this->index.open(this->filename, this->file_size)) {
+        queue_index(this->filename, false);
+    }
+}
+
+// changed is set when the file was just written, so an index being built for it is out of date
+void Player::queue_index(const string &path, bool changed)
+{
+    if(!this->index_enable) return;
+
+    // it is about to be rewritten
+    if(path == this->filename) this->index.close();
+
+    if(this->indexer.is_running() && this->indexer.get_path() == path) {
+        if(!changed) return;
+        this->indexer.abort();
+    }
+
+    if(std::find(this->index_queue.begin(), this->index_queue.end(), path) == this->index_queue.end()) {
+        this->index_queue.push_back(path);
+    }
+    THEKERNEL->scheduler->wake(this->index_task);
+}
+
+// builds the queued indexes a few lines per main loop pass, the file being played is read at the same time
+void Player::index_step()
+{
+    static const unsigned int lines_per_step = 50;
+
+    if(!this->indexer.is_running()) {
+        if(this->index_queue.empty()) return;
+
+        string path = this->index_queue.front();
+        this->index_queue.pop_front();
+        if(!this->indexer.start(path, this->index_interval, this->index_feed_rate, this->index_seek_rate)) {
+            THEKERNEL->streams->printf("Could not index %s\r\n", path.c_str());
+            THEKERNEL->scheduler->wake(this->index_task);
+            return;
+        }
+    }
+
+    if(this->indexer.step(lines_per_step)) {
+        THEKERNEL->scheduler->wake(this->index_task);
+        return;
+    }
+
+    // the loaded file can use it straight away
+    if(this->indexer.succeeded() && this->current_file_handler != NULL && this->indexer.get_path() == this->filename && !this->index.is_open()) {
+        this->index.open(this->filename, this->file_size);
+    }
+    if(!this->index_queue.empty()) THEKERNEL->scheduler->wake(this->index_task);
+}
+
+// time a file by running it through the planner without moving, the times are kept in its index for progress and the panel
+void Player::estimate_command( string parameters, StreamOutput *stream )
+{
+    string options = extract_options(parameters);
+    if(parameters.empty()) {
+        stream->printf("Usage: estimate file [-v]\r\n");
+        return;
+    }
+    string path = absolute_from_relative(parameters);
+
+    if(!this->index_enable) {
+        stream->printf("Estimates are kept in the gcode index, set gcode_index_enable true\r\n");
+        return;
+    }
+    if(this->playing_file || this->suspended || !THEKERNEL->conveyor->is_queue_empty()) {
+        stream->printf("Cannot estimate while printing or moving\r\n");
+        return;
+    }
+
+    FILE *fp = fopen(path.c_str(), "r");
+    if(fp == NULL) {
+        stream->printf("File not found: %s\r\n", path.c_str());
+        return;
+    }
+    unsigned long size = LineReader::size_of(fp);
+    fclose(fp);
+
+    // the index holds the times, so it is built here if it is missing or out of date
+    GcodeIndex times;
+    if(!times.open(path, size)) {
+        if(this->indexer.is_running() && this->indexer.get_path() == path) this->indexer.abort();
+        this->index_queue.erase(std::remove(this->index_queue.begin(), this->index_queue.end(), path), this->index_queue.end());
+
+        stream->printf("Indexing %s\r\n", path.c_str());
+        GcodeIndexer builder;
+        bool ok = builder.start(path, this->index_interval, this->index_feed_rate, this->index_seek_rate);
+        while(ok && !this->halted && builder.step(50)) {
+            THEKERNEL->call_event(ON_IDLE);
+        }
+        if(!ok || !builder.succeeded()) {
+            builder.abort();
+            stream->printf("Could not index %s\r\n", path.c_str());
+            return;
+        }
+    }
+    times.close();
+
+    // a paused file gets its index back once the times are in
+    bool loaded = this->current_file_handler != NULL && path == this->filename;
+    if(loaded) this->index.close();
+
+    stream->printf("Estimating %s\r\n", path.c_str());
+    bool ok = this->estimator.run(path, stream);
+
+    if(loaded && !this->index.open(this->filename, this->file_size)) queue_index(this->filename, false);
+    if(!ok) return;
+
+    stream->printf("Estimated time: %lu s\r\n", (unsigned long)this->estimator.get_total());
+
+    if(options.find_first_of("Vv") != string::npos && times.open(path, size)) {
+        const GcodeIndex::header_t &h = times.get_header();
+        GcodeIndex::entry_t entry, next;
+        for(unsigned int layer = 1; layer <= h.layers && times.find_layer(layer, entry); layer++) {
+            float end = layer < h.layers && times.find_layer(layer + 1, next) ? next.time : h.total_time;
+            stream->printf("layer %u, Z %1.3f, line %lu, starts at %lu s, takes %lu s\r\n", layer, entry.z,
+                           (unsigned long)entry.line + 1, (unsigned long)entry.time, (unsigned long)(end - entry.time));
+        }
+    }
+}
+
 void Player::abort_command( string parameters, StreamOutput *stream )
 {
     if(!playing_file && current_file_handler == NULL) {
@@ -365,6 +685,8 @@ void Player::abort_command( string parameters, StreamOutput *stream )
     file_size = 0;
     this->filename = "";
     this->current_stream = NULL;
+    this->index.close();
+    this->reader.stop();
     fclose(current_file_handler);
     current_file_handler = NULL;
     if(parameters.empty()) {
@@ -403,40 +725,37 @@ void Player::on_main_loop(void *argument)
             return;
         }
 
-        char buf[130]; // lines upto 128 characters are allowed, anything longer is discarded
-        bool discard = false;
-
-        while(fgets(buf, sizeof(buf), this->current_file_handler) != NULL) {
-            int len = strlen(buf);
-            if(len == 0) continue; // empty line? should not be possible
-            if(buf[len - 1] == '\n' || feof(this->current_file_handler)) {
-                if(discard) { // we are discarding a long line
-                    discard = false;
-                    continue;
-                }
-                if(len == 1) continue; // empty line
-
-                this->current_stream->printf("%s", buf);
-                struct SerialMessage message;
-                message.message = buf;
-                message.stream = this->current_stream;
-
-                // waits for the queue to have enough room
-                THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
-                played_cnt += len;
-                return; // we feed one line per main loop
-
-            } else {
-                // discard long line
-                this->current_stream->printf("Warning: Discarded long line\n");
-                discard = true;
-            }
+        size_t len;
+        bool too_long;
+        char *line;
+        do {
+            line = this->reader.next_line(len, too_long);
+            if(too_long) this->current_stream->printf("Warning: Discarded long line\n");
+        } while(line != NULL && len == 0); // skip empty lines
+
+        // the next chunk of the file is still being read, it will be there in a pass or two
+        if(line == NULL && this->reader.waiting()) return;
+
+        if(line != NULL) {
+            this->current_stream->printf("%s\n", line);
+            struct SerialMessage message;
+            message.message = line;
+            message.stream = this->current_stream;
+
+            // taken before the line is run, as it may abort the print
+            played_cnt = this->reader.tell();
+
+            // waits for the queue to have enough room
+            THEKERNEL->call_event(ON_CONSOLE_LINE_RECEIVED, &message);
+            return; // we feed one line per main loop
         }
 
         this->playing_file = false;
         this->filename = "";
         played_cnt = 0;
         file_size = 0;
+        this->index.close();
+        this->reader.stop();
         fclose(this->current_file_handler);
         current_file_handler = NULL;
         this->current_stream = NULL;
@@ -465,8 +784,15 @@ void Player::on_get_public_data(void *argument)
         static struct pad_progress p;
         if(file_size > 0 && playing_file) {
             p.elapsed_secs = this->elapsed_secs;
-            p.percent_complete = (this->file_size - (this->file_size - this->played_cnt)) * 100 / this->file_size;
+            p.percent_complete = percent_complete();
             p.filename = this->filename;
+            p.remaining_secs = seconds_left();
+            if(this->index.is_open() && this->line_known) {
+                p.layer = this->index.layer_at(this->reader.line());
+                p.layers = this->index.get_header().layers;
+            } else {
+                p.layer = p.layers = 0;
+            }
             pdr->set_data_ptr(&p);
             pdr->set_taken();
         }
@@ -482,6 +808,12 @@ void Player::on_set_public_data(void *argument)
     if(pdr->second_element_is(abort_play_checksum)) {
         abort_command("", &(StreamOutput::NullStream));
         pdr->set_taken();
+
+    } else if(pdr->second_element_is(index_file_checksum)) {
+        // a file was uploaded, index it if it is gcode
+        string *path = static_cast<string *>(pdr->get_data_ptr());
+        if(is_gcode_file(*path)) queue_index(*path, true);
+        pdr->set_taken();
     }
 }
 
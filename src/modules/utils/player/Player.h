@@ -10,11 +10,16 @@
 #define PLAYER_H
 
 #include "Module.h"
+#include "QueuedLineReader.h"
+#include "GcodeIndex.h"
+#include "TimeEstimator.h"
+#include "Scheduler.h"
 
 #include <stdio.h>
 #include <string>
 #include <map>
 #include <vector>
+#include <deque>
 using std::string;
 
 class StreamOutput;
@@ -38,8 +43,17 @@ class Player : public Module {
         void abort_command( string parameters, StreamOutput* stream );
         void suspend_command( string parameters, StreamOutput* stream );
         void resume_command( string parameters, StreamOutput* stream );
+        void seek_command( string parameters, StreamOutput* stream );
+        void estimate_command( string parameters, StreamOutput* stream );
+        bool seek_to(unsigned long offset, StreamOutput* stream);
+        bool seek_to_line(unsigned long line, StreamOutput* stream);
         string extract_options(string& args);
         void suspend_part2();
+        void open_index();
+        void queue_index(const string& path, bool changed);
+        void index_step();
+        unsigned int percent_complete();
+        unsigned long seconds_left();
 
         string filename;
         string after_suspend_gcode;
@@ -50,6 +64,15 @@ class Player : public Module {
         StreamOutput* suspend_stream;
 
         FILE* current_file_handler;
+        QueuedLineReader reader;
+        GcodeIndex index;
+        GcodeIndexer indexer;
+        TimeEstimator estimator;
+        std::deque<string> index_queue;
+        Scheduler::Task *index_task;
+        float index_feed_rate;
+        float index_seek_rate;
+        uint16_t index_interval;
         long file_size;
         unsigned long played_cnt;
         unsigned long elapsed_secs;
@@ -66,6 +89,8 @@ class Player : public Module {
             bool saved_absolute_mode:1;
             bool was_playing_file:1;
             bool leave_heaters_on:1;
+            bool index_enable:1;
+            bool line_known:1;
             uint8_t suspend_loops:4;
 
         };
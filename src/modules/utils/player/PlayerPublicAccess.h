@@ -6,10 +6,14 @@
 #define is_suspended_checksum     CHECKSUM("is_suspended")
 #define abort_play_checksum       CHECKSUM("abort_play")
 #define get_progress_checksum     CHECKSUM("progress")
+#define index_file_checksum       CHECKSUM("index_file")
 
 struct pad_progress {
     unsigned int percent_complete;
     unsigned long elapsed_secs;
     string filename;
+    unsigned long remaining_secs; // 0 when not known
+    unsigned int layer;           // layer and layers are 0 when the file has no index or no layers
+    unsigned int layers;
 };
 #endif
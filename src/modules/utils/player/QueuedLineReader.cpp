@@ -0,0 +1,41 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "QueuedLineReader.h"
+
+#include "libs/Kernel.h"
+#include "libs/FileIO.h"
+
+void QueuedLineReader::start_read(char *to, size_t len)
+{
+    if(compressed()) {
+        LineReader::start_read(to, len);
+        return;
+    }
+    THEKERNEL->file_io->read(get_file(), to, len, read_in, this);
+}
+
+void QueuedLineReader::finish_read()
+{
+    THEKERNEL->file_io->finish(this);
+}
+
+void QueuedLineReader::cancel_read()
+{
+    THEKERNEL->file_io->cancel(this);
+}
+
+// decompressing up to a seek offset can take seconds, keep what runs on ON_IDLE going like waiting for the queue does
+void QueuedLineReader::seeking()
+{
+    THEKERNEL->call_event(ON_IDLE);
+}
+
+void QueuedLineReader::read_in(void *object, size_t bytes)
+{
+    static_cast<QueuedLineReader *>(object)->read_done(bytes);
+}
@@ -0,0 +1,35 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUEUEDLINEREADER_H
+#define QUEUEDLINEREADER_H
+
+#include "LineReader.h"
+
+// A LineReader that has FileIO read the next chunk in its own pass of the main loop while this one is played,
+// so the pass that feeds a line to the planner never waits on the card.
+// A compressed file is still decoded where the chunk is needed, its reads are a sector at a time.
+// Seeking into one decodes everything before the offset, ON_IDLE is called along the way so that is not a stall.
+class QueuedLineReader : public LineReader {
+    public:
+        // sectors in each of the two chunks, together what a LineReader used to read at once
+        static const size_t sectors = 2;
+
+        QueuedLineReader() : LineReader(true) {}
+        ~QueuedLineReader() { stop(); }
+
+    protected:
+        void start_read(char *to, size_t len);
+        void finish_read();
+        void cancel_read();
+        void seeking();
+
+    private:
+        static void read_in(void *object, size_t bytes);
+};
+
+#endif // QUEUEDLINEREADER_H
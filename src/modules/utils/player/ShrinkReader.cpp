@@ -0,0 +1,164 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ShrinkReader.h"
+
+#include <string.h>
+
+static const char shrink_magic[4] = {'H', 'S', 'G', 'C'};
+
+// checks the header, returns the window and lookahead bits and the decompressed size
+static bool parse_header(const uint8_t *h, uint8_t &window_bits, uint8_t &lookahead_bits, unsigned long &size)
+{
+    if(memcmp(h, shrink_magic, sizeof(shrink_magic)) != 0 || h[4] != ShrinkReader::version) return false;
+
+    window_bits = h[5];
+    lookahead_bits = h[6];
+    if(window_bits < 4 || window_bits > ShrinkReader::max_window_bits || lookahead_bits < 3 || lookahead_bits >= window_bits) return false;
+
+    size = h[8] | (h[9] << 8) | (h[10] << 16) | ((unsigned long)h[11] << 24);
+    return true;
+}
+
+ShrinkReader::ShrinkReader()
+{
+    this->file = NULL;
+    this->window = NULL;
+    this->in = NULL;
+    this->in_size = this->in_len = this->in_pos = 0;
+    this->out_size = this->out_total = 0;
+    this->start_pos = 0;
+}
+
+ShrinkReader::~ShrinkReader()
+{
+    stop();
+}
+
+bool ShrinkReader::is_compressed(FILE *file, unsigned long *size)
+{
+    uint8_t h[header_size];
+    long pos = ftell(file);
+    bool ok = fread(h, 1, sizeof(h), file) == sizeof(h);
+    fseek(file, pos, SEEK_SET);
+
+    uint8_t window_bits, lookahead_bits;
+    unsigned long out_size;
+    if(!ok || !parse_header(h, window_bits, lookahead_bits, out_size)) return false;
+    if(size != NULL) *size = out_size;
+    return true;
+}
+
+bool ShrinkReader::start(FILE *file, size_t in_size)
+{
+    stop();
+
+    uint8_t h[header_size];
+    long pos = ftell(file);
+    if(fread(h, 1, sizeof(h), file) != sizeof(h) || !parse_header(h, this->window_bits, this->lookahead_bits, this->out_size)) return false;
+
+    // the first read has to hold the header
+    if(in_size < header_size) in_size = header_size;
+    this->in_size = in_size;
+    this->in = new uint8_t[this->in_size];
+    this->window = new uint8_t[1 << this->window_bits];
+    if(this->in == NULL || this->window == NULL) {
+        stop();
+        return false;
+    }
+
+    this->file = file;
+    this->start_pos = pos;
+    this->mask = (1 << this->window_bits) - 1;
+    return rewind();
+}
+
+void ShrinkReader::stop()
+{
+    delete [] this->in;
+    delete [] this->window;
+    this->in = NULL;
+    this->window = NULL;
+    this->file = NULL;
+}
+
+// the header is read again with the first sector, so the input stays on sector boundaries
+bool ShrinkReader::rewind()
+{
+    if(this->file == NULL || fseek(this->file, this->start_pos, SEEK_SET) != 0) return false;
+
+    this->in_len = fread(this->in, 1, this->in_size, this->file);
+    if(this->in_len < header_size) return false;
+    this->in_pos = header_size;
+
+    // a copy from before the start of the gcode gets zeros, as it does in heatshrink
+    memset(this->window, 0, this->mask + 1);
+    this->head = 0;
+    this->copy_index = this->copy_count = 0;
+    this->bit_index = 0;
+    this->out_total = 0;
+    return true;
+}
+
+// next count bits of the stream, or -1 at the end of the file
+int ShrinkReader::get_bits(uint8_t count)
+{
+    int value = 0;
+    for(uint8_t i = 0; i < count; i++) {
+        if(this->bit_index == 0) {
+            if(this->in_pos >= this->in_len) {
+                this->in_len = fread(this->in, 1, this->in_size, this->file);
+                this->in_pos = 0;
+                if(this->in_len == 0) return -1;
+            }
+            this->current_byte = this->in[this->in_pos++];
+            this->bit_index = 0x80;
+        }
+        value = (value << 1) | ((this->current_byte & this->bit_index) ? 1 : 0);
+        this->bit_index >>= 1;
+    }
+    return value;
+}
+
+size_t ShrinkReader::read(char *out, size_t len)
+{
+    if(this->file == NULL) return 0;
+
+    // the size in the header ends the stream, the last byte of it is padded with bits that are not a whole code
+    unsigned long left = this->out_size - this->out_total;
+    if(len > left) len = left;
+
+    size_t n = 0;
+    while(n < len) {
+        if(this->copy_count > 0) {
+            uint8_t c = this->window[(this->head - this->copy_index) & this->mask];
+            this->window[this->head++ & this->mask] = c;
+            out[n++] = c;
+            this->copy_count--;
+            continue;
+        }
+
+        int tag = get_bits(1);
+        if(tag < 0) break;
+        if(tag) {
+            int c = get_bits(8);
+            if(c < 0) break;
+            this->window[this->head++ & this->mask] = c;
+            out[n++] = c;
+        } else {
+            int index = get_bits(this->window_bits);
+            if(index < 0) break;
+            int count = get_bits(this->lookahead_bits);
+            if(count < 0) break;
+            this->copy_index = index + 1;
+            this->copy_count = count + 1;
+        }
+    }
+
+    this->out_total += n;
+    return n;
+}
@@ -0,0 +1,83 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHRINKREADER_H
+#define SHRINKREADER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Decompresses a gcode file written by smoothie-compress.py as it is read, so big jobs take a fraction of the
+// space and of the SD reads. The data is a heatshrink LZSS bit stream, which only needs the sliding window
+// of recent output to decode, 2^window_bits bytes, plus one sector of input.
+//
+// File format, header fields little endian:
+//
+//   header, 12 bytes
+//     char     magic[4]        "HSGC"
+//     uint8_t  version         1
+//     uint8_t  window_bits     log2 of the window size, 4 to max_window_bits
+//     uint8_t  lookahead_bits  log2 of the longest match, 3 to window_bits - 1
+//     uint8_t  reserved        0
+//     uint32_t size            size of the gcode once decompressed
+//
+//   then the bit stream, most significant bit first:
+//     1 bbbbbbbb               a literal byte
+//     0 i..i c..c              copy c + 1 bytes from i + 1 bytes back, i is window_bits and c lookahead_bits long
+//
+// It is the stream the heatshrink encoder writes with the same window and lookahead, so heatshrink -e -w 11 -l 4
+// with this header in front makes a file that plays too.
+// Only uses stdio, so it can be run on a host against any file.
+class ShrinkReader {
+    public:
+        static const uint8_t version = 1;
+        static const uint8_t max_window_bits = 12;
+        static const size_t header_size = 12;
+
+        ShrinkReader();
+        ~ShrinkReader();
+
+        // true if the file at its current position starts with a header we can decode, which is left unread
+        // size is set to what it decompresses to
+        static bool is_compressed(FILE *file, unsigned long *size = NULL);
+
+        // start decompressing file from its current position, the start of the header
+        bool start(FILE *file, size_t in_size = 512);
+        void stop();
+        // back to the first byte of the gcode
+        bool rewind();
+
+        // decompress up to len bytes into out, returns fewer only at the end of the gcode
+        size_t read(char *out, size_t len);
+
+        // size of the gcode once decompressed
+        unsigned long size() const { return out_size; }
+
+    private:
+        int get_bits(uint8_t count);
+
+        FILE *file;
+        long start_pos;
+        uint8_t *window;
+        uint8_t *in;
+        size_t in_size;
+        size_t in_len;
+        size_t in_pos;
+        unsigned long out_size;
+        unsigned long out_total;
+        uint16_t head;
+        uint16_t mask;
+        uint16_t copy_index;
+        uint16_t copy_count;
+        uint8_t window_bits;
+        uint8_t lookahead_bits;
+        uint8_t current_byte;
+        uint8_t bit_index;
+};
+
+#endif // SHRINKREADER_H
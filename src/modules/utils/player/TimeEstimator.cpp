@@ -0,0 +1,258 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TimeEstimator.h"
+
+#include "libs/Kernel.h"
+#include "libs/StreamOutput.h"
+#include "Robot.h"
+#include "Gcode.h"
+#include "LineReader.h"
+#include "modules/robot/Conveyor.h"
+#include "modules/robot/Block.h"
+#include "PublicData.h"
+#include "checksumm.h"
+#include "ExtruderPublicAccess.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+
+TimeEstimator::TimeEstimator()
+{
+    this->index = NULL;
+    this->next_entry_i = 0;
+    this->blocks_done = 0;
+    this->time = 0;
+    this->total = 0;
+    this->motion = -1;
+    this->cancelled = false;
+    this->write_failed = false;
+}
+
+bool TimeEstimator::run(const string &gcode_path, StreamOutput *stream)
+{
+    FILE *gcode = fopen(gcode_path.c_str(), "r");
+    if(gcode == NULL) {
+        stream->printf("File not found: %s\r\n", gcode_path.c_str());
+        return false;
+    }
+
+    string index_path = GcodeIndex::path_for(gcode_path);
+    this->index = fopen(index_path.c_str(), "r+");
+    if(this->index != NULL) {
+        // entries are read and rewritten one at a time all through the run
+        setvbuf(this->index, NULL, _IONBF, 0);
+    }
+    if(this->index == NULL || fread(&this->header, sizeof(this->header), 1, this->index) != 1 || this->header.entries == 0) {
+        stream->printf("No index for %s\r\n", gcode_path.c_str());
+        if(this->index != NULL) fclose(this->index);
+        this->index = NULL;
+        fclose(gcode);
+        return false;
+    }
+
+    LineReader reader;
+    if(!reader.start(gcode, 2)) {
+        stream->printf("Not enough memory to read %s\r\n", gcode_path.c_str());
+        fclose(this->index);
+        this->index = NULL;
+        fclose(gcode);
+        return false;
+    }
+
+    this->marks.clear();
+    this->next_entry_i = 0;
+    this->blocks_done = 0;
+    this->time = 0;
+    this->motion = -1;
+    this->cancelled = false;
+    this->write_failed = !read_entry(0, this->next_entry);
+
+    // the file may change units, positioning and feedrates, all of which are put back afterwards
+    Robot *robot = THEKERNEL->robot;
+    bool inch_mode = robot->inch_mode;
+    send("M120");
+    // the extruders plan E along with the moves, their speed limits need each move's extrusion
+    PublicData::set_value(extruder_checksum, save_plan_checksum, nullptr);
+    THEKERNEL->conveyor->start_dry_run(block_done, this);
+
+    size_t len;
+    bool too_long;
+    char *line;
+    unsigned int count = 0;
+    while(!this->cancelled && (line = reader.next_line(len, too_long)) != NULL) {
+        // the line just read is the one before the count
+        mark_entries(reader.line() - 1);
+        simulate(line);
+
+        // planning a file takes a while, keep the usb and serial alive
+        if((++count & 0xFF) == 0) THEKERNEL->call_event(ON_IDLE);
+    }
+
+    // also queues the end of the path the robot is holding back
+    send("M121");
+    THEKERNEL->conveyor->stop_dry_run();
+    robot->inch_mode = inch_mode;
+    PublicData::set_value(extruder_checksum, restore_plan_checksum, nullptr);
+    // the robot thinks it is wherever the file ended, the actuators never moved
+    robot->reset_position_from_current_actuator_position();
+
+    // whatever is left starts once the last move is done
+    mark_entries(ULONG_MAX);
+    settle(UINT32_MAX);
+    this->marks.clear();
+    this->total = this->time;
+
+    reader.stop();
+    fclose(gcode);
+
+    if(!this->cancelled && !this->write_failed) {
+        this->header.total_time = this->total;
+        this->header.flags |= GcodeIndex::planned_times;
+        this->write_failed = fseek(this->index, 0, SEEK_SET) != 0 || fwrite(&this->header, sizeof(this->header), 1, this->index) != 1;
+    }
+    fclose(this->index);
+    this->index = NULL;
+
+    if(this->cancelled || this->write_failed) {
+        // some of the times were rewritten, the index gets built again next time the file is played
+        remove(index_path.c_str());
+        if(this->cancelled) stream->printf("Estimate aborted\r\n");
+        else stream->printf("Could not write %s\r\n", index_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// called with each block as it would have run, in the order they were queued
+void TimeEstimator::block_done(void *object, Block *block)
+{
+    TimeEstimator *estimator = static_cast<TimeEstimator *>(object);
+    // lines queued before this block start as soon as the blocks before it are done
+    estimator->settle(estimator->blocks_done);
+    estimator->time += block->duration();
+    estimator->blocks_done++;
+}
+
+void TimeEstimator::settle(uint32_t blocks)
+{
+    while(!this->marks.empty() && this->marks.front().blocks <= blocks) {
+        const mark_t &mark = this->marks.front();
+        if(mark.entry < 0) {
+            this->time += mark.dwell;
+        } else if(!this->write_failed && !write_time(mark.entry, this->time)) {
+            this->write_failed = true;
+        }
+        this->marks.pop_front();
+    }
+}
+
+// entries for line and any before it are timed once the blocks queued so far are done
+void TimeEstimator::mark_entries(unsigned long line)
+{
+    while(this->next_entry_i < this->header.entries && this->next_entry.line <= line) {
+        this->marks.push_back({THEKERNEL->conveyor->get_dry_run_queued(), (int32_t)this->next_entry_i, 0});
+        if(++this->next_entry_i < this->header.entries && !read_entry(this->next_entry_i, this->next_entry)) {
+            this->write_failed = true;
+            this->next_entry_i = this->header.entries;
+        }
+    }
+}
+
+// the same clean up GcodeDispatch does, then only what moves the robot or changes how it moves is passed on
+void TimeEstimator::simulate(char *line)
+{
+    char *comment = strpbrk(line, ";(");
+    if(comment != NULL) *comment = '\0';
+    while(*line == ' ') line++;
+    if(*line == 'N') {
+        char *checksum = strchr(line, '*');
+        if(checksum != NULL) *checksum = '\0';
+        line += strspn(line, "N0123456789.,- ");
+    }
+    if(*line == '\0') return;
+
+    char buf[LineReader::max_line + 8];
+    if(strchr("XYZF", *line) != NULL) {
+        // pycam syntax, coordinates on their own continue the last G0 or G1
+        if(this->motion < 0) return;
+        snprintf(buf, sizeof(buf), "G%d %s", this->motion, line);
+        line = buf;
+    }
+
+    // assumes G or M are always the first on the line
+    while(*line != '\0') {
+        size_t n = strlen(line);
+        char *next = n > 2 ? strpbrk(line + 2, "GM") : NULL;
+        string command = next != NULL ? string(line, next - line) : string(line);
+        line = next != NULL ? next : line + n;
+
+        Gcode gcode(command, &(StreamOutput::NullStream));
+        // M codes are left alone, they would heat, wait or switch things, but the extruders need the E mode
+        if(gcode.has_m && (gcode.m == 82 || gcode.m == 83)) plan_extruders(&gcode);
+        if(!gcode.has_g) continue;
+        this->motion = gcode.g <= 1 ? gcode.g : -1;
+
+        switch(gcode.g) {
+            case 0: case 1: case 2: case 3:
+            case 17: case 18: case 19:
+            case 20: case 21:
+            case 90: case 91:
+            case 92:
+                THEKERNEL->robot->on_gcode_received(&gcode);
+                // after the robot, as when the gcode is played, so a move is limited by what it extrudes
+                plan_extruders(&gcode);
+                break;
+
+            case 4: {
+                // the robot would really wait, so it is added once the moves before it are done
+                float seconds = 0;
+                if(gcode.has_letter('P')) seconds += gcode.get_int('P') / 1000.0F;
+                if(gcode.has_letter('S')) seconds += gcode.get_int('S');
+                this->marks.push_back({THEKERNEL->conveyor->get_dry_run_queued(), -1, seconds});
+                break;
+            }
+
+            case 28:
+                // homing is not simulated, the robot just ends the path it is holding, and the homed axes are taken to be at 0
+                THEKERNEL->robot->on_gcode_received(&gcode);
+                if(gcode.has_letter('X') || gcode.has_letter('Y') || gcode.has_letter('Z')) {
+                    for(char letter = 'X'; letter <= 'Z'; letter++) {
+                        if(gcode.has_letter(letter)) THEKERNEL->robot->reset_axis_position(0, letter - 'X');
+                    }
+                } else {
+                    THEKERNEL->robot->reset_axis_position(0, 0, 0);
+                }
+                break;
+        }
+    }
+}
+
+void TimeEstimator::plan_extruders(Gcode *gcode)
+{
+    PublicData::set_value(extruder_checksum, plan_gcode_checksum, gcode);
+}
+
+void TimeEstimator::send(const char *command)
+{
+    Gcode gcode(command, &(StreamOutput::NullStream));
+    THEKERNEL->robot->on_gcode_received(&gcode);
+}
+
+bool TimeEstimator::read_entry(uint32_t i, GcodeIndex::entry_t &entry)
+{
+    if(fseek(this->index, sizeof(GcodeIndex::header_t) + i * sizeof(GcodeIndex::entry_t), SEEK_SET) != 0) return false;
+    return fread(&entry, sizeof(entry), 1, this->index) == 1;
+}
+
+bool TimeEstimator::write_time(uint32_t i, float time)
+{
+    long at = sizeof(GcodeIndex::header_t) + i * sizeof(GcodeIndex::entry_t) + offsetof(GcodeIndex::entry_t, time);
+    if(fseek(this->index, at, SEEK_SET) != 0) return false;
+    return fwrite(&time, sizeof(time), 1, this->index) == 1;
+}
@@ -0,0 +1,72 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TIMEESTIMATOR_H
+#define TIMEESTIMATOR_H
+
+#include "GcodeIndex.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+using std::string;
+
+class Block;
+class Gcode;
+class StreamOutput;
+
+// Times a gcode file by running its moves through the Robot and the Planner with the Conveyor in a dry run,
+// so acceleration, junction speeds and the look ahead are accounted for just as they will be when it is played.
+// The times replace the distance over feedrate ones in the file's index, which must already exist.
+// It runs to the end before returning, calling ON_IDLE as it goes, nothing else may move or be queued meanwhile.
+// Only moves, dwells, units, positioning modes and G92 are simulated, homing is taken to end at 0,
+// extruder only moves and anything an M code changes, like the acceleration, are not timed.
+// The extruders plan E from the moves, G92 and M82/M83 as they would when it is played, so the speed limits see
+// each move's extrusion whether E is absolute or relative, and their plan is put back afterwards.
+class TimeEstimator {
+    public:
+        TimeEstimator();
+
+        bool run(const string &gcode_path, StreamOutput *stream);
+        // stops a run at the next line, on halt
+        void cancel() { cancelled = true; }
+
+        float get_total() const { return total; }
+
+    private:
+        struct mark_t {
+            uint32_t blocks; // blocks queued before the line
+            int32_t entry;   // index entry to time, or -1 for a dwell
+            float dwell;     // seconds
+        };
+
+        static void block_done(void *object, Block *block);
+        void settle(uint32_t blocks);
+        void mark_entries(unsigned long line);
+        void simulate(char *line);
+        void send(const char *command);
+        void plan_extruders(Gcode *gcode);
+        bool read_entry(uint32_t i, GcodeIndex::entry_t &entry);
+        bool write_time(uint32_t i, float time);
+
+        FILE *index;
+        GcodeIndex::header_t header;
+        GcodeIndex::entry_t next_entry;
+        uint32_t next_entry_i;
+        std::deque<mark_t> marks;
+        uint32_t blocks_done;
+        float time;
+        float total;
+        int8_t motion; // modal G0 or G1 for lines that only have coordinates, -1 otherwise
+        struct {
+            bool cancelled:1;
+            bool write_failed:1;
+        };
+};
+
+#endif // TIMEESTIMATOR_H
@@ -22,13 +22,18 @@
 #include "checksumm.h"
 #include "PublicData.h"
 #include "Gcode.h"
-//#include "StepTicker.h"
+#include "StepTicker.h"
+#include "Scheduler.h"
+#include "FileIO.h"
+#include "Profiler.h"
+#include "SamplingProfiler.h"
 
 #include "modules/tools/temperaturecontrol/TemperatureControlPublicAccess.h"
 #include "modules/robot/RobotPublicAccess.h"
 #include "NetworkPublicAccess.h"
 #include "platform_memory.h"
 #include "SwitchPublicAccess.h"
+#include "PlayerPublicAccess.h"
 #include "SDFAT.h"
 #include "Thermistor.h"
 
@@ -62,6 +67,9 @@ const SimpleShell::ptentry_t SimpleShell::commands_table[] = {
     {"?",        SimpleShell::help_command},
     {"version",  SimpleShell::version_command},
     {"mem",      SimpleShell::mem_command},
+    {"tasks",    SimpleShell::tasks_command},
+    {"profile",  SimpleShell::profile_command},
+    {"queue",    SimpleShell::queue_command},
     {"get",      SimpleShell::get_command},
     {"set_temp", SimpleShell::set_temp_command},
     {"switch",   SimpleShell::switch_command},
@@ -69,6 +77,7 @@ const SimpleShell::ptentry_t SimpleShell::commands_table[] = {
     {"load",     SimpleShell::load_command},
     {"save",     SimpleShell::save_command},
     {"remount",  SimpleShell::remount_command},
+    {"sdcache",  SimpleShell::sdcache_command},
     {"calc_thermistor", SimpleShell::calc_thermistor_command},
 
     // unknown command
@@ -265,6 +274,13 @@ void SimpleShell::remount_command( string parameters, StreamOutput *stream )
     stream->printf("remounted\r\n");
 }
 
+// show the sd sector cache hit rate, -r resets the counts
+void SimpleShell::sdcache_command( string parameters, StreamOutput *stream )
+{
+    mounter.report_cache(stream);
+    if (shift_parameter( parameters ) == "-r") mounter.reset_cache_stats();
+}
+
 // Delete a file
 void SimpleShell::rm_command( string parameters, StreamOutput *stream )
 {
@@ -355,14 +371,15 @@ void SimpleShell::upload_command( string parameters, StreamOutput *stream )
 
     // open file to upload to
     string upload_filename = absolute_from_relative( parameters );
-    FILE *fd = fopen(upload_filename.c_str(), "w");
-    if(fd != NULL) {
+    FileIOWriter upload_file;
+    if(upload_file.open(upload_filename.c_str())) {
         stream->printf("uploading to file: %s, send control-D or control-Z to finish\r\n", upload_filename.c_str());
     } else {
         stream->printf("failed to open file: %s.\r\n", upload_filename.c_str());
         return;
     }
 
+    // the file io task does not run while we wait here, so each buffer is written once the next one is full
     int cnt = 0;
     bool uploading = true;
     while(uploading) {
@@ -375,27 +392,24 @@ void SimpleShell::upload_command( string parameters, StreamOutput *stream )
         char c = stream->_getc();
         if( c == 4 || c == 26) { // ctrl-D or ctrl-Z
             uploading = false;
-            // close file
-            fclose(fd);
-            stream->printf("uploaded %d bytes\n", cnt);
+            // write what is left and close file
+            if(upload_file.close()) {
+                stream->printf("uploaded %d bytes\n", cnt);
+            } else {
+                stream->printf("error writing to file: %s\r\n", upload_filename.c_str());
+            }
+            // let the player index it in the background
+            PublicData::set_value(player_checksum, index_file_checksum, &upload_filename);
             return;
 
         } else {
             // write character to file
             cnt++;
-            if(fputc(c, fd) != c) {
+            if(!upload_file.write(&c, 1)) {
                 // error writing to file
                 stream->printf("error writing to file. ignoring all characters until EOF\r\n");
-                fclose(fd);
-                fd = NULL;
+                upload_file.close();
                 uploading= false;
-
-            } else {
-                if ((cnt%400) == 0) {
-                    // HACK ALERT to get around fwrite corruption close and re open for append
-                    fclose(fd);
-                    fd = fopen(upload_filename.c_str(), "a");
-                }
             }
         }
     }
@@ -470,6 +484,55 @@ void SimpleShell::save_command( string parameters, StreamOutput *stream )
     stream->printf("Settings Stored to %s\r\n", filename.c_str());
 }
 
+// show how the main loop time is shared between the tasks, -r resets the counts after printing
+void SimpleShell::tasks_command( string parameters, StreamOutput *stream)
+{
+    THEKERNEL->scheduler->report(stream);
+    if (shift_parameter( parameters ) == "-r") THEKERNEL->scheduler->reset_stats();
+}
+
+// show the planner queue telemetry, -r resets it after printing
+void SimpleShell::queue_command( string parameters, StreamOutput *stream)
+{
+    THEKERNEL->conveyor->report_stats(stream);
+    if (shift_parameter( parameters ) == "-r") THEKERNEL->conveyor->reset_stats();
+}
+
+// show the profiling zones, -r resets them after printing
+// profile start [hz] [samples], profile stop and profile dump control the sampling profiler
+void SimpleShell::profile_command( string parameters, StreamOutput *stream)
+{
+    string what = shift_parameter( parameters );
+
+    if (what == "start") {
+        string hz = shift_parameter( parameters );
+        string n = shift_parameter( parameters );
+        uint32_t frequency = hz.empty() ? 1000 : strtoul(hz.c_str(), NULL, 10);
+        uint32_t size = n.empty() ? 1024 : strtoul(n.c_str(), NULL, 10);
+        if (frequency < 10 || frequency > 20000 || size == 0) {
+            stream->printf("usage: profile start [10-20000 Hz] [samples]\r\n");
+        } else if (SamplingProfiler::start(frequency, size)) {
+            stream->printf("sampling at %lu Hz, keeping the last %lu samples\r\n", frequency, size);
+        } else {
+            stream->printf("not enough AHB0 memory for %lu samples\r\n", size);
+        }
+
+    } else if (what == "stop") {
+        SamplingProfiler::stop();
+
+    } else if (what == "dump") {
+        SamplingProfiler::dump(stream);
+
+    } else {
+#if PROFILE_ENABLE
+        Profiler::report(stream);
+        if (what == "-r") Profiler::reset();
+#else
+        stream->printf("profiling zones are not built in, build with make PROFILE=1 ( not available in Release builds )\r\n");
+#endif
+    }
+}
+
 // show free memory
 void SimpleShell::mem_command( string parameters, StreamOutput *stream)
 {
@@ -578,6 +641,12 @@ void SimpleShell::get_command( string parameters, StreamOutput *stream)
         } else {
             stream->printf("get pos command failed\r\n");
         }
+
+    } else if (what == "tick") {
+        // worst case acceleration tick since the last reset, add reset to start measuring again
+        uint32_t cycles = StepTicker::global_step_ticker->get_max_acceleration_tick_cycles();
+        stream->printf("acceleration tick max: %lu cycles, %1.2f us\r\n", cycles, cycles * 1000000.0F / SystemCoreClock);
+        if (shift_parameter( parameters ) == "reset") StepTicker::global_step_ticker->reset_max_acceleration_tick_cycles();
     }
 }
 
@@ -656,6 +725,10 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("Commands:\r\n");
     stream->printf("version\r\n");
     stream->printf("mem [-v]\r\n");
+    stream->printf("tasks [-r] - shows main loop time per task, -r resets the counts\r\n");
+    stream->printf("queue [-r] - shows planner queue depth, starvation and wait times, -r resets them\r\n");
+    stream->printf("profile [-r] - shows the hot path timings when built with PROFILE=1, -r resets them\r\n");
+    stream->printf("profile start [hz] [samples] | stop | dump - sample the PC, symbolize the dump with smoothie-profile.py\r\n");
     stream->printf("ls [-s] [folder]\r\n");
     stream->printf("cd folder\r\n");
     stream->printf("pwd\r\n");
@@ -663,9 +736,13 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("rm file\r\n");
     stream->printf("mv file newfile\r\n");
     stream->printf("remount\r\n");
+    stream->printf("sdcache [-r] - shows the sd sector cache hit rate, -r resets the counts\r\n");
     stream->printf("play file [-v]\r\n");
     stream->printf("progress - shows progress of current play\r\n");
     stream->printf("abort - abort currently playing file\r\n");
+    stream->printf("seek byte_offset - continue a paused or suspended play from the first line at or after the offset\r\n");
+    stream->printf("seek line|layer number - continue a paused or suspended play from a line or layer, once the file is indexed\r\n");
+    stream->printf("estimate file [-v] - time a file by planning its moves without moving, -v lists the layers\r\n");
     stream->printf("reset - reset smoothie\r\n");
     stream->printf("dfu - enter dfu boot loader\r\n");
     stream->printf("break - break into debugger\r\n");
@@ -674,6 +751,7 @@ void SimpleShell::help_command( string parameters, StreamOutput *stream )
     stream->printf("get temp [bed|hotend]\r\n");
     stream->printf("set_temp bed|hotend 185\r\n");
     stream->printf("get pos\r\n");
+    stream->printf("get tick [reset]\r\n");
     stream->printf("net\r\n");
     stream->printf("load [file] - loads a configuration override file from soecified name or config-override\r\n");
     stream->printf("save [file] - saves a configuration override file as specified filename or as config-override\r\n");
@@ -46,6 +46,9 @@ private:
     static void calc_thermistor_command( string parameters, StreamOutput *stream);
     static void switch_command(string parameters, StreamOutput *stream );
     static void mem_command(string parameters, StreamOutput *stream );
+    static void tasks_command(string parameters, StreamOutput *stream );
+    static void profile_command(string parameters, StreamOutput *stream );
+    static void queue_command(string parameters, StreamOutput *stream );
 
     static void net_command( string parameters, StreamOutput *stream);
 
@@ -53,6 +56,7 @@ private:
     static void save_command( string parameters, StreamOutput *stream);
 
     static void remount_command( string parameters, StreamOutput *stream);
+    static void sdcache_command( string parameters, StreamOutput *stream);
 
     bool parse_command(const char *cmd, string args, StreamOutput *stream);
 
@@ -0,0 +1,197 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host round trip of compressed gcode: writes a sample gcode file next to the test binary, compresses it with
+// smoothie-compress.py for a few window and lookahead sizes, and reads each back through LineReader, which
+// decompresses it with ShrinkReader, with and without read ahead.
+// Checks that the lines, the too long flags, the line offsets and counts are the same as reading the sample itself,
+// and that random seeks land on the same line as a seek in the sample. Needs python3 to run the compressor.
+
+#include "modules/utils/player/LineReader.h"
+#include "modules/utils/player/ShrinkReader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static const int sample_lines = 12000;
+static const int seeks = 100;
+
+struct Line {
+    string text;
+    bool too_long;
+    unsigned long offset;
+    unsigned long number;       // lines before it
+};
+
+static unsigned long write_sample(const string &path)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if(f == NULL) return 0;
+
+    string s = "; sample for the compressed gcode test\nG21\nG90\nM82\nG28\n";
+    float e = 0;
+    for (int i = 0; i < sample_lines; i++) {
+        char line[96];
+        if(i % 1000 == 0) {
+            snprintf(line, sizeof(line), ";LAYER:%d\nG1 Z%.2f F600\n", i / 1000, 0.2F + i / 1000 * 0.2F);
+            s += line;
+        } else if(i % 777 == 0) {
+            s += "; " + string(150 + i % 200, 'x') + "\n";   // too long to be played
+        } else if(i % 501 == 0) {
+            s += "\n";
+        } else {
+            e += 0.0271F;
+            snprintf(line, sizeof(line), "G1 X%.3f Y%.3f E%.5f%s\n", (i * 37 % 20000) / 100.0F, (i * 91 % 20000) / 100.0F,
+                     e, (i % 13 == 0) ? " F2400\r" : "");
+            s += line;
+        }
+    }
+    s += "M107\nM84";   // last line without a line ending
+
+    fwrite(s.data(), 1, s.size(), f);
+    fclose(f);
+    return s.size();
+}
+
+// every line the reader hands out from where it is, with where it starts and how many lines are before it
+static vector<Line> read_all(LineReader &reader, size_t limit = 0)
+{
+    vector<Line> lines;
+    for(;;) {
+        size_t len;
+        bool too_long;
+        char *text = reader.next_line(len, too_long);
+        if(text == NULL) {
+            if(reader.waiting()) continue;
+            break;
+        }
+        Line l;
+        l.text.assign(text, len);
+        l.too_long = too_long;
+        l.offset = reader.offset_of(text);
+        l.number = reader.line() - 1;
+        lines.push_back(l);
+        if(limit > 0 && lines.size() == limit) break;
+    }
+    return lines;
+}
+
+static bool same(const vector<Line> &a, const vector<Line> &b)
+{
+    if(a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if(a[i].text != b[i].text || a[i].too_long != b[i].too_long || a[i].offset != b[i].offset ||
+           a[i].number != b[i].number) {
+            printf("  line %zu differs: '%s' at %lu, '%s' at %lu\n", i, a[i].text.c_str(), a[i].offset,
+                   b[i].text.c_str(), b[i].offset);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void round_trip(const string &plain, unsigned long size, const string &dir, int window, int lookahead)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/compressed_gcode_test_w%d_l%d.gcz", window, lookahead);
+    string packed = dir + name;
+    char command[512];
+    snprintf(command, sizeof(command), "python3 ../smoothie-compress.py -q -w %d -l %d -o %s %s", window, lookahead,
+             packed.c_str(), plain.c_str());
+    int r = system(command);
+    CHECK(r == 0);
+    if(r != 0) return;
+
+    FILE *pf = fopen(plain.c_str(), "rb");
+    FILE *cf = fopen(packed.c_str(), "rb");
+    CHECK(pf != NULL && cf != NULL);
+    if(pf == NULL || cf == NULL) return;
+
+    fseek(cf, 0, SEEK_END);
+    long packed_size = ftell(cf);
+    fseek(cf, 0, SEEK_SET);
+    printf("  window %d, lookahead %d: %lu bytes to %ld\n", window, lookahead, size, packed_size);
+
+    unsigned long content = 0;
+    CHECK(ShrinkReader::is_compressed(cf, &content));
+    CHECK(content == size);
+    CHECK(LineReader::size_of(cf) == size);
+    CHECK(!ShrinkReader::is_compressed(pf));
+
+    LineReader expected_reader;
+    CHECK(expected_reader.start(pf));
+    vector<Line> expected = read_all(expected_reader);
+    CHECK(expected.size() > (size_t)sample_lines);
+
+    struct { bool read_ahead; size_t sectors; } runs[] = { {false, 4}, {true, 4}, {false, 1}, {true, 8} };
+    for (auto &run : runs) {
+        fseek(cf, 0, SEEK_SET);
+        LineReader reader(run.read_ahead);
+        CHECK(reader.start(cf, run.sectors));
+        CHECK(reader.compressed());
+        CHECK(reader.content_size() == size);
+        vector<Line> lines = read_all(reader);
+        CHECK(same(lines, expected));
+        CHECK(reader.tell() == size);
+        CHECK(reader.line() == expected_reader.line());
+    }
+
+    // seeks to random offsets, and to the start of random lines with their line number
+    LineReader reader(true);
+    fseek(cf, 0, SEEK_SET);
+    CHECK(reader.start(cf, 4));
+    for (int s = 0; s < seeks && failures == 0; s++) {
+        unsigned long offset;
+        unsigned long line = 0;
+        if(s % 2 == 0) {
+            offset = rand() % (size + 1);
+        } else {
+            const Line &l = expected[rand() % expected.size()];
+            offset = l.offset;
+            line = l.number;
+        }
+        CHECK(expected_reader.seek(offset, line));
+        CHECK(reader.seek(offset, line));
+        CHECK(reader.tell() == expected_reader.tell());
+        CHECK(same(read_all(reader, 20), read_all(expected_reader, 20)));
+    }
+    reader.stop();
+    expected_reader.stop();
+
+    fclose(pf);
+    fclose(cf);
+    remove(packed.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+    string dir = argc > 1 ? argv[1] : ".";
+    string plain = dir + "/compressed_gcode_test.gcode";
+
+    srand(1);
+    unsigned long size = write_sample(plain);
+    CHECK(size > 0);
+
+    round_trip(plain, size, dir, 11, 4);
+    round_trip(plain, size, dir, 8, 3);
+    round_trip(plain, size, dir, 12, 6);
+
+    remove(plain.c_str());
+
+    if(failures == 0) printf("PASS\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host benchmark of the Kernel's event dispatch. A set of modules like a printer's hook ON_IDLE and ON_GCODE_RECEIVED,
+// some of them only handling a couple of M codes, the way Switch, Spindle and CurrentControl do.
+// Runs the events through EventHooks, and through the loop over modules calling the pointer to member handlers the
+// Kernel used before, and reports events/s and the cost of an event for each.
+// Also checks that a routed module only gets its own codes, and that modules are called in the order they registered.
+// Timings depend on the host, only the checks can fail.
+
+#include "libs/EventHooks.h"
+#include "libs/Kernel.h"
+#include "Gcode.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Module.cpp registers through the Kernel, nothing here does
+Kernel* Kernel::instance;
+void Kernel::register_for_event(_EVENT_ENUM id_event, Module *module) {}
+void Kernel::register_for_gcode(char letter, uint16_t code, Module *module) {}
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static std::vector<int> call_order;
+
+class TestModule : public Module {
+    public:
+        TestModule(int id, int m_code) : id(id), m_code(m_code), idles(0), gcodes(0), wrong(0) {}
+
+        void on_idle(void *argument) { idles++; }
+        void on_gcode_received(void *argument) {
+            Gcode *gcode = static_cast<Gcode *>(argument);
+            call_order.push_back(id);
+            if(m_code < 0) return;
+            // what a module that handles one code does with the others, a routed one should never see them
+            if(gcode->has_m && gcode->m == (unsigned int)m_code) gcodes++;
+            else wrong++;
+        }
+
+        int id;
+        int m_code;         // the only M code it handles, -1 for all gcodes
+        uint32_t idles, gcodes, wrong;  // wrong counts the other codes it was called for
+};
+
+static const int idle_modules = 24;
+static const int all_gcode_modules = 6;
+static const int routed_modules = 12;
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void report(const char *what, uint32_t events, double seconds)
+{
+    printf("  %-34s %10.0f events/s  %7.1f ns/event\n", what, events / seconds, seconds * 1e9 / events);
+}
+
+// the Kernel's dispatch before EventHooks
+static void call_each(std::vector<Module *> &modules, _EVENT_ENUM id_event, void *argument)
+{
+    for (auto m : modules) {
+        (m->*kernel_callback_functions[id_event])(argument);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<TestModule *> modules;
+    EventHooks hooks;
+    std::vector<Module *> old_idle, old_gcode;
+
+    for (int i = 0; i < idle_modules; i++) {
+        TestModule *m = new TestModule(i, -1);
+        modules.push_back(m);
+        hooks.add(ON_IDLE, m);
+        old_idle.push_back(m);
+    }
+    // modules that want every gcode and modules that want one M code, interleaved as they would load
+    for (int i = 0; i < all_gcode_modules + routed_modules; i++) {
+        bool routed = (i % 3 != 0);
+        TestModule *m = new TestModule(100 + i, routed ? 200 + i : -1);
+        modules.push_back(m);
+        if(routed) hooks.add_gcode('M', 200 + i, m);
+        else hooks.add(ON_GCODE_RECEIVED, m);
+        old_gcode.push_back(m);
+    }
+
+    // checks, a G1 reaches the modules that want every gcode in the order they registered and none of the routed ones,
+    // an M code also reaches the module routed for it, called where it registered among the others
+    Gcode g1("G1 X10 Y10", nullptr);
+    Gcode m205("M205 S1", nullptr);
+    std::vector<int> expected_g1, expected_m205;
+    for (int i = 0; i < all_gcode_modules + routed_modules; i++) {
+        if(i % 3 == 0) expected_g1.push_back(100 + i);
+        if(i % 3 == 0 || i == 5) expected_m205.push_back(100 + i);
+    }
+    call_order.clear();
+    hooks.call(ON_GCODE_RECEIVED, &g1);
+    CHECK(call_order == expected_g1);
+    call_order.clear();
+    hooks.call(ON_GCODE_RECEIVED, &m205);
+    CHECK(call_order == expected_m205);
+    call_order.reserve(64);
+
+    // benchmarks
+    const uint32_t idle_events = 2000000;
+    const uint32_t gcode_events = 2000000;
+    Gcode *lines[] = {&g1, &g1, &g1, &g1, &g1, &g1, &g1, &m205};
+    const int nlines = sizeof(lines) / sizeof(lines[0]);
+
+    printf("%d modules on ON_IDLE, %d on every gcode, %d on one M code each\n", idle_modules, all_gcode_modules, routed_modules);
+
+    Clock::time_point start = Clock::now();
+    for (uint32_t i = 0; i < idle_events; i++) call_each(old_idle, ON_IDLE, nullptr);
+    report("ON_IDLE, pointer to member loop", idle_events, seconds_since(start));
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < idle_events; i++) hooks.call(ON_IDLE, nullptr);
+    report("ON_IDLE, EventHooks", idle_events, seconds_since(start));
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < gcode_events; i++) {
+        call_each(old_gcode, ON_GCODE_RECEIVED, lines[i % nlines]);
+        call_order.clear();
+    }
+    report("ON_GCODE_RECEIVED, every module", gcode_events, seconds_since(start));
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < gcode_events; i++) {
+        hooks.call(ON_GCODE_RECEIVED, lines[i % nlines]);
+        call_order.clear();
+    }
+    report("ON_GCODE_RECEIVED, routed", gcode_events, seconds_since(start));
+
+    // every module saw every idle event from both, and the routed one its M code as often from both
+    for (int i = 0; i < idle_modules; i++) CHECK(modules[i]->idles == 2 * idle_events);
+    CHECK(modules[idle_modules + 5]->gcodes == 1 + 2 * (gcode_events / nlines));
+    // only the old loop calls modules for codes they do not handle
+    uint32_t wrong = 0;
+    for (auto m : modules) wrong += m->wrong;
+    CHECK(wrong == routed_modules * gcode_events - gcode_events / nlines);
+
+    for (auto m : modules) delete m;
+
+    if(failures == 0) printf("PASS\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host test of the E the extruder plans as gcodes are queued, which the robot's follow speed limit works from.
+// Writes the same print with absolute E, with G92 E0 resets, and with relative E, plans both the way the extruder
+// does when they are played or timed by the estimate command, and checks that every move is taken to extrude the
+// same whichever way E is written, as the extruder's speed limits would otherwise slow one of them down.
+// Also checks that an extruder that is not the active tool follows the modes but not the moves.
+
+#include "modules/tools/extruder/ExtruderPlan.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static const int layers = 40;
+static const int moves_per_layer = 50;
+
+static string line(const char *format, float a, float b, float e)
+{
+    char buf[96];
+    snprintf(buf, sizeof(buf), format, a, b, e);
+    return buf;
+}
+
+// the moves of a print, with a retract and prime at every layer change
+static vector<string> print(bool absolute)
+{
+    vector<string> lines;
+    lines.push_back("G21");
+    lines.push_back("G90");
+    lines.push_back(absolute ? "M82" : "M83");
+    lines.push_back("G92 E0");
+    float e = 0;
+    for (int l = 0; l < layers; l++) {
+        if(absolute && l % 10 == 5) {
+            // slicers reset E now and then so it does not lose precision
+            lines.push_back("G92 E0");
+            e = 0;
+        }
+        e -= 1.5F;
+        lines.push_back(absolute ? line("G1 E%.5f F2400", e, 0, 0) : "G1 E-1.50000 F2400");
+        lines.push_back(line("G0 Z%.2f X%.1f", 0.2F * (l + 1), 10, 0));
+        e += 1.5F;
+        lines.push_back(absolute ? line("G1 E%.5f", e, 0, 0) : "G1 E1.50000");
+        for (int m = 0; m < moves_per_layer; m++) {
+            float x = 10 + (m * 37 % 100), y = 10 + (m * 53 % 100);
+            float de = 0.02F + (m % 7) * 0.01F;
+            e += de;
+            lines.push_back(line("G1 X%.3f Y%.3f E%.5f", x, y, absolute ? e : de));
+        }
+    }
+    lines.push_back("M107");
+    return lines;
+}
+
+// what each move with E extrudes, as the robot sees it when it plans the move, which comes before the extruder does
+static vector<float> plan(const vector<string> &lines, ExtruderPlan &p, bool enabled)
+{
+    vector<float> extrusions;
+    for (const string &l : lines) {
+        Gcode gcode(l, nullptr);
+        if(gcode.has_g && gcode.g < 4 && gcode.has_letter('E')) extrusions.push_back(p.extrusion(&gcode));
+        p.plan(&gcode, enabled);
+    }
+    return extrusions;
+}
+
+int main(int argc, char *argv[])
+{
+    ExtruderPlan abs_plan = {0, true};
+    ExtruderPlan rel_plan = {0, true};
+    vector<float> abs_e = plan(print(true), abs_plan, true);
+    vector<float> rel_e = plan(print(false), rel_plan, true);
+    printf("%zu moves with E\n", abs_e.size());
+
+    CHECK(abs_e.size() == rel_e.size());
+    float worst = 0;
+    for (size_t i = 0; i < abs_e.size() && i < rel_e.size(); i++) {
+        worst = fmaxf(worst, fabsf(abs_e[i] - rel_e[i]));
+    }
+    printf("  worst difference %g mm\n", worst);
+    CHECK(worst < 0.001F);
+    // no move is taken for more than it extrudes, as it would be from a plan that missed the moves before it
+    for (float e : abs_e) CHECK(fabsf(e) <= 1.5F + 0.0001F);
+    CHECK(abs_plan.absolute && !rel_plan.absolute);
+
+    // a plan put back after a dry run is the same as before it
+    ExtruderPlan saved = abs_plan;
+    plan(print(false), abs_plan, true);
+    abs_plan = saved;
+    CHECK(plan(print(true), abs_plan, true) == abs_e);
+
+    // another extruder follows M82/M83 and G90/G91, its position only changes when it is the active tool
+    ExtruderPlan idle = {12.5F, true};
+    plan(print(false), idle, false);
+    CHECK(!idle.absolute);
+    CHECK(idle.position == 12.5F);
+
+    if(failures == 0) printf("PASS\n");
+    return failures == 0 ? 0 : 1;
+}
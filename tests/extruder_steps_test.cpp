@@ -0,0 +1,104 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host test of the steps a FOLLOW mode extruder gets for each block. Runs many short blocks of random length through
+// the split the extruder does on a block's start: pressure advance works out what the block moves, retracts included,
+// each mixing channel takes its share, and carry_steps turns that into whole steps.
+// Counts the steps of each channel in every block and checks that what is carried stays under a step, so no block is
+// more than that off what it moves, that none steps the wrong way, and that the totals stay within a step and a bit
+// of float rounding of what was asked for, whatever the blocks, so nothing drifts over a print.
+// The axes' own steps come from the absolute step positions in StepperMotor::steps_to_target, which cannot drift,
+// and the Stepper that steps them all on one tick needs the step timer, so it is not run here.
+
+#include "modules/tools/extruder/PressureAdvance.h"
+#include "modules/tools/extruder/StepCarry.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static const int blocks = 200000;
+static const float xy_steps_per_mm = 80;
+
+static float random_between(float lo, float hi)
+{
+    return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+static void run(int channels, float e_steps_per_mm, float k)
+{
+    printf("%d channels, %g steps/mm, k=%g\n", channels, e_steps_per_mm, k);
+
+    float mix[4];
+    float sum = 0;
+    for (int c = 0; c < channels; c++) {
+        mix[c] = random_between(0.05F, 1);
+        sum += mix[c];
+    }
+    for (int c = 0; c < channels; c++) mix[c] /= sum;
+
+    PressureAdvance pa;
+    pa.configure(k, 0, 1000);
+
+    float unstepped[4] = {0, 0, 0, 0};
+    double exact[4] = {0, 0, 0, 0};      // mm each channel should have moved
+    long stepped[4] = {0, 0, 0, 0};
+    int retracts = 0, wrong_way = 0;
+    float worst = 0, worst_carry = 0;
+
+    float rate = 0;
+    for (int b = 0; b < blocks; b++) {
+        float length = random_between(0.01F, 2);
+        uint32_t steps_event_count = ceilf(length * xy_steps_per_mm);
+        float initial_rate = rate;
+        rate = (b % 50 == 49) ? 0 : random_between(0, 100) * xy_steps_per_mm;
+        bool hold_lead = (b % 50 != 48);
+
+        float travel = length * random_between(0.01F, 0.08F);
+        float move = pa.enabled() ? pa.begin_block(travel, initial_rate, rate, steps_event_count, hold_lead) : travel;
+        if(move < 0) retracts++;
+
+        for (int c = 0; c < channels; c++) {
+            float distance = move * mix[c];
+            int steps = carry_steps(distance, unstepped[c], e_steps_per_mm);
+            stepped[c] += steps;
+            exact[c] += distance;
+
+            float off = fabsf(steps - distance * e_steps_per_mm);
+            if(off > worst) worst = off;
+            float carry = fabsf(unstepped[c] * e_steps_per_mm);
+            if(carry > worst_carry) worst_carry = carry;
+            if(steps != 0 && (steps > 0) != (distance > 0) && fabsf(distance) * e_steps_per_mm >= 1) wrong_way++;
+        }
+    }
+
+    printf("  %d blocks retract, worst block %.3f steps off its move, worst carry %.3f steps\n", retracts, worst, worst_carry);
+    CHECK(worst_carry < 1);
+    CHECK(worst < 2);
+    CHECK(wrong_way == 0);
+    for (int c = 0; c < channels; c++) {
+        double off = stepped[c] - exact[c] * e_steps_per_mm;
+        printf("  channel %d: %ld steps for %.3f mm, %.3f steps off\n", c, stepped[c], exact[c], off);
+        CHECK(fabs(off) < 1.5);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    srand(1);
+    run(1, 140, 0);
+    run(1, 837, 0.05F);
+    run(3, 415, 0.2F);
+    run(4, 96, 0.1F);
+
+    if(failures == 0) printf("PASS\n");
+    return failures == 0 ? 0 : 1;
+}
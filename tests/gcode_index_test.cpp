@@ -0,0 +1,306 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host test of the gcode index: builds the index of a sample gcode file and checks its header, its entries, where
+// it finds the layers starting, and that seeking the player's reader to an entry lands on the right line.
+// One sample has its layers found from the moves, with a Z hop that must not count as one, the other has
+// ;LAYER: comments. Also checks that an edit keeping the size makes the index stale, and that a vase mode file can
+// have more layers than fit in 16 bits. The files are written next to the test binary.
+
+#include "modules/utils/player/GcodeIndex.h"
+#include "modules/utils/player/LineReader.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static const uint16_t interval = 8;
+
+struct Sample {
+    vector<string> lines;
+    vector<unsigned long> offsets;       // of each line
+    vector<unsigned long> layer_starts;  // line of each layer start, layer 1 first
+    vector<float> layer_z;               // z of each layer start entry
+    unsigned long size;
+
+    void add(const string &line) {
+        offsets.push_back(size);
+        lines.push_back(line);
+        size += line.size() + 1;
+    }
+    void layer(float z) {
+        layer_starts.push_back(lines.size());
+        layer_z.push_back(z);
+    }
+    // the layer a line belongs to
+    unsigned int layer_of(unsigned long line) const {
+        unsigned int l = 0;
+        while(l < layer_starts.size() && layer_starts[l] <= line) l++;
+        return l;
+    }
+};
+
+static void perimeter(Sample &s, float e)
+{
+    const char *corners[] = {"X20 Y0", "X20 Y20", "X0 Y20", "X0 Y0"};
+    for (int i = 0; i < 4; i++) {
+        char line[64];
+        e += 0.8F;
+        snprintf(line, sizeof(line), "G1 %s E%.3f F1800", corners[i], e);
+        s.add(line);
+    }
+}
+
+// layers found from the moves, with a Z hop in the middle of the first one
+static Sample moves_sample()
+{
+    Sample s = Sample();
+    s.add("; sample with no layer comments");
+    s.add("G21");
+    s.add("G90");
+    s.add("M82");
+    s.add("G28");
+    s.add("");
+    s.add("; " + string(200, 'x')); // too long to be played, still counts as a line
+    s.add("G92 E0");
+    s.layer(0.2F);
+    s.add("G1 Z0.2 F600");
+    perimeter(s, 0);
+    s.add("G1 Z0.6 F600");
+    s.add("G0 X5 Y5");
+    s.add("G1 Z0.2");
+    perimeter(s, 3.2F);
+    s.layer(0.4F);
+    s.add("G1 Z0.4 F600");
+    perimeter(s, 6.4F);
+    s.add("G4 P500");
+    s.layer(0.6F);
+    s.add("G1 Z0.6 F600");
+    perimeter(s, 9.6F);
+    s.add("M107");
+    return s;
+}
+
+// layers given by the slicer
+static Sample comments_sample()
+{
+    Sample s = Sample();
+    s.add("G21");
+    s.add("G90");
+    s.add("G92 E0");
+    for (int l = 0; l < 5; l++) {
+        char line[32];
+        // a layer comment comes before the Z move, so its entry has the Z the line starts at
+        s.layer(0.2F * l);
+        snprintf(line, sizeof(line), ";LAYER:%d", l);
+        s.add(line);
+        snprintf(line, sizeof(line), "G1 Z%.1f F600", 0.2F * (l + 1));
+        s.add(line);
+        perimeter(s, l * 3.2F);
+    }
+    return s;
+}
+
+static bool write_file(const string &path, const Sample &s)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if(f == NULL) return false;
+    for (const string &line : s.lines) fprintf(f, "%s\n", line.c_str());
+    return fclose(f) == 0;
+}
+
+static bool build_index(const string &path)
+{
+    GcodeIndexer indexer;
+    if(!indexer.start(path, interval, 1000, 3000)) return false;
+    while(indexer.step(5)) ;
+    return indexer.succeeded();
+}
+
+static vector<GcodeIndex::entry_t> read_entries(const string &path, GcodeIndex::header_t &header)
+{
+    vector<GcodeIndex::entry_t> entries;
+    FILE *f = fopen(GcodeIndex::path_for(path).c_str(), "r");
+    if(f == NULL) return entries;
+    if(fread(&header, sizeof(header), 1, f) == 1) {
+        GcodeIndex::entry_t e;
+        while(fread(&e, sizeof(e), 1, f) == 1) entries.push_back(e);
+    }
+    fclose(f);
+    return entries;
+}
+
+// changes a byte of the gcode file, and whether its index still opens, then puts the byte back
+static bool edited_index_opens(const string &path, unsigned long size, unsigned long at)
+{
+    FILE *f = fopen(path.c_str(), "r+b");
+    if(f == NULL) return true;
+    fseek(f, at, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, at, SEEK_SET);
+    fputc(c ^ 1, f);
+    fclose(f);
+
+    GcodeIndex index;
+    bool opens = index.open(path, size);
+    index.close();
+
+    f = fopen(path.c_str(), "r+b");
+    if(f == NULL) return opens;
+    fseek(f, at, SEEK_SET);
+    fputc(c, f);
+    fclose(f);
+    return opens;
+}
+
+static void check_sample(const string &path, const Sample &s)
+{
+    printf("%s: %zu lines, %zu layers\n", path.c_str(), s.lines.size(), s.layer_starts.size());
+    CHECK(write_file(path, s));
+    CHECK(build_index(path));
+
+    // header
+    GcodeIndex::header_t header;
+    vector<GcodeIndex::entry_t> entries = read_entries(path, header);
+    CHECK(memcmp(header.magic, "SGIX", 4) == 0);
+    CHECK(header.version == GcodeIndex::version);
+    CHECK(header.interval == interval);
+    CHECK(header.source_size == s.size);
+    CHECK(header.lines == s.lines.size());
+    CHECK(header.entries == entries.size());
+    CHECK(header.layers == s.layer_starts.size());
+    CHECK(header.total_time > 0);
+
+    // entries, in line order, at the right offsets, one at every multiple of the interval and one at every layer start
+    for (size_t i = 0; i < entries.size(); i++) {
+        const GcodeIndex::entry_t &e = entries[i];
+        CHECK(e.line < s.lines.size());
+        if(e.line >= s.lines.size()) continue;
+        if(i > 0) {
+            CHECK(e.line > entries[i - 1].line);
+            CHECK(e.time >= entries[i - 1].time);
+        }
+        CHECK(e.offset == s.offsets[e.line]);
+        CHECK(e.layer == s.layer_of(e.line));
+        bool is_start = false;
+        for (unsigned long l : s.layer_starts) is_start = is_start || l == e.line;
+        CHECK(((e.flags & GcodeIndex::layer_start) != 0) == is_start);
+    }
+    for (unsigned long line = 0; line < s.lines.size(); line += interval) {
+        bool found = false;
+        for (const GcodeIndex::entry_t &e : entries) found = found || e.line == line;
+        CHECK(found);
+    }
+
+    GcodeIndex index;
+    CHECK(!index.open(path, s.size + 1)); // stale, the file changed
+    CHECK(index.open(path, s.size));
+    // stale, edits at either end that keep the size
+    CHECK(!edited_index_opens(path, s.size, 3));
+    CHECK(!edited_index_opens(path, s.size, s.size - 3));
+    CHECK(index.open(path, s.size));
+
+    // layer starts
+    for (size_t l = 0; l < s.layer_starts.size(); l++) {
+        GcodeIndex::entry_t e;
+        CHECK(index.find_layer(l + 1, e));
+        CHECK(e.line == s.layer_starts[l]);
+        CHECK(fabsf(e.z - s.layer_z[l]) < 0.001F);
+    }
+    GcodeIndex::entry_t none;
+    CHECK(!index.find_layer(0, none));
+    CHECK(!index.find_layer(s.layer_starts.size() + 1, none));
+
+    // seeks by line and by offset find the last entry at or before it, and the reader picks up from there
+    LineReader reader;
+    FILE *gcode = fopen(path.c_str(), "r");
+    CHECK(gcode != NULL && reader.start(gcode, 1));
+    float last_time = 0;
+    for (unsigned long line = 0; line < s.lines.size(); line++) {
+        const GcodeIndex::entry_t *want = NULL;
+        for (const GcodeIndex::entry_t &e : entries) if(e.line <= line) want = &e;
+
+        GcodeIndex::entry_t e;
+        CHECK(index.find_line(line, e) && want != NULL && e.line == want->line);
+        CHECK(index.find_offset(s.offsets[line], e) && want != NULL && e.line == want->line);
+        CHECK(index.layer_at(line) == s.layer_of(line));
+        float t = index.time_at(line);
+        CHECK(t >= last_time && t <= header.total_time);
+        last_time = t;
+
+        // seek to the entry, then skip to the line, as the player does
+        CHECK(reader.seek(e.offset, e.line));
+        while(reader.line() < line && reader.skip_line()) ;
+        size_t len;
+        bool too_long;
+        char *text = reader.next_line(len, too_long);
+        if(s.lines[line].size() > LineReader::max_line) continue;
+        CHECK(text != NULL && s.lines[line] == string(text, len));
+        CHECK(reader.line() == line + 1);
+    }
+    reader.stop();
+    if(gcode != NULL) fclose(gcode);
+
+    remove(GcodeIndex::path_for(path).c_str());
+    remove(path.c_str());
+}
+
+// a vase mode file, a layer for every few moves
+static void check_many_layers(const string &path)
+{
+    const unsigned int layers = 70000;
+    FILE *f = fopen(path.c_str(), "w");
+    CHECK(f != NULL);
+    if(f == NULL) return;
+    fprintf(f, "G21\nG90\nM82\n");
+    for (unsigned int l = 1; l <= layers; l++) {
+        fprintf(f, ";LAYER:%u\nG1 Z%.3f X%u Y0 E%u\n", l - 1, l * 0.01F, l % 2 * 10, l);
+    }
+    fclose(f);
+    printf("%s: %u layers\n", path.c_str(), layers);
+
+    CHECK(build_index(path));
+    GcodeIndex::header_t header;
+    vector<GcodeIndex::entry_t> entries = read_entries(path, header);
+    CHECK(header.layers == layers);
+    CHECK(!entries.empty() && entries.back().layer == layers);
+
+    FILE *gcode = fopen(path.c_str(), "r");
+    fseek(gcode, 0, SEEK_END);
+    unsigned long size = ftell(gcode);
+    fclose(gcode);
+    GcodeIndex index;
+    GcodeIndex::entry_t e;
+    CHECK(index.open(path, size));
+    CHECK(index.find_layer(layers, e) && e.line == 3 + (layers - 1) * 2);
+    CHECK(index.find_layer(65537, e) && e.line == 3 + 65536 * 2);
+    CHECK(index.layer_at(3 + (layers - 1) * 2) == layers);
+    index.close();
+
+    remove(GcodeIndex::path_for(path).c_str());
+    remove(path.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+    string dir = argc > 1 ? argv[1] : ".";
+    check_sample(dir + "/index_moves.gcode", moves_sample());
+    check_sample(dir + "/index_comments.gcode", comments_sample());
+    check_many_layers(dir + "/index_vase.gcode");
+
+    if(failures == 0) printf("all passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host benchmark of reading a played file. Writes a sample gcode file next to the test binary and reads it back the
+// way the player used to, fgets into a 130 byte buffer through a FILE with a sector of buffer, and through LineReader
+// with and without read ahead, reporting lines/s for each. Checks that all of them hand out the same lines.
+// The host's page cache stands in for the card, so this times the per line cost, not the reads, which on the board
+// go from one per sector to one per chunk.
+// Timings depend on the host, only the checks can fail.
+
+#include "modules/utils/player/LineReader.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static const unsigned long sample_lines = 1000000;
+
+typedef std::chrono::steady_clock Clock;
+
+// a sum of the lines handed out, so the readers can be compared without keeping them
+struct Lines {
+    unsigned long count;
+    unsigned long hash;
+
+    Lines() : count(0), hash(5381) {}
+    void add(const char *line, size_t len) {
+        count++;
+        for (size_t i = 0; i < len; i++) hash = hash * 33 + (unsigned char)line[i];
+        hash = hash * 33 + '\n';
+    }
+};
+
+static void report(const char *what, const Lines &lines, unsigned long size, double seconds)
+{
+    printf("  %-28s %10.0f lines/s  %6.1f MB/s\n", what, lines.count / seconds, size / seconds / 1e6);
+}
+
+static unsigned long write_sample(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if(f == NULL) return 0;
+
+    unsigned long size = 0;
+    float e = 0;
+    for (unsigned long i = 0; i < sample_lines; i++) {
+        char line[160];
+        int n;
+        if(i % 5000 == 0) {
+            n = snprintf(line, sizeof(line), ";LAYER:%lu\n", i / 5000);
+        } else if(i % 997 == 0) {
+            // too long to be played, skipped by both
+            n = snprintf(line, sizeof(line), "; %s\n", std::string(140, 'x').c_str());
+        } else {
+            e += 0.0317F;
+            n = snprintf(line, sizeof(line), "G1 X%.3f Y%.3f E%.5f%s\n", (i * 7 % 20000) / 100.0F, (i * 13 % 20000) / 100.0F, e,
+                         (i % 7 == 0) ? " F1800\r" : "");
+        }
+        fwrite(line, 1, n, f);
+        size += n;
+    }
+    fclose(f);
+    return size;
+}
+
+// what Player::on_main_loop did before LineReader, skipping lines too long for the buffer the same way
+static Lines read_fgets(FILE *f)
+{
+    Lines lines;
+    char buf[130];
+    bool discard = false;
+    while(fgets(buf, sizeof(buf), f) != NULL) {
+        size_t len = strlen(buf);
+        if(len > 0 && buf[len - 1] == '\n') {
+            if(discard) {
+                discard = false;
+                continue;
+            }
+            len--;
+            if(len > 0 && buf[len - 1] == '\r') len--;
+            if(len > LineReader::max_line) continue;
+            lines.add(buf, len);
+        } else if(!feof(f)) {
+            discard = true;
+        } else if(!discard) {
+            lines.add(buf, len);
+        }
+    }
+    return lines;
+}
+
+static Lines read_lines(LineReader &reader, FILE *f, size_t sectors)
+{
+    Lines lines;
+    CHECK(reader.start(f, sectors));
+    size_t len;
+    bool too_long;
+    for(;;) {
+        char *line = reader.next_line(len, too_long);
+        if(line == NULL) {
+            if(reader.waiting()) continue;
+            break;
+        }
+        lines.add(line, len);
+    }
+    reader.stop();
+    return lines;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = argc > 1 ? argv[1] : ".";
+    std::string path = dir + "/line_reader_bench.gcode";
+
+    unsigned long size = write_sample(path);
+    CHECK(size > 0);
+    printf("%lu lines, %lu bytes\n", sample_lines, size);
+
+    FILE *f = fopen(path.c_str(), "rb");
+    CHECK(f != NULL);
+    if(f == NULL) return 1;
+    // the board's FILE fills its buffer with a read of a sector
+    setvbuf(f, NULL, _IOFBF, LineReader::sector_size);
+    Clock::time_point start = Clock::now();
+    Lines old_lines = read_fgets(f);
+    report("fgets, 512 byte buffer", old_lines, size, std::chrono::duration<double>(Clock::now() - start).count());
+    fclose(f);
+
+    struct { size_t sectors; bool read_ahead; const char *what; } runs[] = {
+        {4, false, "LineReader, 4 sectors"},
+        {8, false, "LineReader, 8 sectors"},
+        {4, true, "LineReader, 4 sectors ahead"},
+    };
+    for (auto &run : runs) {
+        f = fopen(path.c_str(), "rb");
+        LineReader reader(run.read_ahead);
+        start = Clock::now();
+        Lines lines = read_lines(reader, f, run.sectors);
+        report(run.what, lines, size, std::chrono::duration<double>(Clock::now() - start).count());
+        fclose(f);
+
+        CHECK(lines.count == old_lines.count);
+        CHECK(lines.hash == old_lines.hash);
+    }
+
+    remove(path.c_str());
+
+    if(failures == 0) printf("PASS\n");
+    return failures == 0 ? 0 : 1;
+}
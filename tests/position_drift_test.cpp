@@ -0,0 +1,77 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host test of the integer position: runs 10^7 random relative (G91) moves with 3 decimals, as a slicer writes them,
+// through the same parsing and nanometer rounding Robot uses, and checks after every one that the position is
+// exactly the sum of the moves and that the actuator step position worked out from it, as steps_to_target does,
+// is the exact one. The float sum the position used to be kept in is run alongside to show the drift it had.
+
+#include "libs/nuts_bolts.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static const long segments = 10000000;
+static const int64_t max_um = 300000;           // moves stay on a 300mm bed
+static const int64_t max_move_um = 5000;
+
+// the exact step position of a position in microns, for a whole number of steps per mm
+static int64_t exact_steps(int64_t um, int64_t steps_per_mm)
+{
+    int64_t n = um * steps_per_mm;
+    return (n >= 0 ? n + 500 : n - 500) / 1000;
+}
+
+int main(int argc, char *argv[])
+{
+    const int64_t steps_per_mm[3] = {80, 80, 400};
+
+    int64_t exact_um[3] = {0, 0, 0};
+    int64_t last_milestone_nm[3] = {0, 0, 0};
+    float float_milestone[3] = {0, 0, 0};
+    double max_float_error = 0;
+
+    srand(1);
+    for (long s = 0; s < segments; s++) {
+        for (int a = X_AXIS; a <= Z_AXIS; a++) {
+            int64_t move = (rand() % (2 * max_move_um + 1)) - max_move_um;
+            if(exact_um[a] + move < 0 || exact_um[a] + move > max_um) move = -move;
+            exact_um[a] += move;
+
+            // what the gcode says, and how Gcode::get_value reads it back
+            char value[16];
+            snprintf(value, sizeof(value), "%.3f", move / 1000.0);
+            float v = strtof(value, nullptr);
+
+            last_milestone_nm[a] += mm_to_nm(v);
+            float_milestone[a] += v;
+
+            if(last_milestone_nm[a] != exact_um[a] * 1000) {
+                CHECK(last_milestone_nm[a] == exact_um[a] * 1000);
+                return 1;
+            }
+            if(lround(nm_to_mm(last_milestone_nm[a]) * steps_per_mm[a]) != exact_steps(exact_um[a], steps_per_mm[a])) {
+                CHECK(lround(nm_to_mm(last_milestone_nm[a]) * steps_per_mm[a]) == exact_steps(exact_um[a], steps_per_mm[a]));
+                return 1;
+            }
+
+            double err = fabs(float_milestone[a] - exact_um[a] / 1000.0);
+            if(err > max_float_error) max_float_error = err;
+        }
+    }
+
+    printf("%ld segments, integer position drift 0, a float sum drifts up to %f mm\n", segments, max_float_error);
+
+    if(failures == 0) printf("PASS\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host simulation of pressure advance over a ramp made of many short blocks, the way a curve or a small segment
+// slicer output is planned. The robot accelerates over several blocks, cruises, and decelerates over several more.
+// Or the ramp runs at speed into a travel move that does not extrude.
+// Checks that the extruder finishes every block with the axes, so the robot never waits on it, that the lead follows
+// k * extruder speed across the block boundaries instead of dropping back to zero at each one, that it is all taken
+// back by the stop or before the travel, retracting if it has to, and that the filament moved is what was asked for.
+
+#include "modules/tools/extruder/PressureAdvance.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+static const float ticks_per_second = 1000;
+static const float step_frequency = 100000;
+static const float xy_steps_per_mm = 80;
+static const float e_steps_per_mm = 400;
+static const float e_per_mm = 0.05F;         // mm of filament per mm of travel
+static const float acceleration = 1000;      // mm/s^2
+static const float block_length = 0.5F;      // mm
+
+struct Block {
+    uint32_t steps_event_count;
+    float initial_rate, final_rate, rate_delta;
+    int phase;                               // 1 accelerating, 0 cruising, -1 decelerating
+};
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    if(!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// a ramp up to speed over accel_blocks blocks, cruise_blocks at speed, and back down to stop, unless it goes into a travel
+static std::vector<Block> plan(int accel_blocks, int cruise_blocks, bool into_travel)
+{
+    std::vector<Block> blocks;
+    uint32_t steps = block_length * xy_steps_per_mm;
+    float rate_delta = acceleration * xy_steps_per_mm / ticks_per_second;
+    float v = 0;
+    for(int i = 0; i < accel_blocks; i++) {
+        float v1 = sqrtf(v * v + 2 * acceleration * block_length);
+        blocks.push_back({steps, v * xy_steps_per_mm, v1 * xy_steps_per_mm, rate_delta, 1});
+        v = v1;
+    }
+    for(int i = 0; i < cruise_blocks; i++) blocks.push_back({steps, v * xy_steps_per_mm, v * xy_steps_per_mm, rate_delta, 0});
+    if(into_travel) return blocks;
+    for(int i = 0; i < accel_blocks; i++) {
+        float v1 = sqrtf(fmaxf(v * v - 2 * acceleration * block_length, 0));
+        blocks.push_back({steps, v * xy_steps_per_mm, v1 * xy_steps_per_mm, rate_delta, -1});
+        v = v1;
+    }
+    return blocks;
+}
+
+static void simulate(float k, float smooth_time, int accel_blocks, int cruise_blocks, bool into_travel)
+{
+    printf("k=%g smooth=%g, %d blocks ramping, %d cruising%s\n", k, smooth_time, accel_blocks, cruise_blocks, into_travel ? ", then a travel" : "");
+    std::vector<Block> blocks = plan(accel_blocks, cruise_blocks, into_travel);
+
+    PressureAdvance pa;
+    pa.configure(k, smooth_time, ticks_per_second);
+
+    float distance = block_length * e_per_mm;
+    float e_position = 0, nominal = 0, moved = 0, max_lead_error = 0, expected = 0;
+    double robot_wait = 0;
+    uint32_t ticks_per_tick = step_frequency / ticks_per_second;
+    int retracts = 0;
+
+    for(size_t b = 0; b < blocks.size(); b++) {
+        const Block &block = blocks[b];
+        bool last = (b + 1 == blocks.size());
+        float mm = pa.begin_block(distance, block.initial_rate, block.final_rate, block.steps_event_count, !last);
+        float want = last ? 0 : k * block.final_rate * distance / block.steps_event_count;
+        if(fabsf(mm - (distance + want - expected)) > 1e-5F) {
+            printf("  block %zu moves %.5f mm, asked for %.5f mm\n", b, mm, distance + want - expected);
+            failures++;
+        }
+        expected = want;
+
+        // the motor turns one way in a block
+        float direction = mm < 0 ? -1 : 1;
+        if(mm < 0) retracts++;
+        uint32_t e_steps = floorf(fabsf(mm) * e_steps_per_mm + 0.5F);
+
+        // the lead within a block is only k * extruder speed where that does not need the motor to turn back
+        float lead_drop = k * block.rate_delta * ticks_per_second * distance / block.steps_event_count;
+        bool free = block.phase >= 0 || (direction > 0 && lead_drop < distance);
+
+        // the Stepper's trapezoid, one rate per acceleration tick, ramping before the first step
+        float rate = block.initial_rate;
+        float robot_phase = 0, e_phase = 0;
+        uint32_t robot_stepped = 0, e_stepped = 0;
+        float e_rate = 0;
+        bool started = false;
+        while(robot_stepped < block.steps_event_count || e_stepped < e_steps) {
+            if(robot_stepped < block.steps_event_count) {
+                if(block.phase > 0 || !started) rate += block.phase > 0 ? block.rate_delta : 0;
+                if(block.phase < 0) rate = fmaxf(rate - block.rate_delta, block.rate_delta);
+                if(block.phase == 0) rate = block.initial_rate;
+                started = true;
+                pa.tick(rate, robot_stepped, block.rate_delta, block.phase);
+            } else {
+                robot_wait += 1 / ticks_per_second;
+            }
+            e_rate = pa.motor_rate(e_steps_per_mm, e_stepped, e_steps);
+
+            // the step ticker between two acceleration ticks
+            for(uint32_t t = 0; t < ticks_per_tick; t++) {
+                if(robot_stepped < block.steps_event_count) {
+                    robot_phase += rate / step_frequency;
+                    if(robot_phase >= 1) { robot_phase -= 1; robot_stepped++; }
+                }
+                if(e_stepped < e_steps) {
+                    e_phase += e_rate / step_frequency;
+                    if(e_phase >= 1) { e_phase -= 1; e_stepped++; }
+                }
+            }
+
+            if(robot_stepped < block.steps_event_count && free && !last) {
+                float lead = (e_position + direction * e_stepped / e_steps_per_mm) - (nominal + distance * robot_stepped / block.steps_event_count);
+                float error = fabsf(lead - k * rate * distance / block.steps_event_count);
+                if(error > max_lead_error) max_lead_error = error;
+            }
+        }
+
+        e_position += direction * e_steps / e_steps_per_mm;
+        nominal += distance;
+        moved += mm;
+
+        // k * extruder speed, or nothing before the travel
+        float lead = e_position - nominal;
+        if(fabsf(lead - want) > 2 / e_steps_per_mm) {
+            printf("  block %zu ends with lead %.4f mm, wanted %.4f mm\n", b, lead, want);
+            failures++;
+        }
+    }
+
+    float leftover = pa.take_lead();
+    printf("  robot waited %.1f ms on the extruder, worst lead error %.4f mm, %d blocks retract, %.4f mm left over\n", robot_wait * 1000, max_lead_error, retracts, leftover);
+    check(robot_wait * ticks_per_second <= blocks.size(), "robot waits at most a tick a block on the extruder");
+    // smoothing lags the lead on purpose, without it the extruder keeps within a few steps of it
+    if(smooth_time == 0) check(max_lead_error < 4 / e_steps_per_mm, "lead follows the extruder speed within the blocks");
+    check(fabsf(leftover) < 1e-5F, "no lead is left in the nozzle at the end");
+    check(fabsf(moved - nominal) < 1e-3F, "extrudes what was asked for");
+    check(fabsf(e_position - nominal) < blocks.size() / e_steps_per_mm, "steps add up to the extrusion");
+}
+
+int main()
+{
+    simulate(0, 0, 20, 10, false);
+    simulate(0.05F, 0, 20, 10, false);
+    simulate(0.05F, 0.04F, 20, 10, false);
+    simulate(0.2F, 0.02F, 8, 4, false);
+    simulate(0.05F, 0, 20, 10, true);
+    simulate(0.2F, 0.02F, 8, 4, true);
+
+    if(failures == 0) printf("all passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,358 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host test of the SD card driver against an emulated SDHC card on its SPI bus. The emulator answers the SPI mode
+// protocol a byte at a time: command responses, data tokens, CMD18 streaming blocks until CMD12, CMD25 taking 0xFC
+// blocks until the 0xFD stop token, data response tokens and busy.
+// Runs random single and multiple block reads and writes, with and without DMA, checks the data against a reference
+// image, that runs of blocks take one CMD18 or CMD25, and that the card is left deselected and idle after each.
+// Then checks that a read error token, a rejected write and an address out of range are reported and the card
+// still works after them. Reports the bytes clocked per sector for single and multiple block reads, the emulator
+// answers at once so this leaves out the access time a real card takes for every command.
+
+#include "SDCard.h"
+
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static const uint32_t c_size = 7;                   // (7 + 1) * 1024 sectors, 4MB
+static const uint32_t sectors = (c_size + 1) * 1024;
+
+class SdCardEmulator {
+    public:
+        enum Mode { IDLE, READ_MULTI, WRITE_SINGLE, WRITE_MULTI };
+
+        SdCardEmulator() : image(sectors * 512), selected(false), mode(IDLE), clocked(0), read_error_block(-1),
+            write_error_block(-1), cmd_len(0), rx_len(-1), app(false), initialising(true), next_block(0) {
+            for (auto &b : image) b = rand();
+            memset(commands, 0, sizeof(commands));
+        }
+
+        int exchange(int in) {
+            if(!selected) return 0xFF;
+            clocked++;
+            // a multiple block read streams blocks until CMD12
+            if(queue.empty() && mode == READ_MULTI) queue_block(next_block++);
+            int out = 0xFF;
+            if(!queue.empty()) {
+                out = queue.front();
+                queue.pop_front();
+            }
+            receive(in & 0xFF);
+            return out;
+        }
+
+        bool idle() const { return !selected && mode == IDLE && queue.empty() && cmd_len == 0 && rx_len < 0; }
+
+        std::vector<uint8_t> image;
+        bool selected;
+        Mode mode;
+        uint32_t commands[64];
+        uint64_t clocked;
+        int read_error_block;       // block that gets an error token instead of its data
+        int write_error_block;      // block whose write is rejected
+
+    private:
+        void receive(uint8_t in) {
+            if(cmd_len > 0) {
+                cmd[cmd_len++] = in;
+                if(cmd_len == 6) {
+                    cmd_len = 0;
+                    command();
+                }
+                return;
+            }
+
+            if(rx_len >= 0) {
+                // data block and its two CRC bytes
+                rx[rx_len++] = in;
+                if(rx_len == 514) {
+                    rx_len = -1;
+                    program();
+                }
+                return;
+            }
+
+            if(mode == WRITE_SINGLE || mode == WRITE_MULTI) {
+                if((mode == WRITE_SINGLE && in == 0xFE) || (mode == WRITE_MULTI && in == 0xFC)) {
+                    rx_len = 0;
+                } else if(mode == WRITE_MULTI && in == 0xFD) {
+                    // one byte after the stop token, then busy while the card finishes
+                    queue.push_back(0xFF);
+                    busy();
+                    mode = IDLE;
+                }
+                return;
+            }
+
+            if((in & 0xC0) == 0x40) {
+                cmd[0] = in;
+                cmd_len = 1;
+            }
+        }
+
+        void command() {
+            uint8_t c = cmd[0] & 0x3F;
+            uint32_t arg = (cmd[1] << 24) | (cmd[2] << 16) | (cmd[3] << 8) | cmd[4];
+            bool was_app = app;
+            app = false;
+            commands[c]++;
+
+            if(c == 12) {
+                // the stream stops, a stuff byte then R1 and busy
+                queue.clear();
+                queue.push_back(0xFF);
+                queue.push_back(0x00);
+                busy();
+                mode = IDLE;
+                return;
+            }
+
+            queue.push_back(0xFF);      // the card takes a byte to answer
+            uint8_t r1 = initialising ? 0x01 : 0x00;
+            switch(c) {
+                case 0:
+                    initialising = true;
+                    queue.push_back(0x01);
+                    break;
+                case 8:
+                    queue.push_back(r1);
+                    queue.push_back(0x00);
+                    queue.push_back(0x00);
+                    queue.push_back(0x01);
+                    queue.push_back(0xAA);
+                    break;
+                case 55:
+                    app = true;
+                    queue.push_back(r1);
+                    break;
+                case 41:
+                    // takes a second try to come out of idle
+                    if(was_app && (arg & (1UL << 30)) && commands[41] > 1) initialising = false;
+                    queue.push_back(initialising ? 0x01 : 0x00);
+                    break;
+                case 58:
+                    queue.push_back(r1);
+                    queue.push_back(0xC0);  // powered up, high capacity
+                    queue.push_back(0xFF);
+                    queue.push_back(0x80);
+                    queue.push_back(0x00);
+                    break;
+                case 9: {
+                    uint8_t csd[16];
+                    memset(csd, 0, sizeof(csd));
+                    set_bits(csd, 127, 126, 1);
+                    set_bits(csd, 69, 48, c_size);
+                    queue.push_back(r1);
+                    queue.push_back(0xFF);
+                    queue.push_back(0xFE);
+                    for (int i = 0; i < 16; i++) queue.push_back(csd[i]);
+                    queue.push_back(0xFF);
+                    queue.push_back(0xFF);
+                    break;
+                }
+                case 16:
+                    queue.push_back(arg == 512 ? r1 : 0x40);
+                    break;
+                case 17:
+                case 18:
+                case 24:
+                case 25:
+                    if(initialising || arg >= sectors) {
+                        queue.push_back(initialising ? 0x05 : 0x20);  // illegal command or address error
+                        break;
+                    }
+                    queue.push_back(0x00);
+                    next_block = arg;
+                    if(c == 17) {
+                        queue.push_back(0xFF);
+                        queue_block(next_block);
+                    } else if(c == 18) {
+                        mode = READ_MULTI;
+                    } else {
+                        mode = (c == 24) ? WRITE_SINGLE : WRITE_MULTI;
+                    }
+                    break;
+                default:
+                    queue.push_back(0x04);  // illegal command
+            }
+        }
+
+        void queue_block(uint32_t block) {
+            // a couple of bytes of access time before the token
+            queue.push_back(0xFF);
+            queue.push_back(0xFF);
+            if(block >= sectors || (int)block == read_error_block) {
+                queue.push_back(0x08);      // error token, out of range
+                return;
+            }
+            queue.push_back(0xFE);
+            for (int i = 0; i < 512; i++) queue.push_back(image[block * 512 + i]);
+            queue.push_back(0xFF);
+            queue.push_back(0xFF);
+        }
+
+        void program() {
+            uint32_t block = next_block++;
+            if(block >= sectors || (int)block == write_error_block) {
+                queue.push_back(0xED);      // write error, the high bits are undefined
+            } else {
+                memcpy(&image[block * 512], rx, 512);
+                queue.push_back(0xE5);      // accepted
+                busy();
+            }
+            if(mode == WRITE_SINGLE) mode = IDLE;
+        }
+
+        void busy() {
+            for (int i = 0; i < 3; i++) queue.push_back(0x00);
+        }
+
+        // the inverse of SDCard's ext_bits
+        static void set_bits(uint8_t *data, int msb, int lsb, uint32_t value) {
+            for (int position = lsb; position <= msb; position++) {
+                int byte = 15 - (position >> 3);
+                if(value & (1UL << (position - lsb))) data[byte] |= 1 << (position & 7);
+            }
+        }
+
+        std::deque<int> queue;      // what the card puts on MISO next
+        uint8_t cmd[6];
+        int cmd_len;
+        uint8_t rx[514];
+        int rx_len;                 // bytes of the data block being received, -1 when not receiving one
+        bool app;
+        bool initialising;
+        uint32_t next_block;
+};
+
+static SdCardEmulator *card;
+bool sd_spi_dma = false;
+
+int sd_spi_exchange(int out)
+{
+    return card->exchange(out);
+}
+
+void sd_spi_select(bool selected)
+{
+    card->selected = selected;
+}
+
+static void random_transfers(SDCard &sd, std::vector<uint8_t> &reference, int transfers)
+{
+    std::vector<char> buffer(16 * 512);
+    for (int t = 0; t < transfers; t++) {
+        uint32_t count = (rand() % 3 == 0) ? 1 : 1 + rand() % 16;
+        uint32_t block = rand() % (sectors - count + 1);
+        bool write = rand() % 2;
+
+        uint32_t single = card->commands[write ? 24 : 17];
+        uint32_t multi = card->commands[write ? 25 : 18];
+        uint32_t stops = card->commands[12];
+        int r;
+        if(write) {
+            for (uint32_t i = 0; i < count * 512; i++) buffer[i] = rand();
+            memcpy(&reference[block * 512], &buffer[0], count * 512);
+            r = sd.disk_write(&buffer[0], block, count);
+        } else {
+            r = sd.disk_read(&buffer[0], block, count);
+            CHECK(memcmp(&buffer[0], &reference[block * 512], count * 512) == 0);
+        }
+        CHECK(r == 0);
+        CHECK(card->idle());
+        CHECK(!sd.busy());
+        // one command for the whole run, a read is ended by CMD12 and a write by the stop token
+        CHECK(card->commands[write ? 24 : 17] - single == (count == 1 ? 1 : 0));
+        CHECK(card->commands[write ? 25 : 18] - multi == (count == 1 ? 0 : 1));
+        CHECK(card->commands[12] - stops == (!write && count > 1 ? 1 : 0));
+        if(failures > 0) return;
+    }
+    CHECK(card->image == reference);
+}
+
+// bytes clocked per sector to read 64 sectors count at a time
+static double clocked_per_sector(SDCard &sd, uint32_t count)
+{
+    std::vector<char> buffer(count * 512);
+    uint64_t start = card->clocked;
+    for (uint32_t block = 0; block < 64; block += count) {
+        CHECK(sd.disk_read(&buffer[0], 1000 + block, count) == 0);
+    }
+    return (card->clocked - start) / 64.0;
+}
+
+int main(int argc, char *argv[])
+{
+    srand(1);
+    card = new SdCardEmulator();
+    std::vector<uint8_t> reference = card->image;
+
+    SDCard sd(0, 0, 0, 0);
+    CHECK(sd.disk_initialize() == 0);
+    CHECK(sd.card_type() == SDCard::SDCARD_V2HC);
+    CHECK(sd.disk_sectors() == sectors);
+    CHECK(card->idle());
+    if(failures > 0) return 1;
+
+    sd_spi_dma = false;
+    random_transfers(sd, reference, 2000);
+    sd_spi_dma = true;
+    random_transfers(sd, reference, 2000);
+    printf("4000 random transfers, %u single and %u multiple block reads, %u single and %u multiple block writes\n",
+           card->commands[17], card->commands[18], card->commands[24], card->commands[25]);
+
+    for (uint32_t count : {1, 4, 16}) {
+        printf("  reads of %2u sectors clock %.1f bytes a sector\n", count, clocked_per_sector(sd, count));
+    }
+
+    std::vector<char> buffer(4 * 512);
+
+    // an error token part way through a multiple block read, the read fails and is still stopped
+    uint32_t stops = card->commands[12];
+    card->read_error_block = 102;
+    CHECK(sd.disk_read(&buffer[0], 100, 4) != 0);
+    CHECK(card->commands[12] == stops + 1);
+    CHECK(card->idle());
+    CHECK(sd.disk_read(&buffer[0], 102, 1) != 0);
+    CHECK(card->idle());
+    card->read_error_block = -1;
+    CHECK(sd.disk_read(&buffer[0], 100, 4) == 0);
+    CHECK(memcmp(&buffer[0], &reference[100 * 512], 4 * 512) == 0);
+
+    // a rejected block in a multiple block write, the ones before it are written and the card is left idle
+    card->write_error_block = 202;
+    for (auto &b : buffer) b = rand();
+    CHECK(sd.disk_write(&buffer[0], 200, 4) != 0);
+    CHECK(card->idle());
+    CHECK(memcmp(&card->image[200 * 512], &buffer[0], 2 * 512) == 0);
+    CHECK(memcmp(&card->image[202 * 512], &reference[202 * 512], 2 * 512) == 0);
+    card->write_error_block = -1;
+    CHECK(sd.disk_write(&buffer[0], 200, 4) == 0);
+    memcpy(&reference[200 * 512], &buffer[0], 4 * 512);
+
+    // out of range
+    CHECK(sd.disk_read(&buffer[0], sectors, 1) != 0);
+    CHECK(sd.disk_read(&buffer[0], sectors, 4) != 0);
+    CHECK(sd.disk_write(&buffer[0], sectors, 4) != 0);
+    CHECK(card->idle());
+    CHECK(!sd.busy());
+
+    CHECK(card->image == reference);
+
+    delete card;
+
+    if(failures == 0) printf("PASS\n");
+    return failures == 0 ? 0 : 1;
+}
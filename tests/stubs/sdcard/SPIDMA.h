@@ -0,0 +1,21 @@
+// Host stand in for the SSP DMA, a transfer clocks each byte through the emulated SD card
+
+#ifndef SPIDMA_H
+#define SPIDMA_H
+
+#include "mbed.h"
+
+class SPIDMA {
+    public:
+        SPIDMA(PinName mosi, PinName miso, PinName sclk) {}
+        bool available() const { return sd_spi_dma; }
+        bool transfer(const uint8_t *tx, uint8_t *rx, uint16_t length) {
+            for (uint16_t i = 0; i < length; i++) {
+                int in = sd_spi_exchange(tx != nullptr ? tx[i] : 0xFF);
+                if(rx != nullptr) rx[i] = in;
+            }
+            return true;
+        }
+};
+
+#endif
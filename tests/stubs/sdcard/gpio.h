@@ -0,0 +1,16 @@
+// Host stand in for the chip select pin of the emulated SD card
+
+#ifndef GPIO_H
+#define GPIO_H
+
+#include "mbed.h"
+
+class GPIO {
+    public:
+        GPIO(PinName pin) {}
+        void output() {}
+        // chip select is active low
+        int operator=(int value) { sd_spi_select(value == 0); return value; }
+};
+
+#endif
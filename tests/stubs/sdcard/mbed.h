@@ -0,0 +1,27 @@
+// Host stand in for the mbed pieces the SD card driver uses, its SPI bus goes to the card emulator in sdcard_test.cpp
+
+#ifndef MBED_H
+#define MBED_H
+
+#include <stdint.h>
+
+typedef int PinName;
+
+// the emulated card, out is clocked out on MOSI and what the card put on MISO is returned
+int sd_spi_exchange(int out);
+void sd_spi_select(bool selected);
+// whether the driver is given a DMA channel
+extern bool sd_spi_dma;
+
+namespace mbed {
+
+class SPI {
+    public:
+        SPI(PinName mosi, PinName miso, PinName sclk) {}
+        void frequency(int hz) {}
+        int write(int value) { return sd_spi_exchange(value); }
+};
+
+}
+
+#endif
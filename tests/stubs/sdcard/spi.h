@@ -0,0 +1,2 @@
+// Host stand in, the SPI class is in mbed.h
+#include "mbed.h"
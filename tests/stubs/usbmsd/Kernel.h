@@ -0,0 +1 @@
+// Host stand in, nothing USBMSD does on the host goes through the Kernel
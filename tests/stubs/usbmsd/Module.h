@@ -0,0 +1,12 @@
+// Host stand in for the module base class
+
+#ifndef MODULE_H
+#define MODULE_H
+
+class Module {
+    public:
+        virtual ~Module() {}
+        virtual void on_module_loaded() {}
+};
+
+#endif
@@ -0,0 +1,45 @@
+// Host stand in for the composite USB device, hands USBMSD the bulk OUT packet the test puts in out_packet and
+// records everything written to the bulk IN endpoint
+
+#ifndef _USB_HPP
+#define _USB_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "USBEndpoints.h"
+#include "descriptor.h"
+#include "USBDevice_Types.h"
+
+class USB {
+    public:
+        USB() : out_len(0), stalls(0), in_interrupt(false), next_endpoint(1) {}
+
+        int addInterface(usbdesc_interface *) { return 0; }
+        int addEndpoint(usbdesc_endpoint *endpoint) { endpoint->bEndpointAddress |= next_endpoint++; return 0; }
+        int addString(const void *) { return 0; }
+        void endpointSetInterrupt(uint8_t endpoint, bool enabled) { if(endpoint & 0x80) in_interrupt = enabled; }
+        bool readEP(uint8_t endpoint, uint8_t *buffer, uint32_t *size, uint32_t max) {
+            memcpy(buffer, out_packet, out_len);
+            *size = out_len;
+            return true;
+        }
+        bool readStart(uint8_t endpoint, uint32_t max) { return true; }
+        bool writeNB(uint8_t endpoint, uint8_t *buffer, uint32_t size, uint32_t max) {
+            in_data.insert(in_data.end(), buffer, buffer + size);
+            return true;
+        }
+        void stallEndpoint(uint8_t endpoint) { stalls++; }
+
+        uint8_t out_packet[64];
+        uint32_t out_len;
+        std::vector<uint8_t> in_data;
+        int stalls;
+        bool in_interrupt;
+
+    private:
+        int next_endpoint;
+};
+
+#endif
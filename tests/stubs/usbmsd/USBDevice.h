@@ -0,0 +1,2 @@
+// Host stand in, USBMSD only needs the types
+#include "USBDevice_Types.h"
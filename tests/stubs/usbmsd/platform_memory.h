@@ -0,0 +1,19 @@
+// Host stand in for the AHB0 pool, with a size the test sets so it can make USBMSD fall back to smaller chunks
+
+#ifndef PLATFORM_MEMORY_H
+#define PLATFORM_MEMORY_H
+
+#include <stdlib.h>
+
+struct HostPool {
+    size_t left;
+    void *alloc(size_t size) {
+        if(size > left) return NULL;
+        left -= size;
+        return malloc(size);
+    }
+};
+
+extern HostPool AHB0;
+
+#endif
@@ -0,0 +1,193 @@
+/*
+      This file is part of Smoothie (http://smoothieware.org/). The motion control part is heavily based on Grbl (https://github.com/simen/grbl).
+      Smoothie is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+      Smoothie is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+      You should have received a copy of the GNU General Public License along with Smoothie. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Host test of the USB mass storage transfers. Drives USBMSD through the CBW, data and CSW stages of random
+// READ(10) and WRITE(10) commands against a RAM disk, the way the host's bulk endpoints would, and checks the data
+// against a reference image and every CSW. Runs with room in AHB0 for each chunk size USBMSD can fall back to,
+// checks that the disk is only asked for whole chunks, and reports how many disk commands the blocks took.
+// Then checks that a failed disk read or write is reported in the CSW, and that host writes are counted.
+// The USB device and the AHB0 pool are stand ins in tests/stubs/usbmsd.
+
+#include "USBMSD.h"
+#include "platform_memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+HostPool AHB0;
+
+static const uint32_t disk_blocks = 4096;
+static const int transfers = 400;
+
+class RamDisk : public MSD_Disk {
+    public:
+        RamDisk(uint32_t blocks) : data(blocks * 512), commands(0), largest(0), fail_block(-1) {
+            for (auto &b : data) b = rand();
+        }
+
+        int disk_read(char *buffer, uint32_t block, uint32_t count) {
+            count_command(count);
+            memcpy(buffer, &data[block * 512], count * 512);
+            return failing(block, count);
+        }
+        int disk_write(const char *buffer, uint32_t block, uint32_t count) {
+            count_command(count);
+            if(failing(block, count)) return 1;
+            memcpy(&data[block * 512], buffer, count * 512);
+            return 0;
+        }
+        uint32_t disk_sectors() { return data.size() / 512; }
+        uint32_t disk_blocksize() { return 512; }
+        int disk_status() { return 0; }
+        bool busy() { return false; }
+
+        std::vector<uint8_t> data;
+        int commands;
+        uint32_t largest;
+        int fail_block;         // a read or write that includes it fails
+
+    private:
+        void count_command(uint32_t count) {
+            commands++;
+            if(count > largest) largest = count;
+        }
+        bool failing(uint32_t block, uint32_t count) const {
+            return fail_block >= 0 && (uint32_t)fail_block >= block && (uint32_t)fail_block < block + count;
+        }
+};
+
+static uint32_t tag = 1;
+
+static void send_cbw(USB &usb, USBMSD &msd, uint8_t opcode, uint32_t lba, uint16_t blocks, bool in)
+{
+    USBMSD::CBW cbw;
+    memset(&cbw, 0, sizeof(cbw));
+    cbw.Signature = 0x43425355;
+    cbw.Tag = tag++;
+    cbw.DataLength = blocks * 512;
+    cbw.Flags = in ? 0x80 : 0;
+    cbw.CBLength = 10;
+    cbw.CB[0] = opcode;
+    cbw.CB[2] = lba >> 24;
+    cbw.CB[3] = lba >> 16;
+    cbw.CB[4] = lba >> 8;
+    cbw.CB[5] = lba;
+    cbw.CB[7] = blocks >> 8;
+    cbw.CB[8] = blocks;
+
+    memcpy(usb.out_packet, &cbw, sizeof(cbw));
+    usb.out_len = sizeof(cbw);
+    msd.USBEvent_EPOut(msd.MSC_BulkOut.bEndpointAddress, 0);
+}
+
+// the host takes every IN packet until USBMSD has nothing more to send
+static void drain_in(USBMSD &msd)
+{
+    for (int i = 0; i < 100000 && msd.USBEvent_EPIn(msd.MSC_BulkIn.bEndpointAddress, 0); i++) {}
+}
+
+// the CSW is the last thing sent
+static USBMSD::CSW last_csw(USB &usb)
+{
+    USBMSD::CSW csw;
+    memset(&csw, 0, sizeof(csw));
+    if(usb.in_data.size() >= sizeof(csw)) memcpy(&csw, &usb.in_data[usb.in_data.size() - sizeof(csw)], sizeof(csw));
+    return csw;
+}
+
+static void read_blocks(USB &usb, USBMSD &msd, uint32_t lba, uint16_t blocks)
+{
+    usb.in_data.clear();
+    send_cbw(usb, msd, 0x28, lba, blocks, true);
+    drain_in(msd);
+}
+
+static void write_blocks(USB &usb, USBMSD &msd, uint32_t lba, uint16_t blocks, const uint8_t *data)
+{
+    usb.in_data.clear();
+    send_cbw(usb, msd, 0x2A, lba, blocks, false);
+    for (uint32_t i = 0; i < blocks * 512u; i += 64) {
+        memcpy(usb.out_packet, data + i, 64);
+        usb.out_len = 64;
+        msd.USBEvent_EPOut(msd.MSC_BulkOut.bEndpointAddress, 0);
+    }
+    // the CSW went out
+    drain_in(msd);
+}
+
+static void run(size_t pool, uint32_t chunk_blocks)
+{
+    AHB0.left = pool;
+    USB usb;
+    RamDisk disk(disk_blocks);
+    USBMSD *msd = new USBMSD(&usb, &disk);
+    CHECK(msd->connect());
+
+    std::vector<uint8_t> reference = disk.data;
+    std::vector<uint8_t> data(64 * 512);
+    uint32_t blocks_total = 0;
+    uint32_t writes = 0;
+    for (int t = 0; t < transfers && failures == 0; t++) {
+        uint16_t blocks = 1 + rand() % 64;
+        uint32_t lba = rand() % (disk_blocks - blocks);
+        bool read = rand() % 2;
+        if(read) {
+            read_blocks(usb, *msd, lba, blocks);
+            CHECK(usb.in_data.size() == blocks * 512u + sizeof(USBMSD::CSW));
+            CHECK(memcmp(&usb.in_data[0], &reference[lba * 512], blocks * 512) == 0);
+        } else {
+            for (uint32_t i = 0; i < blocks * 512u; i++) data[i] = rand();
+            memcpy(&reference[lba * 512], &data[0], blocks * 512);
+            write_blocks(usb, *msd, lba, blocks, &data[0]);
+            CHECK(usb.in_data.size() == sizeof(USBMSD::CSW));
+            writes++;
+        }
+        USBMSD::CSW csw = last_csw(usb);
+        CHECK(csw.Signature == 0x53425355);
+        CHECK(csw.Tag == tag - 1);
+        CHECK(csw.Status == 0);
+        CHECK(csw.DataResidue == 0);
+        blocks_total += blocks;
+    }
+    CHECK(disk.data == reference);
+    CHECK(disk.largest == chunk_blocks);
+    CHECK(usb.stalls == 0);
+    // every host write is counted, so the firmware's sector cache knows to drop what it holds
+    CHECK(disk.host_writes >= writes && (writes == 0) == (disk.host_writes == 0));
+    printf("  %4zu bytes of AHB0: %u blocks in %d disk commands\n", pool, blocks_total, disk.commands);
+
+    // a failing read or write reports failure
+    disk.fail_block = 100;
+    read_blocks(usb, *msd, 98, 4);
+    CHECK(last_csw(usb).Status == 1);
+    write_blocks(usb, *msd, 98, 4, &data[0]);
+    CHECK(last_csw(usb).Status == 1);
+    disk.fail_block = -1;
+    read_blocks(usb, *msd, 98, 4);
+    CHECK(last_csw(usb).Status == 0);
+
+    delete msd;
+}
+
+int main(int argc, char *argv[])
+{
+    srand(1);
+    printf("%d random transfers of 1 to 64 blocks\n", transfers);
+    run(8 * 512, 8);
+    run(4 * 512, 4);
+    run(3 * 512, 2);
+    run(512, 1);
+
+    if(failures == 0) printf("PASS\n");
+    return failures == 0 ? 0 : 1;
+}